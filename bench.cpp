@@ -0,0 +1,694 @@
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <filesystem>
+#include <random>
+#include <thread>
+#include <cmath>
+#include <cstring>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <simdjson.h>
+#include <spng.h>
+#include "dataset.h"
+#if !defined(_WIN32)
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#ifndef DATASET_VERSION
+#define DATASET_VERSION "unknown"
+#endif
+
+using namespace dataset;
+namespace fs = std::filesystem;
+
+struct BenchConfig
+{
+    std::string out_dir = "dataset_bench_data";
+    std::string report_path;
+    uint32_t frames = 64;
+    uint32_t width = 800;
+    uint32_t height = 800;
+    double alpha = 0.5;
+    uint64_t seed = 1;
+    uint32_t repeat = 3;
+    PixelFormat pixel_format = PixelFormat::RGBA8;
+    std::string pixel_format_name = "rgba8";
+    std::vector<uint32_t> threads;
+    bool keep = false;
+};
+
+// Best and median wall time of the repeats of one measurement, in seconds
+struct Timing
+{
+    double best = 0;
+    double median = 0;
+};
+
+struct Dataset
+{
+    uint64_t png_bytes = 0;
+    uint64_t manifest_bytes = 0;
+    uint64_t pixel_bytes = 0; // decoded RGBA8
+};
+
+int usage()
+{
+    std::cerr << "usage:\n";
+    std::cerr << "  dataset_bench [--out DIR] [--frames N] [--size WxH] [--alpha COVERAGE] [--seed N] [--pf rgba8|rgba32f|rgba16f|rgb8|rgb16f] [--threads N[,N...]] [--repeat N] [--report FILE] [--keep]\n";
+    return 1;
+}
+
+double seconds_since(std::chrono::steady_clock::time_point t0)
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+}
+
+template <class F>
+Timing time_repeats(uint32_t repeat, F&& fn)
+{
+    std::vector<double> s;
+    for (uint32_t r = 0; r < repeat; r++)
+    {
+        auto t0 = std::chrono::steady_clock::now();
+        if (!fn()) return Timing{};
+        s.push_back(seconds_since(t0));
+    }
+    std::sort(s.begin(), s.end());
+    return Timing{s.front(), s[s.size() / 2]};
+}
+
+double mbps(uint64_t bytes, double seconds)
+{
+    return seconds > 0 ? bytes / seconds / 1e6 : 0.0;
+}
+
+// Runs fn(i) for i in [0, n) on up to threads workers pulling from a shared counter
+template <class F>
+void run_parallel(size_t n, uint32_t threads, F&& fn)
+{
+    std::atomic<size_t> next{0};
+    auto work = [&]
+    {
+        for (size_t i; (i = next.fetch_add(1)) < n;) fn(i);
+    };
+    std::vector<std::thread> pool;
+    for (uint32_t t = 1; t < std::min<size_t>(threads, n); t++) pool.emplace_back(work);
+    work();
+    for (auto& t : pool) t.join();
+}
+
+// splitmix64, so generated frames do not depend on the standard library's engines
+uint64_t mix(uint64_t x)
+{
+    x += 0x9e3779b97f4a7c15ull;
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ull;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebull;
+    return x ^ (x >> 31);
+}
+
+// One RGBA8 frame: smooth colour gradients with low-amplitude noise, so PNG compresses roughly like a
+// render, inside an opaque rectangle covering the requested fraction of the image and transparent outside
+std::vector<unsigned char> synth_frame(const BenchConfig& cfg, uint32_t index)
+{
+    uint32_t w = cfg.width;
+    uint32_t h = cfg.height;
+    std::vector<unsigned char> px((size_t)w * h * 4);
+    double s = std::sqrt(std::clamp(cfg.alpha, 0.0, 1.0));
+    uint64_t key = mix(cfg.seed ^ ((uint64_t)index << 32));
+    uint32_t ow = (uint32_t)std::lround(s * w);
+    uint32_t oh = (uint32_t)std::lround(s * h);
+    uint32_t x0 = w > ow ? (uint32_t)(key % (w - ow + 1)) : 0;
+    uint32_t y0 = h > oh ? (uint32_t)((key >> 32) % (h - oh + 1)) : 0;
+    for (uint32_t y = 0; y < h; y++)
+    {
+        unsigned char* row = px.data() + (size_t)y * w * 4;
+        for (uint32_t x = 0; x < w; x++)
+        {
+            uint64_t n = mix(key + (uint64_t)y * w + x);
+            row[x * 4 + 0] = (unsigned char)((x * 255u / std::max(w, 1u) + index * 7u + (n & 7)) & 255);
+            row[x * 4 + 1] = (unsigned char)((y * 255u / std::max(h, 1u) + ((n >> 3) & 7)) & 255);
+            row[x * 4 + 2] = (unsigned char)(((x + y) * 127u / std::max(w + h, 1u) + 64 + ((n >> 6) & 7)) & 255);
+            bool in = x >= x0 && x < x0 + ow && y >= y0 && y < y0 + oh;
+            row[x * 4 + 3] = in ? 255 : 0;
+        }
+    }
+    return px;
+}
+
+bool write_png(const std::string& path, const std::vector<unsigned char>& px, uint32_t w, uint32_t h, uint64_t& bytes)
+{
+    spng_ctx* ctx = spng_ctx_new(SPNG_CTX_ENCODER);
+    if (!ctx) return false;
+    spng_set_option(ctx, SPNG_ENCODE_TO_BUFFER, 1);
+    spng_ihdr ih{};
+    ih.width = w;
+    ih.height = h;
+    ih.bit_depth = 8;
+    ih.color_type = SPNG_COLOR_TYPE_TRUECOLOR_ALPHA;
+    int err = spng_set_ihdr(ctx, &ih);
+    if (!err) err = spng_encode_image(ctx, px.data(), px.size(), SPNG_FMT_PNG, SPNG_ENCODE_FINALIZE);
+    size_t n = 0;
+    void* buf = err ? nullptr : spng_get_png_buffer(ctx, &n, &err);
+    spng_ctx_free(ctx);
+    if (!buf) return false;
+    std::ofstream fo(path, std::ios::binary | std::ios::trunc);
+    fo.write((const char*)buf, (std::streamsize)n);
+    free(buf);
+    bytes += n;
+    return (bool)fo;
+}
+
+// Writes cfg.frames PNGs under out_dir/train and a NeRF synthetic transforms.json with cameras on a circle
+bool generate(const BenchConfig& cfg, Dataset& ds)
+{
+    std::error_code ec;
+    fs::create_directories(fs::path(cfg.out_dir) / "train", ec);
+    if (ec) return false;
+    std::vector<uint64_t> bytes(cfg.frames);
+    std::atomic<bool> ok{true};
+    run_parallel(cfg.frames, std::max(1u, std::thread::hardware_concurrency()), [&](size_t i)
+    {
+        std::string p = (fs::path(cfg.out_dir) / "train" / ("r_" + std::to_string(i) + ".png")).string();
+        if (!write_png(p, synth_frame(cfg, (uint32_t)i), cfg.width, cfg.height, bytes[i])) ok = false;
+    });
+    if (!ok) return false;
+    std::ostringstream js;
+    js.precision(9);
+    js << "{\"camera_angle_x\": 0.6911112070083618, \"frames\": [";
+    for (uint32_t i = 0; i < cfg.frames; i++)
+    {
+        double a = 2.0 * 3.14159265358979323846 * i / cfg.frames;
+        double c = std::cos(a);
+        double s = std::sin(a);
+        js << (i ? ", " : "") << "{\"file_path\": \"./train/r_" << i << "\", \"transform_matrix\": [["
+           << c << ", 0, " << s << ", " << 4 * s << "], [0, 1, 0, 0.5], [" << -s << ", 0, " << c << ", " << 4 * c
+           << "], [0, 0, 0, 1]]}";
+    }
+    js << "]}";
+    std::string s = js.str();
+    std::ofstream fo(fs::path(cfg.out_dir) / "transforms.json", std::ios::binary | std::ios::trunc);
+    fo.write(s.data(), (std::streamsize)s.size());
+    ds.png_bytes = 0;
+    for (uint64_t b : bytes) ds.png_bytes += b;
+    ds.manifest_bytes = s.size();
+    ds.pixel_bytes = (uint64_t)cfg.frames * cfg.width * cfg.height * 4;
+    return (bool)fo;
+}
+
+// Removes only what generate and the builds wrote, in case the output directory held anything else
+void remove_generated(const BenchConfig& cfg, const std::string& pack)
+{
+    std::error_code ec;
+    fs::path dir(cfg.out_dir);
+    for (uint32_t i = 0; i < cfg.frames; i++) fs::remove(dir / "train" / ("r_" + std::to_string(i) + ".png"), ec);
+    fs::remove(dir / "train", ec);
+    fs::remove(dir / "transforms.json", ec);
+    fs::remove(pack, ec);
+    fs::remove(dir, ec);
+}
+
+bool read_file(const std::string& path, std::vector<unsigned char>& out)
+{
+    std::ifstream fi(path, std::ios::binary);
+    if (!fi) return false;
+    out.assign(std::istreambuf_iterator<char>(fi), std::istreambuf_iterator<char>());
+    return true;
+}
+
+// Pushes a file's dirty pages to disk so a following eviction really leaves the page cache cold
+void flush_file(const std::string& path)
+{
+#if !defined(_WIN32)
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) return;
+    ::fsync(fd);
+    ::close(fd);
+#else
+    (void)path;
+#endif
+}
+
+BuildConfig build_config(const BenchConfig& cfg, uint32_t threads)
+{
+    BuildConfig b{};
+    b.dataset_root = cfg.out_dir;
+    b.config_path = "auto";
+    b.pixel_format = cfg.pixel_format;
+    b.row_align = 16;
+    b.block_align = 4096;
+    b.threads = threads;
+    b.mip_levels = 1;
+    b.mip_filter = MipFilter::Box;
+    return b;
+}
+
+// JSON: one On-Demand walk over the manifest's frames, paths and matrices, as the build's loader does it
+Timing stage_json(const BenchConfig& cfg)
+{
+    simdjson::padded_string json;
+    if (simdjson::padded_string::load((fs::path(cfg.out_dir) / "transforms.json").string()).get(json)) return Timing{};
+    simdjson::ondemand::parser parser;
+    return time_repeats(cfg.repeat, [&]
+    {
+        simdjson::ondemand::document doc;
+        simdjson::ondemand::array frames;
+        if (parser.iterate(json).get(doc) || doc["frames"].get_array().get(frames)) return false;
+        double sum = 0;
+        for (auto f : frames)
+        {
+            std::string_view path;
+            simdjson::ondemand::array rows;
+            if (f["file_path"].get_string().get(path) || f["transform_matrix"].get_array().get(rows)) return false;
+            for (auto row : rows)
+            {
+                for (auto x : row.get_array())
+                {
+                    double d = 0;
+                    if (x.get_double().get(d)) return false;
+                    sum += d;
+                }
+            }
+        }
+        return std::isfinite(sum);
+    });
+}
+
+// Decode: every PNG to RGBA8 with libspng, files already in memory, frames spread over threads
+Timing stage_decode(const BenchConfig& cfg, uint32_t threads)
+{
+    std::vector<std::vector<unsigned char>> files(cfg.frames);
+    for (uint32_t i = 0; i < cfg.frames; i++)
+    {
+        if (!read_file((fs::path(cfg.out_dir) / "train" / ("r_" + std::to_string(i) + ".png")).string(), files[i])) return Timing{};
+    }
+    return time_repeats(cfg.repeat, [&]
+    {
+        std::atomic<bool> ok{true};
+        run_parallel(cfg.frames, threads, [&](size_t i)
+        {
+            spng_ctx* ctx = spng_ctx_new(0);
+            size_t n = 0;
+            std::vector<unsigned char> px;
+            bool good = ctx && !spng_set_png_buffer(ctx, files[i].data(), files[i].size()) && !spng_decoded_image_size(ctx, SPNG_FMT_RGBA8, &n);
+            if (good)
+            {
+                px.resize(n);
+                good = !spng_decode_image(ctx, px.data(), n, SPNG_FMT_RGBA8, 0);
+            }
+            spng_ctx_free(ctx);
+            if (!good) ok = false;
+        });
+        return ok.load();
+    });
+}
+
+// Convert: the built pack's frames to linear RGBA32F through the library's SIMD kernels
+Timing stage_convert(const BenchConfig& cfg, PackHandle h, uint32_t threads)
+{
+    size_t n = frame_count(h);
+    bool srgb = cfg.pixel_format == PixelFormat::RGBA8 || cfg.pixel_format == PixelFormat::RGB8;
+    return time_repeats(cfg.repeat, [&]
+    {
+        std::atomic<bool> ok{true};
+        run_parallel(n, threads, [&](size_t i)
+        {
+            ImageView v = image_view(h, i);
+            std::vector<float> dst((size_t)v.width * v.height * 4);
+            if (!v.data || image_to_rgba32f(v, dst.data(), (size_t)v.width * 4 * sizeof(float), srgb)) ok = false;
+        });
+        return ok.load();
+    });
+}
+
+// Write: the pack's bytes streamed to a fresh file through ofstream and flushed to disk
+Timing stage_write(const BenchConfig& cfg, PackHandle h, const std::string& path)
+{
+    size_t n = frame_count(h);
+    std::string out = path + ".write";
+    Timing t = time_repeats(cfg.repeat, [&]
+    {
+        std::ofstream fo(out, std::ios::binary | std::ios::trunc);
+        for (size_t i = 0; i < n && fo; i++)
+        {
+            ImageView v = image_view(h, i);
+            fo.write((const char*)v.data, (std::streamsize)((size_t)v.row_stride * v.roi_h));
+        }
+        fo.close();
+        flush_file(out);
+        return (bool)fo;
+    });
+    std::error_code ec;
+    fs::remove(out, ec);
+    return t;
+}
+
+uint64_t frame_bytes(PackHandle h)
+{
+    uint64_t b = 0;
+    for (size_t i = 0; i < frame_count(h); i++)
+    {
+        ImageView v = image_view(h, i);
+        b += (uint64_t)v.row_stride * v.roi_h;
+    }
+    return b;
+}
+
+// Touches every word of each frame in order, returning a checksum so the loads cannot be elided
+uint64_t read_frames(PackHandle h, const std::vector<size_t>& order)
+{
+    uint64_t acc = 0;
+    for (size_t i : order)
+    {
+        ImageView v = image_view(h, i);
+        const unsigned char* p = (const unsigned char*)v.data;
+        size_t bytes = (size_t)v.row_stride * v.roi_h;
+        size_t k = 0;
+        for (; k + 8 <= bytes; k += 8)
+        {
+            uint64_t w;
+            std::memcpy(&w, p + k, 8);
+            acc += w;
+        }
+        for (; k < bytes; k++) acc += p[k];
+    }
+    return acc;
+}
+
+struct ReadResult
+{
+    double cold = 0;
+    double warm = 0;
+};
+
+// Read bandwidth in MB/s over the order given, cold after evicting every frame and warm on a second pass
+ReadResult bench_read(PackHandle h, const std::vector<size_t>& order, uint64_t bytes, uint64_t& sink)
+{
+    ReadResult r;
+    std::vector<size_t> all(frame_count(h));
+    for (size_t i = 0; i < all.size(); i++) all[i] = i;
+    evict_frames(h, all.data(), all.size());
+    auto t0 = std::chrono::steady_clock::now();
+    sink += read_frames(h, order);
+    r.cold = mbps(bytes, seconds_since(t0));
+    t0 = std::chrono::steady_clock::now();
+    sink += read_frames(h, order);
+    r.warm = mbps(bytes, seconds_since(t0));
+    return r;
+}
+
+// Open latency in microseconds, median of repeated open/close pairs
+double bench_open(const std::string& path)
+{
+    std::vector<double> s;
+    for (int r = 0; r < 32; r++)
+    {
+        auto t0 = std::chrono::steady_clock::now();
+        PackHandle h = open_hostpack(path);
+        double t = seconds_since(t0);
+        if (!h) return -1;
+        close_hostpack(h);
+        s.push_back(t);
+    }
+    std::sort(s.begin(), s.end());
+    return s[s.size() / 2] * 1e6;
+}
+
+// Walks the camera SoA the way a ray sampler does (intrinsics, pose, size), repeated until the pass
+// takes long enough to time; returns cameras per second and sets MB/s
+double bench_camera_scan(PackHandle h, double& mb_s, uint64_t& sink)
+{
+    CameraSOAView c = camera_soa(h);
+    if (!c.count) return 0;
+    size_t per_cam = 4 * sizeof(float) + 12 * sizeof(float) + 2 * sizeof(uint32_t);
+    uint64_t cams = 0;
+    double acc = 0;
+    auto t0 = std::chrono::steady_clock::now();
+    double t = 0;
+    do
+    {
+        for (int r = 0; r < 64; r++)
+        {
+            for (size_t i = 0; i < c.count; i++)
+            {
+                const float* T = c.T3x4 + i * 12;
+                acc += (c.fx[i] + c.fy[i]) * (c.cx[i] + c.cy[i]) + T[3] + T[7] + T[11] + (double)c.width[i] * c.height[i];
+            }
+            cams += c.count;
+        }
+        t = seconds_since(t0);
+    } while (t < 0.05);
+    sink += (uint64_t)acc;
+    mb_s = mbps(cams * per_cam, t);
+    return cams / t;
+}
+
+struct GatherResult
+{
+    uint64_t batch = 0;
+    double fused = 0;
+    double loop = 0;
+};
+
+// Batches of frames into an NCHW float tensor (sRGB decoded, composited onto grey, normalized) in MB/s of
+// tensor written: gather_frames against the per-frame image_to_rgba32f and scalar copy it replaces
+GatherResult bench_gather(PackHandle h, uint32_t threads, uint64_t& sink)
+{
+    GatherResult g;
+    size_t n = frame_count(h);
+    if (!n) return g;
+    ImageView v0 = image_view(h, 0);
+    size_t w = v0.width;
+    size_t hh = v0.height;
+    g.batch = std::min<size_t>(n, 8);
+    size_t plane = w * hh;
+    std::vector<float> tensor(g.batch * 3 * plane);
+    std::vector<float> rgba(plane * 4);
+    TensorFormat f{};
+    f.type = TensorType::F32;
+    f.channels = 3;
+    f.srgb_to_linear = true;
+    f.composite = true;
+    f.threads = threads;
+    for (int c = 0; c < 3; c++)
+    {
+        f.background[c] = 0.5f;
+        f.mean[c] = 0.5f;
+        f.std[c] = 0.25f;
+    }
+    uint64_t bytes = 0;
+    auto t0 = std::chrono::steady_clock::now();
+    for (size_t b = 0; b + g.batch <= n; b += g.batch)
+    {
+        std::vector<size_t> idx(g.batch);
+        for (size_t k = 0; k < g.batch; k++) idx[k] = b + k;
+        if (gather_frames(h, idx.data(), idx.size(), PixelRect{}, TensorLayout::NCHW, f, tensor.data()) != 0) return g;
+        sink += (uint64_t)tensor[b % tensor.size()];
+        bytes += tensor.size() * sizeof(float);
+    }
+    g.fused = mbps(bytes, seconds_since(t0));
+    t0 = std::chrono::steady_clock::now();
+    for (size_t b = 0; b + g.batch <= n; b += g.batch)
+    {
+        for (size_t k = 0; k < g.batch; k++)
+        {
+            ImageView v = image_view(h, b + k);
+            if (v.width != w || v.height != hh || image_to_rgba32f(v, rgba.data(), 0, true) != 0) return g;
+            for (size_t p = 0; p < plane; p++)
+            {
+                float a = rgba[p * 4 + 3];
+                for (int c = 0; c < 3; c++) tensor[(k * 3 + c) * plane + p] = (rgba[p * 4 + c] * a + 0.5f * (1.0f - a) - 0.5f) / 0.25f;
+            }
+        }
+        sink += (uint64_t)tensor[b % tensor.size()];
+    }
+    g.loop = mbps(bytes, seconds_since(t0));
+    return g;
+}
+
+void json_timing(std::ostream& o, const char* name, const Timing& t, uint64_t bytes)
+{
+    o << "\"" << name << "\": {\"seconds_best\": " << t.best << ", \"seconds_median\": " << t.median
+      << ", \"mb_s\": " << mbps(bytes, t.best) << "}";
+}
+
+int parse_args(int argc, char** argv, BenchConfig& cfg)
+{
+    for (int i = 1; i < argc; i++)
+    {
+        if (!std::strcmp(argv[i], "--out") && i + 1 < argc)
+        {
+            cfg.out_dir = argv[++i];
+        }
+        else if (!std::strcmp(argv[i], "--frames") && i + 1 < argc)
+        {
+            cfg.frames = (uint32_t)std::stoul(argv[++i]);
+        }
+        else if (!std::strcmp(argv[i], "--size") && i + 1 < argc)
+        {
+            if (std::sscanf(argv[++i], "%ux%u", &cfg.width, &cfg.height) != 2) return usage();
+        }
+        else if (!std::strcmp(argv[i], "--alpha") && i + 1 < argc)
+        {
+            cfg.alpha = std::stod(argv[++i]);
+        }
+        else if (!std::strcmp(argv[i], "--seed") && i + 1 < argc)
+        {
+            cfg.seed = std::stoull(argv[++i]);
+        }
+        else if (!std::strcmp(argv[i], "--repeat") && i + 1 < argc)
+        {
+            cfg.repeat = (uint32_t)std::stoul(argv[++i]);
+        }
+        else if (!std::strcmp(argv[i], "--report") && i + 1 < argc)
+        {
+            cfg.report_path = argv[++i];
+        }
+        else if (!std::strcmp(argv[i], "--keep"))
+        {
+            cfg.keep = true;
+        }
+        else if (!std::strcmp(argv[i], "--threads") && i + 1 < argc)
+        {
+            std::stringstream ss(argv[++i]);
+            for (std::string t; std::getline(ss, t, ',');) cfg.threads.push_back((uint32_t)std::stoul(t));
+        }
+        else if (!std::strcmp(argv[i], "--pf") && i + 1 < argc)
+        {
+            static const std::pair<const char*, PixelFormat> kFormats[] = {{"rgba8", PixelFormat::RGBA8}, {"rgba32f", PixelFormat::RGBA32F}, {"rgba16f", PixelFormat::RGBA16F}, {"rgb8", PixelFormat::RGB8}, {"rgb16f", PixelFormat::RGB16F}};
+            auto f = std::find_if(std::begin(kFormats), std::end(kFormats), [&](const auto& p) { return !std::strcmp(p.first, argv[i + 1]); });
+            if (f == std::end(kFormats)) return usage();
+            cfg.pixel_format = f->second;
+            cfg.pixel_format_name = f->first;
+            i++;
+        }
+        else if (!std::strcmp(argv[i], "--help") || !std::strcmp(argv[i], "-h"))
+        {
+            return usage();
+        }
+        else
+        {
+            std::cerr << "unknown option: " << argv[i] << "\n";
+            return 2;
+        }
+    }
+    if (!cfg.frames || !cfg.width || !cfg.height || !cfg.repeat)
+    {
+        std::cerr << "frames, size and repeat must be positive\n";
+        return 2;
+    }
+    if (cfg.threads.empty()) cfg.threads.push_back(std::max(1u, std::thread::hardware_concurrency()));
+    return 0;
+}
+
+int main(int argc, char** argv)
+{
+    BenchConfig cfg;
+    if (int r = parse_args(argc, argv, cfg)) return r;
+    Dataset ds;
+    auto t0 = std::chrono::steady_clock::now();
+    if (!generate(cfg, ds))
+    {
+        std::cerr << "generating dataset in " << cfg.out_dir << " failed\n";
+        return 3;
+    }
+    std::cerr << "generated " << cfg.frames << " frames (" << ds.png_bytes / 1e6 << " MB png) in " << seconds_since(t0) << " s\n";
+
+    std::string pack = (fs::path(cfg.out_dir) / "bench.hostpack").string();
+    std::ostringstream o;
+    o.precision(6);
+    o << "{\n  \"bench\": \"dataset_bench\",\n  \"version\": \"" << DATASET_VERSION << "\",\n";
+    o << "  \"host\": {\"hardware_concurrency\": " << std::thread::hardware_concurrency() << ", \"simd\": \"" << simd_kernel_name() << "\"},\n";
+    o << "  \"dataset\": {\"frames\": " << cfg.frames << ", \"width\": " << cfg.width << ", \"height\": " << cfg.height
+      << ", \"alpha\": " << cfg.alpha << ", \"seed\": " << cfg.seed << ", \"png_bytes\": " << ds.png_bytes
+      << ", \"manifest_bytes\": " << ds.manifest_bytes << ", \"pixel_bytes\": " << ds.pixel_bytes << "},\n";
+    o << "  \"pixel_format\": \"" << cfg.pixel_format_name << "\",\n  \"repeat\": " << cfg.repeat << ",\n  \"runs\": [";
+    uint64_t sink = 0;
+    uint64_t pack_size = 0;
+    for (size_t k = 0; k < cfg.threads.size(); k++)
+    {
+        uint32_t th = cfg.threads[k];
+        BuildConfig b = build_config(cfg, th);
+        Timing build = time_repeats(cfg.repeat, [&] { return build_hostpack(b, pack) == 0; });
+        if (build.best <= 0)
+        {
+            std::cerr << "build failed error=" << (int)last_error() << "\n";
+            return 3;
+        }
+        PackHandle h = open_hostpack(pack);
+        if (!h)
+        {
+            std::cerr << "open failed error=" << (int)last_error() << "\n";
+            return 3;
+        }
+        pack_size = pack_bytes(h);
+        uint64_t fb = frame_bytes(h);
+        Timing json = stage_json(cfg);
+        Timing decode = stage_decode(cfg, th);
+        Timing convert = stage_convert(cfg, h, th);
+        Timing write = stage_write(cfg, h, pack);
+        close_hostpack(h);
+        o << (k ? "," : "") << "\n    {\"threads\": " << th << ",\n      ";
+        o << "\"build\": {\"seconds_best\": " << build.best << ", \"seconds_median\": " << build.median
+          << ", \"src_mb_s\": " << mbps(ds.png_bytes, build.best) << ", \"pixel_mb_s\": " << mbps(ds.pixel_bytes, build.best)
+          << ", \"out_mb_s\": " << mbps(pack_size, build.best) << "},\n      \"stages\": {";
+        json_timing(o, "json", json, ds.manifest_bytes);
+        o << ", ";
+        json_timing(o, "decode", decode, ds.pixel_bytes);
+        o << ", ";
+        json_timing(o, "convert", convert, ds.pixel_bytes);
+        o << ", ";
+        json_timing(o, "write", write, fb);
+        o << "}}";
+        std::cerr << "threads=" << th << " build " << mbps(ds.pixel_bytes, build.best) << " MB/s\n";
+    }
+    o << "\n  ],\n";
+
+    flush_file(pack);
+    double open_us = bench_open(pack);
+    PackHandle h = open_hostpack(pack);
+    if (!h)
+    {
+        std::cerr << "open failed error=" << (int)last_error() << "\n";
+        return 3;
+    }
+    uint64_t fb = frame_bytes(h);
+    std::vector<size_t> seq(frame_count(h));
+    for (size_t i = 0; i < seq.size(); i++) seq[i] = i;
+    std::vector<size_t> rnd = seq;
+    std::shuffle(rnd.begin(), rnd.end(), std::mt19937_64(cfg.seed));
+    ReadResult rs = bench_read(h, seq, fb, sink);
+    ReadResult rr = bench_read(h, rnd, fb, sink);
+    double cam_mb_s = 0;
+    double cams_s = bench_camera_scan(h, cam_mb_s, sink);
+    GatherResult gr = bench_gather(h, cfg.threads.back(), sink);
+    close_hostpack(h);
+    o << "  \"pack_bytes\": " << pack_size << ",\n  \"open_us\": " << open_us << ",\n";
+    o << "  \"read\": {\"frame_bytes\": " << fb << ", \"sequential_cold_mb_s\": " << rs.cold << ", \"sequential_warm_mb_s\": " << rs.warm
+      << ", \"random_cold_mb_s\": " << rr.cold << ", \"random_warm_mb_s\": " << rr.warm << "},\n";
+    o << "  \"camera_scan\": {\"cameras_per_s\": " << cams_s << ", \"mb_s\": " << cam_mb_s << "},\n";
+    o << "  \"gather\": {\"batch\": " << gr.batch << ", \"threads\": " << cfg.threads.back() << ", \"fused_mb_s\": " << gr.fused << ", \"per_frame_mb_s\": " << gr.loop << "},\n";
+    o << "  \"checksum\": " << (sink & 0xffff) << "\n}\n";
+
+    if (!cfg.keep) remove_generated(cfg, pack);
+    if (cfg.report_path.empty())
+    {
+        std::cout << o.str();
+        return 0;
+    }
+    std::ofstream fo(cfg.report_path, std::ios::binary | std::ios::trunc);
+    fo << o.str();
+    if (!fo)
+    {
+        std::cerr << "writing " << cfg.report_path << " failed\n";
+        return 3;
+    }
+    return 0;
+}
@@ -10,5 +10,9 @@ function(dataset_link_thirdparty target)
     if (NOT TARGET ${target})
         message(FATAL_ERROR "Missing target: ${target}")
     endif ()
-    target_link_libraries(${target} PRIVATE simdjson::simdjson spng_static OpenEXR::OpenEXR TBB::tbb)
+    target_link_libraries(${target} PRIVATE simdjson::simdjson spng_static libdeflate::libdeflate_static OpenEXR::OpenEXR TBB::tbb)
+    # shm_open lives in librt before glibc 2.34
+    if (CMAKE_SYSTEM_NAME STREQUAL "Linux")
+        target_link_libraries(${target} PRIVATE rt)
+    endif ()
 endfunction()
@@ -3,14 +3,34 @@
 
 #include <cstdint>
 #include <cstddef>
+#include <cmath>
+#include <atomic>
+#include <coroutine>
+#include <future>
+#include <memory>
 #include <string>
+#include <vector>
 
 namespace dataset
 {
-    enum class PixelFormat : uint32_t { RGBA8 = 1, RGBA32F = 2 };
+    // RGBA16F/RGB16F hold linear half floats; RGB formats drop alpha after compositing onto BuildConfig::background
+    enum class PixelFormat : uint32_t { RGBA8 = 1, RGBA32F = 2, RGBA16F = 3, RGB8 = 4, RGB16F = 5 };
 
     enum class ColorSpace : uint32_t { Linear = 0, SRGB = 1 };
 
+    enum class MipFilter : uint32_t { Box = 0, Kaiser = 1 };
+
+    // What weights a tile of an importance table: alpha coverage, gradient magnitude of alpha-premultiplied
+    // luma and of alpha, or their sum
+    enum class ImportanceSource : uint32_t { None = 0, Alpha = 1, Gradient = 2, AlphaGradient = 3 };
+
+    enum class AccessPattern : uint32_t { Normal = 0, Random = 1, Sequential = 2 };
+
+    // Lazy: demand-paged file mapping. Populate: same mapping, read in at open. HugeCopy: private copy in
+    // huge-page-backed anonymous memory. Shared: one named shared-memory copy per node that sibling
+    // processes attach to (POSIX only).
+    enum class Residency : uint32_t { Lazy = 0, Populate = 1, HugeCopy = 2, Shared = 3 };
+
     enum class Error : int32_t { Ok = 0, IoFail = -1, BadConfig = -2, BadPack = -3, Unsupported = -4, NoMemory = -5, Internal = -6 };
 
     struct BuildConfig
@@ -20,12 +40,181 @@ namespace dataset
         PixelFormat pixel_format;
         uint32_t row_align;
         uint32_t block_align;
-        uint32_t threads;
+        uint32_t threads; // build task arena concurrency, 0 = hardware concurrency
+        uint64_t memory_budget; // bytes of decoded/converted frames kept in flight, 0 = 1 GiB
+        bool mapped_output; // pre-size the pack and decode frames directly into a writable mapping
+        bool premultiply_alpha; // store RGB * A for formats that keep alpha
+        float background[3]; // composite color for RGB formats, in the stored encoding (sRGB for RGB8)
+        uint32_t mip_levels; // levels stored per frame including the base, 0 or 1 = base only, clamped to the full chain
+        MipFilter mip_filter; // applied in linear light to alpha-premultiplied color
+        uint32_t tile_size; // 0 = scanline rows, else a power of two edge of Morton-ordered square tiles
+        bool ray_table; // store per-pixel ray directions and scene AABB entry/exit distances
+        uint32_t compress_level; // 0 = raw, 1-12 = DEFLATE level of each frame block (mips included)
+        bool incremental; // reuse frames of the pack already at out_path whose source files are unchanged
+        bool crop_alpha; // store only each frame's bounding box of non-zero alpha; the rest reads as ImageView::fill
+        uint32_t crop_margin; // pixels kept around the box (rounded out further to whole texels of the mip chain)
+        ImportanceSource importance; // store per-frame tile sampling tables and a frame table weighted by this
+        uint32_t importance_tile; // tile edge in pixels, 0 = 16
+        float importance_floor; // 0-1 share of every table's probability spread in proportion to pixel count
+        uint32_t shards; // > 1: out_path becomes an index pack over this many shard files (see shard_hostpack)
+    };
+
+    struct OpenOptions
+    {
+        Residency residency;
+        bool lock_memory; // mlock the pack once resident
+        uint32_t threads; // readers for HugeCopy/Shared hydration, 0 = hardware concurrency
+        std::string shm_name; // Shared: segment name, empty = derived from the file's path, size and mtime
+        bool verify_frames; // check each frame against its checksum on first access (BadPack on mismatch)
+        // Reported by open_hostpack_ex
+        double open_seconds;
+        uint64_t resident_bytes;
+        bool locked;
+        bool attached; // Shared: another process had already hydrated the segment
+    };
+
+    struct VerifyReport
+    {
+        bool tables_ok; // header, scene, camera and frame tables
+        uint32_t sections_checked;
+        uint32_t bad_sections;
+        uint64_t frames_checked;
+        std::vector<size_t> bad_frames;
+        uint64_t bytes_checked;
+        double seconds;
+    };
+
+    // Manifest: transforms/COLMAP parse and path resolution. Fingerprint: source stat, plus the CRC-32 of
+    // sources an incremental build cannot match by size and mtime. Decode: image headers and pixel decode
+    // with the CRC-32 of each source for the manifest (EXR frames convert as they decode). Convert: pixel
+    // format conversion, padding, mips and tiling. Compress: DEFLATE and frame checksums. Write: layout,
+    // tables, sections and file output.
+    enum class BuildStage : uint32_t { Manifest = 0, Fingerprint = 1, Decode = 2, Convert = 3, Compress = 4, Write = 5 };
+    constexpr size_t kBuildStages = 6;
+
+    struct StageStats
+    {
+        // Summed over every thread that ran the stage, so parallel stages can exceed the build's wall time
+        double wall_seconds;
+        double cpu_seconds;
+        uint64_t bytes_in;
+        uint64_t bytes_out;
+        uint64_t items;
+    };
+
+    struct BuildStats
+    {
+        StageStats stages[kBuildStages]; // indexed by BuildStage
+        double wall_seconds;
+        double cpu_seconds; // whole process over the build
+        uint64_t frames_built;
+        uint64_t frames_reused;
+        // Wall time of the frame pipeline, and per build worker the part of it spent decoding, converting
+        // and compressing; busy / pipeline is that worker's utilization
+        double pipeline_seconds;
+        std::vector<double> thread_busy_seconds;
+    };
+
+    struct ResidentRange
+    {
+        uint64_t bytes;
+        uint64_t pages; // pages the range touches, shared boundary pages included
+        uint64_t resident_pages;
+    };
+
+    struct SectionResidency
+    {
+        const char* name; // "mips", "rays", "manifest", "checksums"
+        ResidentRange range;
+    };
+
+    // Access counts since the handle was opened
+    struct AccessCounters
+    {
+        uint64_t views; // image_view / image_view_level
+        uint64_t acquires; // acquire_frame
+        uint64_t cache_hits; // acquire_frame of a compressed frame already inflated
+        uint64_t cache_misses;
+        uint64_t reader_loads; // frame reader loads queued
+        uint64_t reader_bytes; // stored bytes those loads read
+        uint64_t prefetches; // frames passed to prefetch_frames and the readahead thread
+        uint64_t evictions;
+    };
+
+    struct PackStats
+    {
+        bool residency_known; // false where the platform cannot report page residency (Windows file views)
+        uint64_t page_bytes;
+        ResidentRange total;
+        ResidentRange tables; // header, scene, camera and frame tables
+        std::vector<SectionResidency> sections;
+        std::vector<ResidentRange> frames; // stored extent of each frame
+        AccessCounters access;
     };
 
     struct PackHandleTag;
     using PackHandle = PackHandleTag*;
 
+    struct ArchiveHandleTag;
+    using ArchiveHandle = ArchiveHandleTag*;
+
+    struct FrameReaderTag;
+    using FrameReader = FrameReaderTag*;
+
+    struct ReaderOptions
+    {
+        uint32_t queue_depth; // reads in flight, 0 = 64
+        uint32_t threads; // pread fallback and decompression workers, 0 = hardware concurrency
+        bool direct; // O_DIRECT for frames on block_align boundaries that are multiples of 4 KiB
+    };
+
+    // A frame read by a FrameReader: the decompressed block with every level, shared with nobody else
+    struct LoadedFrame
+    {
+        size_t frame_index;
+        Error status;
+        std::shared_ptr<const unsigned char> block;
+    };
+
+    // co_await load_frame_async(r, i) resumes the coroutine on a reader thread once the frame is in memory
+    struct FrameAwaiter
+    {
+        FrameReader reader;
+        size_t frame_index;
+        LoadedFrame result;
+
+        bool await_ready() const noexcept
+        {
+            return false;
+        }
+        void await_suspend(std::coroutine_handle<> c);
+        LoadedFrame await_resume()
+        {
+            return std::move(result);
+        }
+    };
+
+    struct FramesAwaiter
+    {
+        FrameReader reader;
+        std::vector<size_t> frame_indices;
+        std::vector<LoadedFrame> result;
+        std::atomic<size_t> remaining;
+
+        bool await_ready() const noexcept
+        {
+            return frame_indices.empty();
+        }
+        bool await_suspend(std::coroutine_handle<> c);
+        std::vector<LoadedFrame> await_resume()
+        {
+            return std::move(result);
+        }
+    };
+
+    // data holds the roi_w x roi_h stored pixels whose top-left is (roi_x, roi_y) of the width x height frame;
+    // pixel_address takes coordinates relative to that corner. Frames of cropped packs (CapCropped) store
+    // less than the whole frame and every pixel outside the ROI reads as fill.
     struct ImageView
     {
         const void* data;
@@ -38,6 +227,8 @@ namespace dataset
         uint32_t roi_y;
         uint32_t roi_w;
         uint32_t roi_h;
+        uint32_t tile_shift; // 0 = scanline rows, else log2 tile edge and row_stride spans one row of tiles
+        const void* fill; // one stored pixel (transparent black, or the background of RGB formats); null if uncropped
     };
 
     struct CameraSOAView
@@ -53,20 +244,293 @@ namespace dataset
         size_t count;
     };
 
+    // Caller-owned SoA outputs of sample_rays, each holding count entries; frame/x/y/pdf may be null
+    struct RayBatch
+    {
+        float* origin[3];
+        float* dir[3];
+        float* rgba[4];
+        uint32_t* frame;
+        uint32_t* x;
+        uint32_t* y;
+        float* pdf; // probability of the ray's pixel relative to a uniform draw over all pixels (1 when uniform)
+    };
+
+    struct RaySampleConfig
+    {
+        uint64_t seed; // same seed and count give the same batch whatever the thread count
+        uint32_t threads; // 0 = hardware concurrency
+        bool jitter; // random subpixel position instead of the pixel centre
+        bool srgb_to_linear; // applies to 8-bit formats only
+        bool importance; // draw frames, tiles and pixels from the pack's importance tables instead of uniformly
+    };
+
+    // Precomputed pixel-centre rays of one frame, row-major over the full image. Origins are the camera
+    // position (column 3 of camera_soa().T3x4); distances are along the unit direction.
+    struct RayTableView
+    {
+        const uint32_t* dir_oct; // octahedral unit direction, x and y as snorm16 in the low and high half
+        const float* t_near;
+        const float* t_far; // t_far <= t_near where the ray misses the scene AABB
+        uint32_t width;
+        uint32_t height;
+    };
+
+    // Importance table of one frame: tiles_x x tiles_y row-major tiles of tile x tile pixels, partial at the
+    // right and bottom edges. weight[t] is the probability of tile t within the frame and cdf[t] the inclusive
+    // prefix sum, whose last entry is exactly 1; pixels of a tile are equally likely.
+    struct ImportanceView
+    {
+        const float* weight;
+        const float* cdf;
+        uint32_t tiles_x;
+        uint32_t tiles_y;
+        uint32_t tile;
+    };
+
+    // Probability of each frame under the importance tables and its inclusive prefix sum (last entry 1)
+    struct FrameImportanceView
+    {
+        const float* weight;
+        const float* cdf;
+        size_t count;
+    };
+
+    enum class TensorLayout : uint32_t { NHWC = 0, NCHW = 1 };
+
+    enum class TensorType : uint32_t { U8 = 0, F16 = 1, F32 = 2 };
+
+    // Output of gather_frames and the conversion fused into its copy, applied in this order: sRGB decode
+    // (8-bit packs), compositing onto the background, (v - mean) / std, then U8 outputs are clamped to [0, 1]
+    // and scaled to 0-255
+    struct TensorFormat
+    {
+        TensorType type;
+        uint32_t channels; // 4 = RGBA, 3 = RGB (alpha dropped after compositing)
+        bool srgb_to_linear; // applies to 8-bit formats only
+        bool composite; // RGB over background by alpha; premultiplied packs are not multiplied again. Alpha passes through
+        float background[3]; // in the output color space
+        float mean[4];
+        float std[4]; // 0 = 1
+        uint32_t threads; // 0 = hardware concurrency
+    };
+
+    // Region of level 0 in full-frame pixels; a zero width or height selects the whole frame
+    struct PixelRect
+    {
+        uint32_t x;
+        uint32_t y;
+        uint32_t width;
+        uint32_t height;
+    };
+
     struct Caps
     {
         uint64_t bits;
     };
 
+    enum CapBit : uint64_t
+    {
+        CapPremultipliedAlpha = 1ull << 0,
+        CapMips = 1ull << 1,
+        CapTiled = 1ull << 2,
+        CapRayTable = 1ull << 3,
+        CapDeflate = 1ull << 4,
+        CapCropped = 1ull << 5,
+        CapImportance = 1ull << 6,
+        CapSharded = 1ull << 7,
+    };
+
+    // Index drawn by u in [0, 1) from an inclusive prefix-sum table ending at 1, in O(log n): the first entry
+    // above u, so zero-weight entries are never picked
+    inline size_t sample_cdf(const float* cdf, size_t n, float u)
+    {
+        size_t lo = 0;
+        while (n > 1)
+        {
+            size_t half = n / 2;
+            if (cdf[lo + half - 1] <= u) lo += half;
+            n -= half;
+        }
+        return lo;
+    }
+
+    inline uint32_t morton_interleave(uint32_t v)
+    {
+        v &= 0xffff;
+        v = (v | (v << 8)) & 0x00ff00ffu;
+        v = (v | (v << 4)) & 0x0f0f0f0fu;
+        v = (v | (v << 2)) & 0x33333333u;
+        v = (v | (v << 1)) & 0x55555555u;
+        return v;
+    }
+
+    // Pixel (x, y) of a view in either layout; tiles are stored row by row, pixels inside a tile in Z order
+    inline const void* pixel_address(const ImageView& v, uint32_t x, uint32_t y)
+    {
+        const char* p = (const char*)v.data;
+        if (!v.tile_shift) return p + (size_t)y * v.row_stride + (size_t)x * v.pixel_stride;
+        uint32_t s = v.tile_shift;
+        uint32_t m = (1u << s) - 1;
+        size_t tile = (size_t)(x >> s) << (2 * s);
+        size_t z = morton_interleave(x & m) | (morton_interleave(y & m) << 1);
+        return p + (size_t)(y >> s) * v.row_stride + (tile + z) * v.pixel_stride;
+    }
+
+    inline const void* tile_address(const ImageView& v, uint32_t tx, uint32_t ty)
+    {
+        return (const char*)v.data + (size_t)ty * v.row_stride + ((size_t)tx << (2 * v.tile_shift)) * v.pixel_stride;
+    }
+
+    inline void oct_decode(uint32_t v, float d[3])
+    {
+        float x = (float)(int16_t)(v & 0xffff) / 32767.0f;
+        float y = (float)(int16_t)(v >> 16) / 32767.0f;
+        float z = 1.0f - std::fabs(x) - std::fabs(y);
+        if (z < 0)
+        {
+            float ox = x;
+            x = std::copysign(1.0f - std::fabs(y), ox);
+            y = std::copysign(1.0f - std::fabs(ox), y);
+        }
+        float len = std::sqrt(x * x + y * y + z * z);
+        d[0] = x / len;
+        d[1] = y / len;
+        d[2] = z / len;
+    }
+
+    uint32_t pixel_format_bytes(PixelFormat pf);
+    // Every pack records its sources' size, mtime and CRC-32. With cfg.incremental a pack built with the same
+    // pixel settings is updated: when its frames are an unchanged prefix of the manifest the new frames are
+    // appended in place, otherwise a new file replaces it with unchanged frame blocks copied rather than
+    // decoded.
     int build_hostpack(const BuildConfig& cfg, const std::string& out_path);
+    // Same build, filling stats with per-stage timings and byte counts (an unchanged incremental rebuild only
+    // has Manifest and Fingerprint)
+    int build_hostpack(const BuildConfig& cfg, const std::string& out_path, BuildStats& stats);
+    // Appends the manifest's frames past the ones the pack already holds, writing new pixel blocks, camera
+    // and frame tables after the existing data and switching the header over last. Fails with BadConfig
+    // when a frame already in the pack changed or the pixel settings differ.
+    int append_hostpack(const BuildConfig& cfg, const std::string& hostpack_path);
+    int append_hostpack(const BuildConfig& cfg, const std::string& hostpack_path, BuildStats& stats);
+    // Splits a pack's frame blocks over shard files index_path.shard0, .shard1, ... of near equal byte size,
+    // cutting the frame order into contiguous runs, and writes index_path: the header, camera and frame
+    // tables and sections with no pixel data, plus the frame to shard map. Frame indices do not change;
+    // shard files start on block_align boundaries (0 = 4096). Index packs cannot be appended to or archived,
+    // and incremental builds of one decode every frame again.
+    int shard_hostpack(const std::string& hostpack_path, const std::string& index_path, uint32_t shards, uint32_t block_align);
+    const char* build_stage_name(BuildStage stage);
+    // Fails with BadPack when a table or section lies outside the file. Frame records are read in place and
+    // checked on access, so open costs the same for any frame count; accessors return empty views (BadPack)
+    // for a frame whose record points outside the pack.
     PackHandle open_hostpack(const std::string& hostpack_path);
+    PackHandle open_hostpack_ex(const std::string& hostpack_path, OpenOptions& options);
+    // Opens an index pack mapping only the shards k with k % world == rank (open_hostpack maps all of them)
+    // into one address range, so frames keep their pack-wide indices. Frames of other shards read as empty
+    // views and are left out of sample_rays, whose frame importance is renormalised over the owned frames.
+    // BadConfig when world exceeds the shard count; a pack that is not sharded opens whole. Lazy and
+    // Populate residency only, POSIX only.
+    PackHandle open_hostpack_shard(const std::string& index_path, uint32_t rank, uint32_t world);
+    PackHandle open_hostpack_shard_ex(const std::string& index_path, uint32_t rank, uint32_t world, OpenOptions& options);
     void close_hostpack(PackHandle h);
+    // Removes the node-wide segment of a Shared open; processes still attached keep their mapping
+    int release_shared_hostpack(const std::string& hostpack_path, const std::string& shm_name);
     Error last_error();
     size_t frame_count(PackHandle h);
     size_t camera_count(PackHandle h);
     size_t frame_camera_index(PackHandle h, size_t frame_index);
+    // 0 for packs that are not sharded
+    uint32_t shard_count(PackHandle h);
+    // Shard file holding the frame (0 when the pack is not sharded), -1 past the frame count
+    int64_t frame_shard(PackHandle h, size_t frame_index);
+    // Whether the frame's pixels are mapped by this handle
+    bool frame_owned(PackHandle h, size_t frame_index);
     ImageView image_view(PackHandle h, size_t frame_index);
+    // Level 0's dimensions, strides, ROI and format with a null data pointer; never reads or decompresses pixels
+    ImageView frame_info(PackHandle h, size_t frame_index);
+    uint32_t frame_mip_levels(PackHandle h, size_t frame_index);
+    // Level 0 is image_view(); an empty view is returned past the stored chain. Both are zero-copy and
+    // return empty views for compressed frames, which are read through acquire_frame.
+    ImageView image_view_level(PackHandle h, size_t frame_index, uint32_t level);
+    // Pins a frame and returns a view of one of its levels, decompressing it into the handle's frame cache
+    // when needed; every successful acquire is paired with a release_frame. Safe to call concurrently.
+    ImageView acquire_frame(PackHandle h, size_t frame_index, uint32_t level);
+    void release_frame(PackHandle h, size_t frame_index);
+    // Acquires count frames, decompressing misses in parallel; on failure nothing stays pinned
+    int acquire_frames(PackHandle h, const size_t* frame_indices, size_t count, uint32_t level, ImageView* out, uint32_t threads);
+    // Unpinned decompressed frames are evicted least recently used first above this many bytes (default 1 GiB)
+    void set_frame_cache_budget(PackHandle h, uint64_t bytes);
+    // Kernel readahead policy for the pixel data; open_hostpack starts with Random
+    void set_access_pattern(PackHandle h, AccessPattern pattern);
+    // Page-granular hints covering the frames' stored bytes (all levels). Eviction only drops pages no other
+    // frame shares and leaves the decompressed frame cache alone. It is ignored under HugeCopy residency,
+    // where the pack's private copy is the only one (and so is evict_behind).
+    int prefetch_frames(PackHandle h, const size_t* frame_indices, size_t count);
+    int evict_frames(PackHandle h, const size_t* frame_indices, size_t count);
+    // Declares the order frames will be read in. A background thread prefetches lookahead frames past the
+    // position reported through advance_schedule and, with evict_behind, evicts frames once passed unless
+    // they come up again inside the window. count 0 stops the thread.
+    int set_access_schedule(PackHandle h, const size_t* order, size_t count, uint32_t lookahead, bool evict_behind);
+    void advance_schedule(PackHandle h, size_t position);
+    // Checks the header, tables, sections and every frame against the checksums written at build time,
+    // frames in parallel on threads workers (0 = hardware concurrency). Returns 0 when everything matches, -1
+    // with BadPack on a mismatch (details in report) or Unsupported for packs built without checksums.
+    int verify_hostpack(PackHandle h, uint32_t threads, VerifyReport& report);
+    // Page residency of the pack's tables, sections and frames (mincore) and the handle's access counters.
+    // Walks the whole mapping's page table, so it costs O(pack size / page size).
+    int pack_stats(PackHandle h, PackStats& stats);
+    // Concatenates hostpacks behind a catalog sorted by scene name, each member starting on a block_align
+    // boundary (0 = 4096); empty names take the file stems
+    int build_archive(const std::vector<std::string>& hostpack_paths, const std::vector<std::string>& names, const std::string& out_path, uint32_t block_align);
+    // Maps the whole archive once; scenes opened from it keep the mapping alive past close_archive
+    ArchiveHandle open_archive(const std::string& archive_path);
+    void close_archive(ArchiveHandle a);
+    size_t archive_scene_count(ArchiveHandle a);
+    // Scene ids follow catalog order
+    std::string archive_scene_name(ArchiveHandle a, size_t scene_id);
+    // An ordinary pack handle over the scene's sub-range of the archive mapping, without any file I/O;
+    // close it with close_hostpack
+    PackHandle open_scene(ArchiveHandle a, const std::string& name);
+    PackHandle open_scene(ArchiveHandle a, size_t scene_id);
+    // Reads whole frames of an open pack with batched positional reads (io_uring where the kernel has it, a
+    // pread thread pool otherwise or with DATASET_AIO=pread) instead of page faults on the mapping.
+    // Compressed frames are inflated on the reader's workers. Close the reader before its pack.
+    FrameReader open_frame_reader(PackHandle h, const ReaderOptions& options);
+    void close_frame_reader(FrameReader r);
+    const char* frame_reader_backend(FrameReader r);
+    std::future<LoadedFrame> load_frame(FrameReader r, size_t frame_index);
+    // Submits the whole batch before waiting on any of it
+    std::vector<std::future<LoadedFrame>> load_frames(FrameReader r, const size_t* frame_indices, size_t count);
+    // Reads frame i decompressed into caller memory of at least frame_block_bytes bytes; raw frames go to dst
+    // without a copy, and with O_DIRECT when dst, the frame and dst_bytes line up on 4 KiB
+    std::future<Error> load_frame_into(FrameReader r, size_t frame_index, void* dst, size_t dst_bytes);
+    FrameAwaiter load_frame_async(FrameReader r, size_t frame_index);
+    FramesAwaiter load_frames_async(FrameReader r, const size_t* frame_indices, size_t count);
+    uint64_t frame_block_bytes(PackHandle h, size_t frame_index);
+    // One level of a loaded frame, valid while f.block is held
+    ImageView loaded_frame_view(PackHandle h, const LoadedFrame& f, uint32_t level);
+    // Expands any view into width x height float RGBA rows (alpha 1 for RGB formats, fill outside the ROI);
+    // dst_row_stride is in bytes, 0 = tight. srgb_to_linear applies to 8-bit formats only.
+    int image_to_rgba32f(const ImageView& v, float* dst, size_t dst_row_stride, bool srgb_to_linear);
+    const char* simd_kernel_name();
+    // Copies a w x h patch of the frame's level into scanline rows whatever the stored layout; x and y are
+    // frame coordinates and pixels outside the stored ROI come back as fill
+    int read_patch(PackHandle h, size_t frame_index, uint32_t level, uint32_t x, uint32_t y, uint32_t width, uint32_t height, void* dst, size_t dst_row_stride);
+    // Copies roi of each listed frame into one contiguous count x H x W x C (NHWC) or count x C x H x W (NCHW)
+    // tensor at dst, converting on the way. Every frame must contain roi (or share one size for a whole-frame
+    // roi). Work is split over format.threads by frame and row band; compressed frames are acquired first.
+    int gather_frames(PackHandle h, const size_t* frame_indices, size_t count, const PixelRect& roi, TensorLayout layout, const TensorFormat& format, void* dst);
     CameraSOAView camera_soa(PackHandle h);
+    // Empty view unless the pack was built with BuildConfig::ray_table
+    RayTableView ray_table(PackHandle h, size_t frame_index);
+    // Empty views unless the pack was built with BuildConfig::importance
+    ImportanceView importance_table(PackHandle h, size_t frame_index);
+    FrameImportanceView frame_importance(PackHandle h);
+    // Draws count rays uniformly over the pixels of every frame (or, with RaySampleConfig::importance, from the
+    // pack's importance tables) with their target colors (alpha 1 for RGB formats); rays outside a cropped
+    // frame's ROI get its fill without touching the frame. Directions are unit length, NeRF/OpenGL camera
+    // convention.
+    int sample_rays(PackHandle h, size_t count, const RaySampleConfig& cfg, const RayBatch& out);
     void scene_aabb(PackHandle h, float out_min[3], float out_max[3]);
     ColorSpace scene_color_space(PackHandle h);
     PixelFormat pack_pixel_format(PackHandle h);
@@ -3,6 +3,7 @@
 #include <vector>
 #include <cstring>
 #include <cstdint>
+#include <cstdio>
 #include "dataset.h"
 
 using namespace dataset;
@@ -10,12 +11,43 @@ using namespace dataset;
 int usage()
 {
     std::cerr << "usage:\n";
-    std::cerr << "  dataset_cli build <dataset_root> <config_or_auto> <out_hostpack> [--pf rgba8|rgba32f] [--threads N] [--row-align N] [--block-align N]\n";
-    std::cerr << "  dataset_cli info <hostpack>\n";
+    std::cerr << "  dataset_cli build <dataset_root> <config_or_auto> <out_hostpack> [--pf rgba8|rgba32f|rgba16f|rgb8|rgb16f] [--premultiply] [--background R,G,B] [--threads N] [--row-align N] [--block-align N] [--memory-budget MiB] [--mapped] [--mips N|full] [--mip-filter box|kaiser] [--tile N] [--ray-table] [--compress LEVEL] [--crop-alpha] [--crop-margin N] [--importance alpha|gradient|both] [--importance-tile N] [--importance-floor F] [--shards K] [--incremental] [--stats]\n";
+    std::cerr << "  dataset_cli append <dataset_root> <config_or_auto> <hostpack> [build options]\n";
+    std::cerr << "  dataset_cli shard <hostpack> <out_index> <shards> [--block-align N]\n";
+    std::cerr << "  dataset_cli info <hostpack> [--residency lazy|populate|huge|shared] [--mlock] [--release-shared] [--rank R --world W]\n";
     std::cerr << "  dataset_cli list <hostpack>\n";
+    std::cerr << "  dataset_cli verify <hostpack> [--threads N]\n";
+    std::cerr << "  dataset_cli residency <hostpack> [--touch] [--frames]\n";
+    std::cerr << "  dataset_cli archive <out_archive> <hostpack>... [--block-align N]\n";
+    std::cerr << "  dataset_cli scenes <archive>\n";
     return 1;
 }
 
+void print_build_stats(const BuildStats& st)
+{
+    for (size_t k = 0; k < kBuildStages; k++)
+    {
+        const StageStats& s = st.stages[k];
+        std::cout << "stage=" << build_stage_name((BuildStage)k)
+            << " wall_s=" << s.wall_seconds
+            << " cpu_s=" << s.cpu_seconds
+            << " in_mb=" << s.bytes_in / 1e6
+            << " out_mb=" << s.bytes_out / 1e6
+            << " items=" << s.items
+            << " MB/s=" << (s.wall_seconds > 0 ? s.bytes_in / s.wall_seconds / 1e6 : 0.0) << "\n";
+    }
+    std::cout << "wall_s=" << st.wall_seconds
+        << " cpu_s=" << st.cpu_seconds
+        << " frames_built=" << st.frames_built
+        << " frames_reused=" << st.frames_reused
+        << " pipeline_s=" << st.pipeline_seconds << "\n";
+    for (size_t t = 0; t < st.thread_busy_seconds.size(); t++)
+    {
+        double b = st.thread_busy_seconds[t];
+        std::cout << "thread=" << t << " busy_s=" << b << " util=" << (st.pipeline_seconds > 0 ? 100.0 * b / st.pipeline_seconds : 0.0) << "%\n";
+    }
+}
+
 int cmd_build(int argc, char** argv)
 {
     if (argc < 5) return usage();
@@ -26,6 +58,22 @@ int cmd_build(int argc, char** argv)
     cfg.row_align = 16;
     cfg.block_align = 4096;
     cfg.threads = 0;
+    cfg.memory_budget = 0;
+    cfg.mapped_output = false;
+    cfg.premultiply_alpha = false;
+    cfg.background[0] = cfg.background[1] = cfg.background[2] = 0.0f;
+    cfg.mip_levels = 1;
+    cfg.mip_filter = MipFilter::Box;
+    cfg.tile_size = 0;
+    cfg.ray_table = false;
+    cfg.compress_level = 0;
+    cfg.incremental = false;
+    cfg.crop_alpha = false;
+    cfg.crop_margin = 0;
+    cfg.importance = ImportanceSource::None;
+    cfg.importance_tile = 16;
+    cfg.importance_floor = 0.0f;
+    bool stats = false;
     std::string out_path = argv[4];
     for (int i = 5; i < argc; i++)
     {
@@ -40,6 +88,18 @@ int cmd_build(int argc, char** argv)
             {
                 cfg.pixel_format = PixelFormat::RGBA32F;
             }
+            else if (!std::strcmp(argv[i], "rgba16f"))
+            {
+                cfg.pixel_format = PixelFormat::RGBA16F;
+            }
+            else if (!std::strcmp(argv[i], "rgb8"))
+            {
+                cfg.pixel_format = PixelFormat::RGB8;
+            }
+            else if (!std::strcmp(argv[i], "rgb16f"))
+            {
+                cfg.pixel_format = PixelFormat::RGB16F;
+            }
             else
             {
                 std::cerr << "bad pixel format\n";
@@ -58,6 +118,110 @@ int cmd_build(int argc, char** argv)
         {
             cfg.block_align = (uint32_t)std::stoul(argv[++i]);
         }
+        else if (!std::strcmp(argv[i], "--memory-budget") && i + 1 < argc)
+        {
+            cfg.memory_budget = (uint64_t)std::stoull(argv[++i]) << 20;
+        }
+        else if (!std::strcmp(argv[i], "--premultiply"))
+        {
+            cfg.premultiply_alpha = true;
+        }
+        else if (!std::strcmp(argv[i], "--background") && i + 1 < argc)
+        {
+            if (std::sscanf(argv[++i], "%f,%f,%f", &cfg.background[0], &cfg.background[1], &cfg.background[2]) != 3)
+            {
+                std::cerr << "bad background\n";
+                return 2;
+            }
+        }
+        else if (!std::strcmp(argv[i], "--mips") && i + 1 < argc)
+        {
+            i++;
+            cfg.mip_levels = !std::strcmp(argv[i], "full") ? 32u : (uint32_t)std::stoul(argv[i]);
+        }
+        else if (!std::strcmp(argv[i], "--mip-filter") && i + 1 < argc)
+        {
+            i++;
+            if (!std::strcmp(argv[i], "box"))
+            {
+                cfg.mip_filter = MipFilter::Box;
+            }
+            else if (!std::strcmp(argv[i], "kaiser"))
+            {
+                cfg.mip_filter = MipFilter::Kaiser;
+            }
+            else
+            {
+                std::cerr << "bad mip filter\n";
+                return 2;
+            }
+        }
+        else if (!std::strcmp(argv[i], "--tile") && i + 1 < argc)
+        {
+            cfg.tile_size = (uint32_t)std::stoul(argv[++i]);
+        }
+        else if (!std::strcmp(argv[i], "--compress") && i + 1 < argc)
+        {
+            cfg.compress_level = (uint32_t)std::stoul(argv[++i]);
+        }
+        else if (!std::strcmp(argv[i], "--crop-alpha"))
+        {
+            cfg.crop_alpha = true;
+        }
+        else if (!std::strcmp(argv[i], "--crop-margin") && i + 1 < argc)
+        {
+            cfg.crop_alpha = true;
+            cfg.crop_margin = (uint32_t)std::stoul(argv[++i]);
+        }
+        else if (!std::strcmp(argv[i], "--importance") && i + 1 < argc)
+        {
+            i++;
+            if (!std::strcmp(argv[i], "alpha"))
+            {
+                cfg.importance = ImportanceSource::Alpha;
+            }
+            else if (!std::strcmp(argv[i], "gradient"))
+            {
+                cfg.importance = ImportanceSource::Gradient;
+            }
+            else if (!std::strcmp(argv[i], "both"))
+            {
+                cfg.importance = ImportanceSource::AlphaGradient;
+            }
+            else
+            {
+                std::cerr << "bad importance source\n";
+                return 2;
+            }
+        }
+        else if (!std::strcmp(argv[i], "--importance-tile") && i + 1 < argc)
+        {
+            cfg.importance_tile = (uint32_t)std::stoul(argv[++i]);
+        }
+        else if (!std::strcmp(argv[i], "--importance-floor") && i + 1 < argc)
+        {
+            cfg.importance_floor = std::stof(argv[++i]);
+        }
+        else if (!std::strcmp(argv[i], "--shards") && i + 1 < argc)
+        {
+            cfg.shards = (uint32_t)std::stoul(argv[++i]);
+        }
+        else if (!std::strcmp(argv[i], "--ray-table"))
+        {
+            cfg.ray_table = true;
+        }
+        else if (!std::strcmp(argv[i], "--mapped"))
+        {
+            cfg.mapped_output = true;
+        }
+        else if (!std::strcmp(argv[i], "--incremental"))
+        {
+            cfg.incremental = true;
+        }
+        else if (!std::strcmp(argv[i], "--stats"))
+        {
+            stats = true;
+        }
         else
         {
             std::cerr << "unknown option: " << argv[i] << "\n";
@@ -74,41 +238,128 @@ int cmd_build(int argc, char** argv)
         std::cerr << "block-align must be power of two\n";
         return 2;
     }
-    int r = build_hostpack(cfg, out_path);
+    BuildStats st{};
+    bool append = !std::strcmp(argv[1], "append");
+    int r = append ? (stats ? append_hostpack(cfg, out_path, st) : append_hostpack(cfg, out_path))
+                   : (stats ? build_hostpack(cfg, out_path, st) : build_hostpack(cfg, out_path));
     if (r)
     {
         std::cerr << "build failed error=" << (int)last_error() << "\n";
         return 3;
     }
     std::cout << "ok\n";
+    if (stats) print_build_stats(st);
     return 0;
 }
 
 const char* pf_name(PixelFormat pf)
 {
-    return pf == PixelFormat::RGBA8 ? "RGBA8" : pf == PixelFormat::RGBA32F ? "RGBA32F" : "?";
+    switch (pf)
+    {
+    case PixelFormat::RGBA8: return "RGBA8";
+    case PixelFormat::RGBA32F: return "RGBA32F";
+    case PixelFormat::RGBA16F: return "RGBA16F";
+    case PixelFormat::RGB8: return "RGB8";
+    case PixelFormat::RGB16F: return "RGB16F";
+    }
+    return "?";
 }
 
 int cmd_info(int argc, char** argv)
 {
     if (argc < 3) return usage();
-    PackHandle h = open_hostpack(argv[2]);
+    OpenOptions opt{};
+    opt.residency = Residency::Lazy;
+    bool release = false;
+    uint32_t rank = 0;
+    uint32_t world = 1;
+    for (int i = 3; i < argc; i++)
+    {
+        if (!std::strcmp(argv[i], "--residency") && i + 1 < argc)
+        {
+            i++;
+            if (!std::strcmp(argv[i], "lazy"))
+            {
+                opt.residency = Residency::Lazy;
+            }
+            else if (!std::strcmp(argv[i], "populate"))
+            {
+                opt.residency = Residency::Populate;
+            }
+            else if (!std::strcmp(argv[i], "huge"))
+            {
+                opt.residency = Residency::HugeCopy;
+            }
+            else if (!std::strcmp(argv[i], "shared"))
+            {
+                opt.residency = Residency::Shared;
+            }
+            else
+            {
+                std::cerr << "bad residency\n";
+                return 2;
+            }
+        }
+        else if (!std::strcmp(argv[i], "--mlock"))
+        {
+            opt.lock_memory = true;
+        }
+        else if (!std::strcmp(argv[i], "--release-shared"))
+        {
+            release = true;
+        }
+        else if (!std::strcmp(argv[i], "--rank") && i + 1 < argc)
+        {
+            rank = (uint32_t)std::stoul(argv[++i]);
+        }
+        else if (!std::strcmp(argv[i], "--world") && i + 1 < argc)
+        {
+            world = (uint32_t)std::stoul(argv[++i]);
+        }
+        else
+        {
+            std::cerr << "unknown option: " << argv[i] << "\n";
+            return 2;
+        }
+    }
+    PackHandle h = open_hostpack_shard_ex(argv[2], rank, world, opt);
     if (!h)
     {
         std::cerr << "open failed error=" << (int)last_error() << "\n";
         return 3;
     }
+    uint32_t tile = 0;
+    size_t owned = 0;
+    for (size_t i = 0; i < frame_count(h); i++) owned += frame_owned(h, i);
+    size_t f0 = 0;
+    while (f0 < frame_count(h) && !frame_owned(h, f0)) f0++;
+    if (f0 < frame_count(h))
+    {
+        ImageView v0 = frame_info(h, f0);
+        tile = v0.tile_shift ? 1u << v0.tile_shift : 0u;
+    }
     std::cout << "frames=" << frame_count(h)
         << " cameras=" << camera_count(h)
         << " version=" << hostpack_version(h)
         << " pixel_format=" << pf_name(pack_pixel_format(h))
+        << " tile=" << tile
+        << " codec=" << ((pack_caps(h).bits & CapDeflate) ? "deflate" : "raw")
+        << " cropped=" << ((pack_caps(h).bits & CapCropped) ? 1 : 0)
+        << " importance_tile=" << importance_table(h, 0).tile
+        << " shards=" << shard_count(h)
+        << " owned_frames=" << owned
         << " bytes=" << pack_bytes(h) << "\n";
     float bmin[3];
     float bmax[3];
     scene_aabb(h, bmin, bmax);
     std::cout << "aabb_min=" << bmin[0] << "," << bmin[1] << "," << bmin[2]
         << " aabb_max=" << bmax[0] << "," << bmax[1] << "," << bmax[2] << "\n";
+    std::cout << "open_ms=" << opt.open_seconds * 1000.0
+        << " resident=" << opt.resident_bytes
+        << " locked=" << opt.locked
+        << " attached=" << opt.attached << "\n";
     close_hostpack(h);
+    if (release && release_shared_hostpack(argv[2], opt.shm_name) != 0) std::cerr << "release failed\n";
     return 0;
 }
 
@@ -124,12 +375,13 @@ int cmd_list(int argc, char** argv)
     size_t n = frame_count(h);
     for (size_t i = 0; i < n; i++)
     {
-        auto v = image_view(h, i);
+        auto v = frame_info(h, i);
         std::cout << i << ": cam=" << frame_camera_index(h, i)
             << " w=" << v.width
             << " h=" << v.height
             << " rs=" << v.row_stride
             << " ps=" << v.pixel_stride
+            << " mips=" << frame_mip_levels(h, i)
             << " roi=" << v.roi_x << "," << v.roi_y << "," << v.roi_w << "," << v.roi_h
             << "\n";
     }
@@ -137,12 +389,211 @@ int cmd_list(int argc, char** argv)
     return 0;
 }
 
+int cmd_verify(int argc, char** argv)
+{
+    if (argc < 3) return usage();
+    uint32_t threads = 0;
+    for (int i = 3; i < argc; i++)
+    {
+        if (!std::strcmp(argv[i], "--threads") && i + 1 < argc)
+        {
+            threads = (uint32_t)std::stoul(argv[++i]);
+        }
+        else
+        {
+            std::cerr << "unknown option: " << argv[i] << "\n";
+            return 2;
+        }
+    }
+    PackHandle h = open_hostpack(argv[2]);
+    if (!h)
+    {
+        std::cerr << "open failed error=" << (int)last_error() << "\n";
+        return 3;
+    }
+    VerifyReport rep{};
+    int r = verify_hostpack(h, threads, rep);
+    close_hostpack(h);
+    if (r && last_error() == Error::Unsupported)
+    {
+        std::cerr << "pack has no checksums\n";
+        return 3;
+    }
+    std::cout << "tables=" << (rep.tables_ok ? "ok" : "bad")
+        << " sections=" << rep.sections_checked - rep.bad_sections << "/" << rep.sections_checked
+        << " frames=" << rep.frames_checked - rep.bad_frames.size() << "/" << rep.frames_checked
+        << " bytes=" << rep.bytes_checked
+        << " MB/s=" << (rep.seconds > 0 ? rep.bytes_checked / rep.seconds / 1e6 : 0.0) << "\n";
+    for (size_t i : rep.bad_frames) std::cout << "bad frame " << i << "\n";
+    return r ? 4 : 0;
+}
+
+void print_range(const char* what, const ResidentRange& r)
+{
+    std::cout << what << " bytes=" << r.bytes << " pages=" << r.pages << " resident=" << r.resident_pages
+        << " (" << (r.pages ? 100.0 * r.resident_pages / r.pages : 0.0) << "%)\n";
+}
+
+int cmd_residency(int argc, char** argv)
+{
+    if (argc < 3) return usage();
+    bool touch = false;
+    bool per_frame = false;
+    for (int i = 3; i < argc; i++)
+    {
+        if (!std::strcmp(argv[i], "--touch"))
+        {
+            touch = true;
+        }
+        else if (!std::strcmp(argv[i], "--frames"))
+        {
+            per_frame = true;
+        }
+        else
+        {
+            std::cerr << "unknown option: " << argv[i] << "\n";
+            return 2;
+        }
+    }
+    PackHandle h = open_hostpack(argv[2]);
+    if (!h)
+    {
+        std::cerr << "open failed error=" << (int)last_error() << "\n";
+        return 3;
+    }
+    if (touch)
+    {
+        // Faults every frame in through the mapping first
+        for (size_t i = 0; i < frame_count(h); i++)
+        {
+            ImageView v = acquire_frame(h, i, 0);
+            if (!v.data) continue;
+            volatile unsigned char sink = 0;
+            const unsigned char* p = (const unsigned char*)v.data;
+            uint64_t n = frame_block_bytes(h, i);
+            for (uint64_t k = 0; k < n; k += 4096) sink = sink + p[k];
+            release_frame(h, i);
+        }
+    }
+    PackStats st{};
+    pack_stats(h, st);
+    close_hostpack(h);
+    if (!st.residency_known) std::cout << "page residency unavailable on this platform\n";
+    std::cout << "page=" << st.page_bytes << "\n";
+    print_range("total", st.total);
+    print_range("tables", st.tables);
+    for (const auto& s : st.sections) print_range(("section=" + std::string(s.name)).c_str(), s.range);
+    size_t full = 0;
+    size_t partial = 0;
+    for (const auto& f : st.frames)
+    {
+        full += f.pages && f.resident_pages == f.pages;
+        partial += f.resident_pages && f.resident_pages < f.pages;
+    }
+    std::cout << "frames=" << st.frames.size() << " resident=" << full << " partial=" << partial << " cold=" << st.frames.size() - full - partial << "\n";
+    if (per_frame)
+    {
+        for (size_t i = 0; i < st.frames.size(); i++) print_range(("frame=" + std::to_string(i)).c_str(), st.frames[i]);
+    }
+    const AccessCounters& a = st.access;
+    std::cout << "views=" << a.views << " acquires=" << a.acquires << " cache_hits=" << a.cache_hits << " cache_misses=" << a.cache_misses
+        << " reader_loads=" << a.reader_loads << " reader_bytes=" << a.reader_bytes << " prefetches=" << a.prefetches << " evictions=" << a.evictions << "\n";
+    return 0;
+}
+
+int cmd_shard(int argc, char** argv)
+{
+    if (argc < 5) return usage();
+    uint32_t block_align = 4096;
+    for (int i = 5; i < argc; i++)
+    {
+        if (!std::strcmp(argv[i], "--block-align") && i + 1 < argc)
+        {
+            block_align = (uint32_t)std::stoul(argv[++i]);
+        }
+        else
+        {
+            std::cerr << "unknown option: " << argv[i] << "\n";
+            return 2;
+        }
+    }
+    if (block_align == 0 || (block_align & (block_align - 1)))
+    {
+        std::cerr << "block-align must be power of two\n";
+        return 2;
+    }
+    if (shard_hostpack(argv[2], argv[3], (uint32_t)std::stoul(argv[4]), block_align))
+    {
+        std::cerr << "shard failed error=" << (int)last_error() << "\n";
+        return 3;
+    }
+    std::cout << "ok\n";
+    return 0;
+}
+
+int cmd_archive(int argc, char** argv)
+{
+    if (argc < 4) return usage();
+    std::vector<std::string> packs;
+    uint32_t block_align = 4096;
+    for (int i = 3; i < argc; i++)
+    {
+        if (!std::strcmp(argv[i], "--block-align") && i + 1 < argc)
+        {
+            block_align = (uint32_t)std::stoul(argv[++i]);
+        }
+        else
+        {
+            packs.push_back(argv[i]);
+        }
+    }
+    if (block_align == 0 || (block_align & (block_align - 1)))
+    {
+        std::cerr << "block-align must be power of two\n";
+        return 2;
+    }
+    if (build_archive(packs, {}, argv[2], block_align))
+    {
+        std::cerr << "archive failed error=" << (int)last_error() << "\n";
+        return 3;
+    }
+    std::cout << "ok\n";
+    return 0;
+}
+
+int cmd_scenes(int argc, char** argv)
+{
+    if (argc < 3) return usage();
+    ArchiveHandle a = open_archive(argv[2]);
+    if (!a)
+    {
+        std::cerr << "open failed error=" << (int)last_error() << "\n";
+        return 3;
+    }
+    size_t n = archive_scene_count(a);
+    for (size_t i = 0; i < n; i++)
+    {
+        PackHandle h = open_scene(a, i);
+        std::cout << i << ": " << archive_scene_name(a, i);
+        if (h) std::cout << " frames=" << frame_count(h) << " bytes=" << pack_bytes(h);
+        std::cout << "\n";
+        close_hostpack(h);
+    }
+    close_archive(a);
+    return 0;
+}
+
 int main(int argc, char** argv)
 {
     if (argc < 2) return usage();
     std::string cmd = argv[1];
-    if (cmd == "build") return cmd_build(argc, argv);
+    if (cmd == "build" || cmd == "append") return cmd_build(argc, argv);
+    if (cmd == "shard") return cmd_shard(argc, argv);
     if (cmd == "info") return cmd_info(argc, argv);
     if (cmd == "list") return cmd_list(argc, argv);
+    if (cmd == "verify") return cmd_verify(argc, argv);
+    if (cmd == "residency") return cmd_residency(argc, argv);
+    if (cmd == "archive") return cmd_archive(argc, argv);
+    if (cmd == "scenes") return cmd_scenes(argc, argv);
     return usage();
 }
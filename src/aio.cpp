@@ -0,0 +1,509 @@
+#include "aio.h"
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <condition_variable>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#if defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+#if defined(__linux__) && __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#define DATASET_HAS_IO_URING 1
+#endif
+
+namespace dataset::detail
+{
+    namespace
+    {
+        constexpr size_t kDirectAlign = 4096;
+
+#if defined(DATASET_HAS_IO_URING)
+        // Raw io_uring without liburing: two mapped rings plus the SQE array, one completion thread
+        struct Ring
+        {
+            int fd = -1;
+            void* sq_map = nullptr;
+            size_t sq_map_bytes = 0;
+            void* cq_map = nullptr;
+            size_t cq_map_bytes = 0;
+            io_uring_sqe* sqes = nullptr;
+            size_t sqes_bytes = 0;
+            unsigned* sq_head = nullptr;
+            unsigned* sq_tail = nullptr;
+            unsigned* sq_mask = nullptr;
+            unsigned* sq_array = nullptr;
+            unsigned sq_entries = 0;
+            unsigned* cq_head = nullptr;
+            unsigned* cq_tail = nullptr;
+            unsigned* cq_mask = nullptr;
+            io_uring_cqe* cqes = nullptr;
+        };
+
+        void ring_close(Ring& r)
+        {
+            if (r.sqes) munmap(r.sqes, r.sqes_bytes);
+            if (r.cq_map && r.cq_map != r.sq_map) munmap(r.cq_map, r.cq_map_bytes);
+            if (r.sq_map) munmap(r.sq_map, r.sq_map_bytes);
+            if (r.fd >= 0) close(r.fd);
+            r = Ring{};
+        }
+
+        bool ring_open(Ring& r, unsigned depth)
+        {
+            io_uring_params p;
+            std::memset(&p, 0, sizeof(p));
+            int fd = (int)syscall(__NR_io_uring_setup, depth, &p);
+            if (fd < 0) return false;
+            r.fd = fd;
+            r.sq_map_bytes = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+            r.cq_map_bytes = p.cq_off.cqes + p.cq_entries * sizeof(io_uring_cqe);
+            bool single = (p.features & IORING_FEAT_SINGLE_MMAP) != 0;
+            if (single) r.sq_map_bytes = r.cq_map_bytes = std::max(r.sq_map_bytes, r.cq_map_bytes);
+            r.sq_map = mmap(nullptr, r.sq_map_bytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+            if (r.sq_map == MAP_FAILED)
+            {
+                r.sq_map = nullptr;
+                ring_close(r);
+                return false;
+            }
+            if (single)
+            {
+                r.cq_map = r.sq_map;
+            }
+            else
+            {
+                r.cq_map = mmap(nullptr, r.cq_map_bytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+                if (r.cq_map == MAP_FAILED)
+                {
+                    r.cq_map = nullptr;
+                    ring_close(r);
+                    return false;
+                }
+            }
+            r.sqes_bytes = p.sq_entries * sizeof(io_uring_sqe);
+            void* s = mmap(nullptr, r.sqes_bytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+            if (s == MAP_FAILED)
+            {
+                ring_close(r);
+                return false;
+            }
+            r.sqes = (io_uring_sqe*)s;
+            char* sq = (char*)r.sq_map;
+            char* cq = (char*)r.cq_map;
+            r.sq_head = (unsigned*)(sq + p.sq_off.head);
+            r.sq_tail = (unsigned*)(sq + p.sq_off.tail);
+            r.sq_mask = (unsigned*)(sq + p.sq_off.ring_mask);
+            r.sq_array = (unsigned*)(sq + p.sq_off.array);
+            r.sq_entries = p.sq_entries;
+            r.cq_head = (unsigned*)(cq + p.cq_off.head);
+            r.cq_tail = (unsigned*)(cq + p.cq_off.tail);
+            r.cq_mask = (unsigned*)(cq + p.cq_off.ring_mask);
+            r.cqes = (io_uring_cqe*)(cq + p.cq_off.cqes);
+            return true;
+        }
+#endif
+
+        struct Pending
+        {
+            ReadOp op;
+            size_t got = 0;
+            bool direct = false;
+        };
+    }
+
+    struct AsyncReader
+    {
+#if defined(_WIN32)
+        std::vector<HANDLE> hfiles;
+#else
+        std::vector<int> fds;
+        std::vector<int> direct_fds;
+#endif
+        bool direct = false; // at least one O_DIRECT descriptor opened
+        bool uring = false;
+
+        std::mutex mu;
+        std::condition_variable cv;
+        std::deque<std::function<void()>> tasks;
+        std::vector<std::thread> workers;
+        bool stopping = false;
+
+#if defined(DATASET_HAS_IO_URING)
+        Ring ring;
+        std::thread reaper;
+        std::mutex sq_mu;
+        std::condition_variable sq_cv;
+        unsigned inflight = 0;
+        // Ordering for ops handed over through the kernel, spelled out so race detectors can follow it
+        std::atomic<uint64_t> submitted{0};
+#endif
+    };
+
+    namespace
+    {
+        // Blocking read of the part of p not yet filled, on the buffered descriptor so any offset works
+        bool finish_read(AsyncReader* r, Pending& p)
+        {
+            char* dst = (char*)p.op.dst;
+            while (p.got < p.op.bytes)
+            {
+#if defined(_WIN32)
+                OVERLAPPED ov;
+                std::memset(&ov, 0, sizeof(ov));
+                uint64_t off = p.op.off + p.got;
+                ov.Offset = (DWORD)off;
+                ov.OffsetHigh = (DWORD)(off >> 32);
+                size_t want = std::min<size_t>(p.op.bytes - p.got, size_t(1) << 30);
+                DWORD got = 0;
+                if (!ReadFile(r->hfiles[p.op.file], dst + p.got, (DWORD)want, &got, &ov) || got == 0) break;
+                p.got += got;
+#else
+                ssize_t n = pread(r->fds[p.op.file], dst + p.got, p.op.bytes - p.got, (off_t)(p.op.off + p.got));
+                if (n < 0 && errno == EINTR) continue;
+                if (n <= 0) break;
+                p.got += (size_t)n;
+#endif
+            }
+            return p.got >= p.op.need;
+        }
+
+        void worker_loop(AsyncReader* r)
+        {
+            for (;;)
+            {
+                std::function<void()> fn;
+                {
+                    std::unique_lock<std::mutex> lk(r->mu);
+                    r->cv.wait(lk, [&] { return r->stopping || !r->tasks.empty(); });
+                    if (r->tasks.empty()) return;
+                    fn = std::move(r->tasks.front());
+                    r->tasks.pop_front();
+                }
+                fn();
+            }
+        }
+
+#if defined(DATASET_HAS_IO_URING)
+        void retire(AsyncReader* r, Pending* p, bool ok)
+        {
+            if (p->op.done) p->op.done(ok);
+            delete p;
+            {
+                std::lock_guard<std::mutex> lk(r->sq_mu);
+                --r->inflight;
+            }
+            r->sq_cv.notify_all();
+        }
+
+        void complete(AsyncReader* r, Pending* p, int res)
+        {
+            if (res > 0) p->got += (size_t)res;
+            if (p->got >= p->op.need || res == 0)
+            {
+                retire(r, p, p->got >= p->op.need);
+                return;
+            }
+            // O_DIRECT refused by the file system (res < 0), or a read past the per-SQE cap: the rest goes
+            // through the page cache on a worker, keeping this thread free for other completions
+            aio_post(r, [r, p] { retire(r, p, finish_read(r, *p)); });
+        }
+
+        void reaper_loop(AsyncReader* r)
+        {
+            Ring& g = r->ring;
+            bool stop = false;
+            while (!stop)
+            {
+                long rc = syscall(__NR_io_uring_enter, g.fd, 0, 1, IORING_ENTER_GETEVENTS, nullptr, 0);
+                if (rc < 0 && errno != EINTR && errno != EAGAIN && errno != EBUSY) break;
+                (void)r->submitted.load(std::memory_order_acquire);
+                unsigned head = *g.cq_head;
+                unsigned tail = std::atomic_ref<unsigned>(*g.cq_tail).load(std::memory_order_acquire);
+                while (head != tail)
+                {
+                    io_uring_cqe cqe = g.cqes[head & *g.cq_mask];
+                    ++head;
+                    // Hand the slot back before running callbacks, which may take a while
+                    std::atomic_ref<unsigned>(*g.cq_head).store(head, std::memory_order_release);
+                    if (cqe.user_data == 0)
+                    {
+                        stop = true;
+                        continue;
+                    }
+                    complete(r, (Pending*)(uintptr_t)cqe.user_data, cqe.res);
+                }
+            }
+        }
+
+        // Queues one SQE; the caller holds sq_mu and has checked there is room
+        void push_sqe(AsyncReader* r, uint8_t opcode, int fd, void* dst, size_t bytes, uint64_t off, uint64_t user)
+        {
+            Ring& g = r->ring;
+            unsigned tail = *g.sq_tail;
+            unsigned idx = tail & *g.sq_mask;
+            io_uring_sqe& e = g.sqes[idx];
+            std::memset(&e, 0, sizeof(e));
+            e.opcode = opcode;
+            e.fd = fd;
+            e.addr = (uint64_t)(uintptr_t)dst;
+            e.len = (uint32_t)bytes;
+            e.off = off;
+            e.user_data = user;
+            g.sq_array[idx] = idx;
+            std::atomic_ref<unsigned>(*g.sq_tail).store(tail + 1, std::memory_order_release);
+        }
+
+        // False when the kernel refused the SQEs outright; the ones it did not take are still on the ring
+        bool enter_submit(AsyncReader* r, unsigned n)
+        {
+            while (n > 0)
+            {
+                long rc = syscall(__NR_io_uring_enter, r->ring.fd, n, 0, 0, nullptr, 0);
+                if (rc < 0)
+                {
+                    if (errno == EINTR || errno == EAGAIN || errno == EBUSY) continue;
+                    return false;
+                }
+                n -= (unsigned)rc;
+            }
+            return true;
+        }
+
+        // Takes the SQEs the kernel never consumed back off the ring and hands their reads to the workers,
+        // so every op still completes; the caller holds sq_mu
+        void reclaim_sqes(AsyncReader* r)
+        {
+            Ring& g = r->ring;
+            unsigned head = std::atomic_ref<unsigned>(*g.sq_head).load(std::memory_order_acquire);
+            unsigned tail = *g.sq_tail;
+            for (unsigned t = head; t != tail; ++t)
+            {
+                auto* p = (Pending*)(uintptr_t)g.sqes[g.sq_array[t & *g.sq_mask]].user_data;
+                aio_post(r, [r, p] { retire(r, p, finish_read(r, *p)); });
+            }
+            std::atomic_ref<unsigned>(*g.sq_tail).store(head, std::memory_order_release);
+        }
+#endif
+
+        bool use_direct(const AsyncReader* r, const ReadOp& op)
+        {
+#if defined(_WIN32)
+            return false;
+#else
+            return r->direct_fds[op.file] >= 0 && op.off % kDirectAlign == 0 && op.bytes % kDirectAlign == 0 &&
+                   (uintptr_t)op.dst % kDirectAlign == 0;
+#endif
+        }
+
+        void close_files(AsyncReader* r)
+        {
+#if defined(_WIN32)
+            for (HANDLE h : r->hfiles)
+            {
+                if (h != INVALID_HANDLE_VALUE) CloseHandle(h);
+            }
+#else
+            for (int fd : r->direct_fds)
+            {
+                if (fd >= 0) close(fd);
+            }
+            for (int fd : r->fds)
+            {
+                if (fd >= 0) close(fd);
+            }
+#endif
+        }
+    }
+
+    AsyncReader* aio_open(const std::string& path, uint32_t queue_depth, uint32_t threads, bool direct)
+    {
+        return aio_open(std::vector<std::string>{path}, queue_depth, threads, direct);
+    }
+
+    AsyncReader* aio_open(const std::vector<std::string>& paths, uint32_t queue_depth, uint32_t threads, bool direct)
+    {
+        auto* r = new AsyncReader();
+        bool ok = !paths.empty();
+        for (const std::string& path : paths)
+        {
+#if defined(_WIN32)
+            HANDLE h = INVALID_HANDLE_VALUE;
+            if (!path.empty()) h = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+            ok = ok && (path.empty() || h != INVALID_HANDLE_VALUE);
+            r->hfiles.push_back(h);
+#else
+            int fd = path.empty() ? -1 : open(path.c_str(), O_RDONLY);
+            int direct_fd = -1;
+            ok = ok && (path.empty() || fd >= 0);
+#if defined(O_DIRECT)
+            if (direct && fd >= 0) direct_fd = open(path.c_str(), O_RDONLY | O_DIRECT);
+#endif
+            r->fds.push_back(fd);
+            r->direct_fds.push_back(direct_fd);
+            r->direct = r->direct || direct_fd >= 0;
+#endif
+        }
+        if (!ok)
+        {
+            close_files(r);
+            delete r;
+            return nullptr;
+        }
+        if (queue_depth == 0) queue_depth = 64;
+        if (threads == 0) threads = std::max(1u, std::thread::hardware_concurrency());
+#if defined(DATASET_HAS_IO_URING)
+        const char* env = std::getenv("DATASET_AIO");
+        if (!(env && std::strcmp(env, "pread") == 0) && ring_open(r->ring, std::min(queue_depth, 4096u)))
+        {
+            r->uring = true;
+            r->reaper = std::thread(reaper_loop, r);
+        }
+#endif
+        for (uint32_t t = 0; t < threads; ++t) r->workers.emplace_back(worker_loop, r);
+        return r;
+    }
+
+    void aio_close(AsyncReader* r)
+    {
+        if (!r) return;
+#if defined(DATASET_HAS_IO_URING)
+        if (r->uring)
+        {
+            std::unique_lock<std::mutex> lk(r->sq_mu);
+            r->sq_cv.wait(lk, [&] { return r->inflight == 0; });
+            push_sqe(r, IORING_OP_NOP, -1, nullptr, 0, 0, 0);
+            enter_submit(r, 1);
+            lk.unlock();
+            r->reaper.join();
+            ring_close(r->ring);
+        }
+#endif
+        {
+            std::lock_guard<std::mutex> lk(r->mu);
+            r->stopping = true;
+        }
+        r->cv.notify_all();
+        for (auto& t : r->workers) t.join();
+        close_files(r);
+        delete r;
+    }
+
+    void aio_post(AsyncReader* r, std::function<void()> fn)
+    {
+        {
+            std::lock_guard<std::mutex> lk(r->mu);
+            r->tasks.push_back(std::move(fn));
+        }
+        r->cv.notify_one();
+    }
+
+    void aio_submit(AsyncReader* r, std::vector<ReadOp>& ops)
+    {
+#if defined(DATASET_HAS_IO_URING)
+        if (r->uring)
+        {
+            Ring& g = r->ring;
+            size_t i = 0;
+            while (i < ops.size())
+            {
+                std::unique_lock<std::mutex> lk(r->sq_mu);
+                r->sq_cv.wait(lk, [&] { return r->inflight < g.sq_entries; });
+                unsigned n = 0;
+                for (; i < ops.size() && r->inflight < g.sq_entries; ++i, ++n)
+                {
+                    auto* p = new Pending{std::move(ops[i]), 0, false};
+                    p->direct = use_direct(r, p->op);
+                    // A single SQE moves at most 1 GiB; a worker reads the remainder
+                    size_t len = std::min<size_t>(p->op.bytes, size_t(1) << 30);
+                    push_sqe(r, IORING_OP_READ, p->direct ? r->direct_fds[p->op.file] : r->fds[p->op.file], p->op.dst, len, p->op.off,
+                             (uint64_t)(uintptr_t)p);
+                    ++r->inflight;
+                }
+                r->submitted.fetch_add(n, std::memory_order_release);
+                if (!enter_submit(r, n)) reclaim_sqes(r);
+            }
+            ops.clear();
+            return;
+        }
+#endif
+        {
+            std::lock_guard<std::mutex> lk(r->mu);
+            for (auto& op : ops)
+            {
+                auto p = std::make_shared<Pending>(Pending{std::move(op), 0, false});
+                r->tasks.push_back([r, p]
+                {
+                    bool ok;
+#if defined(_WIN32)
+                    ok = finish_read(r, *p);
+#else
+                    if (use_direct(r, p->op))
+                    {
+                        char* dst = (char*)p->op.dst;
+                        while (p->got < p->op.bytes)
+                        {
+                            ssize_t n = pread(r->direct_fds[p->op.file], dst + p->got, p->op.bytes - p->got, (off_t)(p->op.off + p->got));
+                            if (n < 0 && errno == EINTR) continue;
+                            if (n <= 0 || (size_t)n % kDirectAlign != 0)
+                            {
+                                if (n > 0) p->got += (size_t)n;
+                                break;
+                            }
+                            p->got += (size_t)n;
+                        }
+                    }
+                    ok = p->got >= p->op.need || finish_read(r, *p);
+#endif
+                    if (p->op.done) p->op.done(ok);
+                });
+            }
+        }
+        ops.clear();
+        r->cv.notify_all();
+    }
+
+    const char* aio_backend(const AsyncReader* r)
+    {
+        return r->uring ? "io_uring" : "pread";
+    }
+
+    size_t aio_direct_align(const AsyncReader* r)
+    {
+#if defined(_WIN32)
+        return 0;
+#else
+        return r->direct ? kDirectAlign : 0;
+#endif
+    }
+
+    void* aligned_bytes(size_t align, size_t bytes)
+    {
+        bytes = (bytes + align - 1) / align * align;
+#if defined(_WIN32)
+        return _aligned_malloc(bytes ? bytes : align, align);
+#else
+        return std::aligned_alloc(align, bytes ? bytes : align);
+#endif
+    }
+
+    void free_aligned(void* p)
+    {
+#if defined(_WIN32)
+        _aligned_free(p);
+#else
+        std::free(p);
+#endif
+    }
+}
@@ -0,0 +1,46 @@
+#ifndef DATASET_AIO_H
+#define DATASET_AIO_H
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+namespace dataset::detail
+{
+    // Positional read of bytes at off into dst. A read that ends early at end of file still succeeds once
+    // need bytes have arrived; done runs on a reader thread.
+    struct ReadOp
+    {
+        uint64_t off;
+        size_t bytes;
+        size_t need;
+        void* dst;
+        std::function<void(bool ok)> done;
+        uint32_t file = 0; // index into the paths the reader was opened on
+    };
+
+    struct AsyncReader;
+
+    // Batched reads of one file through io_uring, or a pread thread pool where io_uring is unavailable or
+    // DATASET_AIO=pread. With direct, reads whose offset, length and buffer are multiples of
+    // aio_direct_align() go through an O_DIRECT descriptor; everything else uses the page cache.
+    AsyncReader* aio_open(const std::string& path, uint32_t queue_depth, uint32_t threads, bool direct);
+    // One reader over several files, ReadOp::file picking among them; empty paths are skipped and reads
+    // naming them fail
+    AsyncReader* aio_open(const std::vector<std::string>& paths, uint32_t queue_depth, uint32_t threads, bool direct);
+    // Waits for every submitted read and posted task
+    void aio_close(AsyncReader* r);
+    void aio_submit(AsyncReader* r, std::vector<ReadOp>& ops);
+    // Runs fn on the reader's worker pool, for post-processing that should not hold up completions
+    void aio_post(AsyncReader* r, std::function<void()> fn);
+    const char* aio_backend(const AsyncReader* r);
+    // 0 when O_DIRECT is off
+    size_t aio_direct_align(const AsyncReader* r);
+
+    void* aligned_bytes(size_t align, size_t bytes);
+    void free_aligned(void* p);
+}
+
+#endif
@@ -0,0 +1,706 @@
+#include "convert.h"
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <vector>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define DATASET_X86 1
+#include <immintrin.h>
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+#endif
+#elif defined(__aarch64__) || defined(_M_ARM64)
+#define DATASET_NEON 1
+#include <arm_neon.h>
+#endif
+
+#if defined(_MSC_VER) && !defined(__clang__)
+#define DATASET_TARGET(x)
+#else
+#define DATASET_TARGET(x) __attribute__((target(x)))
+#endif
+
+namespace dataset::detail
+{
+    namespace
+    {
+        struct Tables
+        {
+            float srgb[1024];
+            float unorm[1024];
+            // Linear values halfway between consecutive sRGB codes
+            float srgb_mid[255];
+
+            Tables()
+            {
+                for (int i = 0; i < 256; i++)
+                {
+                    float c = float(i) / 255.0f;
+                    float l = c <= 0.04045f ? c / 12.92f : std::pow((c + 0.055f) / 1.055f, 2.4f);
+                    for (int k = 0; k < 4; k++)
+                    {
+                        srgb[i * 4 + k] = k < 3 ? l : c;
+                        unorm[i * 4 + k] = c;
+                    }
+                    if (i < 255)
+                    {
+                        float m = (float(i) + 0.5f) / 255.0f;
+                        srgb_mid[i] = m <= 0.04045f ? m / 12.92f : std::pow((m + 0.055f) / 1.055f, 2.4f);
+                    }
+                }
+            }
+        };
+
+        const Tables& tables()
+        {
+            static const Tables t;
+            return t;
+        }
+
+#if DATASET_X86
+        DATASET_TARGET("sse4.1")
+        void rgba8_to_f32_sse41(const unsigned char* src, float* dst, size_t pixels, const float* table)
+        {
+            // SSE has no gather: the index math is vectorized, the table loads stay scalar
+            const __m128i lane = _mm_setr_epi32(0, 1, 2, 3);
+            for (size_t i = 0; i < pixels; i++)
+            {
+                int32_t v;
+                std::memcpy(&v, src + i * 4, 4);
+                __m128i idx = _mm_add_epi32(_mm_slli_epi32(_mm_cvtepu8_epi32(_mm_cvtsi32_si128(v)), 2), lane);
+                __m128 f = _mm_setr_ps(table[_mm_extract_epi32(idx, 0)], table[_mm_extract_epi32(idx, 1)], table[_mm_extract_epi32(idx, 2)], table[_mm_extract_epi32(idx, 3)]);
+                _mm_storeu_ps(dst + i * 4, f);
+            }
+        }
+
+        DATASET_TARGET("avx2")
+        void rgba8_to_f32_avx2(const unsigned char* src, float* dst, size_t pixels, const float* table)
+        {
+            const __m256i lane = _mm256_setr_epi32(0, 1, 2, 3, 0, 1, 2, 3);
+            size_t i = 0;
+            for (; i + 4 <= pixels; i += 4)
+            {
+                __m128i b = _mm_loadu_si128((const __m128i*)(src + i * 4));
+                __m256i lo = _mm256_add_epi32(_mm256_slli_epi32(_mm256_cvtepu8_epi32(b), 2), lane);
+                __m256i hi = _mm256_add_epi32(_mm256_slli_epi32(_mm256_cvtepu8_epi32(_mm_srli_si128(b, 8)), 2), lane);
+                _mm256_storeu_ps(dst + i * 4, _mm256_i32gather_ps(table, lo, 4));
+                _mm256_storeu_ps(dst + i * 4 + 8, _mm256_i32gather_ps(table, hi, 4));
+            }
+            rgba8_to_f32_scalar(src + i * 4, dst + i * 4, pixels - i, table);
+        }
+
+        DATASET_TARGET("avx512f")
+        void rgba8_to_f32_avx512(const unsigned char* src, float* dst, size_t pixels, const float* table)
+        {
+            const __m512i lane = _mm512_setr_epi32(0, 1, 2, 3, 0, 1, 2, 3, 0, 1, 2, 3, 0, 1, 2, 3);
+            size_t i = 0;
+            for (; i + 8 <= pixels; i += 8)
+            {
+                __m128i b0 = _mm_loadu_si128((const __m128i*)(src + i * 4));
+                __m128i b1 = _mm_loadu_si128((const __m128i*)(src + i * 4 + 16));
+                __m512i i0 = _mm512_add_epi32(_mm512_slli_epi32(_mm512_cvtepu8_epi32(b0), 2), lane);
+                __m512i i1 = _mm512_add_epi32(_mm512_slli_epi32(_mm512_cvtepu8_epi32(b1), 2), lane);
+                _mm512_storeu_ps(dst + i * 4, _mm512_i32gather_ps(i0, table, 4));
+                _mm512_storeu_ps(dst + i * 4 + 16, _mm512_i32gather_ps(i1, table, 4));
+            }
+            rgba8_to_f32_scalar(src + i * 4, dst + i * 4, pixels - i, table);
+        }
+
+        DATASET_TARGET("avx,f16c")
+        void f32_to_f16_f16c(const float* src, uint16_t* dst, size_t n)
+        {
+            size_t i = 0;
+            for (; i + 8 <= n; i += 8)
+            {
+                __m128i h = _mm256_cvtps_ph(_mm256_loadu_ps(src + i), _MM_FROUND_TO_NEAREST_INT);
+                _mm_storeu_si128((__m128i*)(dst + i), h);
+            }
+            f32_to_f16_scalar(src + i, dst + i, n - i);
+        }
+
+        DATASET_TARGET("avx,f16c")
+        void f16_to_f32_f16c(const uint16_t* src, float* dst, size_t n)
+        {
+            size_t i = 0;
+            for (; i + 8 <= n; i += 8)
+            {
+                _mm256_storeu_ps(dst + i, _mm256_cvtph_ps(_mm_loadu_si128((const __m128i*)(src + i))));
+            }
+            f16_to_f32_scalar(src + i, dst + i, n - i);
+        }
+
+        // Gathers stay per lane: consecutive rays rarely share a camera
+        DATASET_TARGET("avx2")
+        void ray_dirs_avx2(const CameraSOAView& c, const uint32_t* cam, const float* px, const float* py, size_t n, float* const o[3], float* const d[3])
+        {
+            const __m256i twelve = _mm256_set1_epi32(12);
+            size_t i = 0;
+            for (; i + 8 <= n; i += 8)
+            {
+                __m256i ci = _mm256_loadu_si256((const __m256i*)(cam + i));
+                __m256 x = _mm256_div_ps(_mm256_sub_ps(_mm256_loadu_ps(px + i), _mm256_i32gather_ps(c.cx, ci, 4)), _mm256_i32gather_ps(c.fx, ci, 4));
+                __m256 y = _mm256_div_ps(_mm256_sub_ps(_mm256_i32gather_ps(c.cy, ci, 4), _mm256_loadu_ps(py + i)), _mm256_i32gather_ps(c.fy, ci, 4));
+                __m256i ti = _mm256_mullo_epi32(ci, twelve);
+                __m256 v[3];
+                for (int r = 0; r < 3; r++)
+                {
+                    const float* row = c.T3x4 + r * 4;
+                    __m256 xy = _mm256_add_ps(_mm256_mul_ps(_mm256_i32gather_ps(row, ti, 4), x), _mm256_mul_ps(_mm256_i32gather_ps(row + 1, ti, 4), y));
+                    v[r] = _mm256_sub_ps(xy, _mm256_i32gather_ps(row + 2, ti, 4));
+                    _mm256_storeu_ps(o[r] + i, _mm256_i32gather_ps(row + 3, ti, 4));
+                }
+                __m256 len = _mm256_sqrt_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(v[0], v[0]), _mm256_mul_ps(v[1], v[1])), _mm256_mul_ps(v[2], v[2])));
+                for (int r = 0; r < 3; r++) _mm256_storeu_ps(d[r] + i, _mm256_div_ps(v[r], len));
+            }
+            float* ot[3] = {o[0] + i, o[1] + i, o[2] + i};
+            float* dt[3] = {d[0] + i, d[1] + i, d[2] + i};
+            ray_dirs_scalar(c, cam + i, px + i, py + i, n - i, ot, dt);
+        }
+
+        DATASET_TARGET("sse4.1")
+        void shade_rgba_sse41(const float* src, size_t n, const ShadeParams& p, uint32_t channels, float* const out[4], size_t step)
+        {
+            const __m128 one = _mm_set1_ps(1.0f);
+            size_t i = 0;
+            if (step == 1)
+            {
+                // Planar: four pixels transposed to one register per channel
+                __m128 bg[4], sc[4], bi[4];
+                for (int c = 0; c < 4; c++)
+                {
+                    bg[c] = _mm_set1_ps(c < 3 ? p.background[c] : 0.0f);
+                    sc[c] = _mm_set1_ps(p.scale[c]);
+                    bi[c] = _mm_set1_ps(p.bias[c]);
+                }
+                for (; i + 4 <= n; i += 4)
+                {
+                    __m128 v0 = _mm_loadu_ps(src + i * 4);
+                    __m128 v1 = _mm_loadu_ps(src + i * 4 + 4);
+                    __m128 v2 = _mm_loadu_ps(src + i * 4 + 8);
+                    __m128 v3 = _mm_loadu_ps(src + i * 4 + 12);
+                    _MM_TRANSPOSE4_PS(v0, v1, v2, v3);
+                    __m128 v[4] = {v0, v1, v2, v3};
+                    __m128 t = _mm_sub_ps(one, v3);
+                    __m128 m = p.straight ? v3 : one;
+                    for (uint32_t c = 0; c < channels; c++)
+                    {
+                        __m128 r = _mm_add_ps(_mm_mul_ps(v[c], c < 3 ? m : one), _mm_mul_ps(bg[c], t));
+                        _mm_storeu_ps(out[c] + i, _mm_add_ps(_mm_mul_ps(r, sc[c]), bi[c]));
+                    }
+                }
+            }
+            else
+            {
+                const __m128 bg = _mm_setr_ps(p.background[0], p.background[1], p.background[2], 0.0f);
+                const __m128 sc = _mm_loadu_ps(p.scale);
+                const __m128 bi = _mm_loadu_ps(p.bias);
+                for (; i < n; i++)
+                {
+                    __m128 x = _mm_loadu_ps(src + i * 4);
+                    __m128 a = _mm_shuffle_ps(x, x, 0xff);
+                    __m128 m = p.straight ? _mm_blend_ps(a, one, 0x8) : one;
+                    __m128 r = _mm_add_ps(_mm_mul_ps(_mm_add_ps(_mm_mul_ps(x, m), _mm_mul_ps(bg, _mm_sub_ps(one, a))), sc), bi);
+                    if (channels == 4)
+                    {
+                        _mm_storeu_ps(out[0] + i * step, r);
+                        continue;
+                    }
+                    alignas(16) float tmp[4];
+                    _mm_store_ps(tmp, r);
+                    for (uint32_t c = 0; c < channels; c++) out[0][i * step + c] = tmp[c];
+                }
+            }
+            float* rest[4] = {out[0] + i * step, out[1] + i * step, out[2] + i * step, out[3] + i * step};
+            shade_rgba_scalar(src + i * 4, n - i, p, channels, rest, step);
+        }
+
+        DATASET_TARGET("avx2")
+        void shade_rgba_avx2(const float* src, size_t n, const ShadeParams& p, uint32_t channels, float* const out[4], size_t step)
+        {
+            const __m256 one = _mm256_set1_ps(1.0f);
+            size_t i = 0;
+            if (step == 1)
+            {
+                // Planar: eight pixels transposed within lanes to one register per channel (pixel order
+                // 0 2 4 6 1 3 5 7), put back in order on the store
+                __m256 bg[4], sc[4], bi[4];
+                for (int c = 0; c < 4; c++)
+                {
+                    bg[c] = _mm256_set1_ps(c < 3 ? p.background[c] : 0.0f);
+                    sc[c] = _mm256_set1_ps(p.scale[c]);
+                    bi[c] = _mm256_set1_ps(p.bias[c]);
+                }
+                const __m256i order = _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7);
+                for (; i + 8 <= n; i += 8)
+                {
+                    const float* s = src + i * 4;
+                    __m256 x0 = _mm256_loadu_ps(s);
+                    __m256 x1 = _mm256_loadu_ps(s + 8);
+                    __m256 x2 = _mm256_loadu_ps(s + 16);
+                    __m256 x3 = _mm256_loadu_ps(s + 24);
+                    __m256 t0 = _mm256_unpacklo_ps(x0, x1);
+                    __m256 t1 = _mm256_unpackhi_ps(x0, x1);
+                    __m256 t2 = _mm256_unpacklo_ps(x2, x3);
+                    __m256 t3 = _mm256_unpackhi_ps(x2, x3);
+                    __m256 v[4] = {_mm256_shuffle_ps(t0, t2, 0x44), _mm256_shuffle_ps(t0, t2, 0xee), _mm256_shuffle_ps(t1, t3, 0x44), _mm256_shuffle_ps(t1, t3, 0xee)};
+                    __m256 t = _mm256_sub_ps(one, v[3]);
+                    __m256 m = p.straight ? v[3] : one;
+                    for (uint32_t c = 0; c < channels; c++)
+                    {
+                        __m256 r = _mm256_add_ps(_mm256_mul_ps(v[c], c < 3 ? m : one), _mm256_mul_ps(bg[c], t));
+                        r = _mm256_add_ps(_mm256_mul_ps(r, sc[c]), bi[c]);
+                        _mm256_storeu_ps(out[c] + i, _mm256_permutevar8x32_ps(r, order));
+                    }
+                }
+            }
+            else
+            {
+                // Interleaved: two pixels per register with alpha broadcast within each
+                const __m256 bg = _mm256_setr_ps(p.background[0], p.background[1], p.background[2], 0.0f, p.background[0], p.background[1], p.background[2], 0.0f);
+                const __m256 sc = _mm256_broadcast_ps((const __m128*)p.scale);
+                const __m256 bi = _mm256_broadcast_ps((const __m128*)p.bias);
+                for (; i + 2 <= n; i += 2)
+                {
+                    __m256 x = _mm256_loadu_ps(src + i * 4);
+                    __m256 a = _mm256_permute_ps(x, 0xff);
+                    __m256 m = p.straight ? _mm256_blend_ps(a, one, 0x88) : one;
+                    __m256 r = _mm256_add_ps(_mm256_mul_ps(_mm256_add_ps(_mm256_mul_ps(x, m), _mm256_mul_ps(bg, _mm256_sub_ps(one, a))), sc), bi);
+                    if (channels == 4)
+                    {
+                        _mm256_storeu_ps(out[0] + i * step, r);
+                        continue;
+                    }
+                    alignas(32) float tmp[8];
+                    _mm256_store_ps(tmp, r);
+                    for (uint32_t c = 0; c < channels; c++)
+                    {
+                        out[0][i * step + c] = tmp[c];
+                        out[0][(i + 1) * step + c] = tmp[4 + c];
+                    }
+                }
+            }
+            float* rest[4] = {out[0] + i * step, out[1] + i * step, out[2] + i * step, out[3] + i * step};
+            shade_rgba_scalar(src + i * 4, n - i, p, channels, rest, step);
+        }
+
+        bool cpu_has(const char* feature)
+        {
+#if defined(_MSC_VER) && !defined(__clang__)
+            int r[4];
+            __cpuid(r, 0);
+            int max_leaf = r[0];
+            __cpuid(r, 1);
+            bool sse41 = (r[2] >> 19) & 1;
+            bool osxsave = (r[2] >> 27) & 1;
+            bool avx = (r[2] >> 28) & 1;
+            unsigned long long xcr0 = osxsave ? _xgetbv(0) : 0;
+            bool ymm = avx && (xcr0 & 0x6) == 0x6;
+            bool zmm = ymm && (xcr0 & 0xe0) == 0xe0;
+            bool f16c = (r[2] >> 29) & 1;
+            int ebx7 = 0;
+            if (max_leaf >= 7)
+            {
+                __cpuidex(r, 7, 0);
+                ebx7 = r[1];
+            }
+            if (!std::strcmp(feature, "sse4.1")) return sse41;
+            if (!std::strcmp(feature, "f16c")) return ymm && f16c;
+            if (!std::strcmp(feature, "avx2")) return ymm && ((ebx7 >> 5) & 1);
+            if (!std::strcmp(feature, "avx512f")) return zmm && ((ebx7 >> 16) & 1);
+            return false;
+#else
+            __builtin_cpu_init();
+            if (!std::strcmp(feature, "sse4.1")) return __builtin_cpu_supports("sse4.1");
+            if (!std::strcmp(feature, "f16c")) return __builtin_cpu_supports("avx") && __builtin_cpu_supports("f16c");
+            if (!std::strcmp(feature, "avx2")) return __builtin_cpu_supports("avx2");
+            if (!std::strcmp(feature, "avx512f")) return __builtin_cpu_supports("avx512f");
+            return false;
+#endif
+        }
+#endif
+
+#if DATASET_NEON
+        void rgba8_to_f32_neon(const unsigned char* src, float* dst, size_t pixels, const float* table)
+        {
+            // NEON has no gather either; four pixels per step keep the loads independent
+            size_t i = 0;
+            for (; i + 4 <= pixels; i += 4)
+            {
+                const unsigned char* s = src + i * 4;
+                float* d = dst + i * 4;
+                for (int p = 0; p < 4; p++)
+                {
+                    float32x4_t f = vdupq_n_f32(0.0f);
+                    f = vld1q_lane_f32(table + s[p * 4 + 0] * 4 + 0, f, 0);
+                    f = vld1q_lane_f32(table + s[p * 4 + 1] * 4 + 1, f, 1);
+                    f = vld1q_lane_f32(table + s[p * 4 + 2] * 4 + 2, f, 2);
+                    f = vld1q_lane_f32(table + s[p * 4 + 3] * 4 + 3, f, 3);
+                    vst1q_f32(d + p * 4, f);
+                }
+            }
+            rgba8_to_f32_scalar(src + i * 4, dst + i * 4, pixels - i, table);
+        }
+
+        void ray_dirs_neon(const CameraSOAView& c, const uint32_t* cam, const float* px, const float* py, size_t n, float* const o[3], float* const d[3])
+        {
+            size_t i = 0;
+            for (; i + 4 <= n; i += 4)
+            {
+                float fx[4], fy[4], cx[4], cy[4], t[12][4];
+                for (int k = 0; k < 4; k++)
+                {
+                    uint32_t j = cam[i + k];
+                    fx[k] = c.fx[j];
+                    fy[k] = c.fy[j];
+                    cx[k] = c.cx[j];
+                    cy[k] = c.cy[j];
+                    for (int e = 0; e < 12; e++) t[e][k] = c.T3x4[j * 12 + e];
+                }
+                float32x4_t x = vdivq_f32(vsubq_f32(vld1q_f32(px + i), vld1q_f32(cx)), vld1q_f32(fx));
+                float32x4_t y = vdivq_f32(vsubq_f32(vld1q_f32(cy), vld1q_f32(py + i)), vld1q_f32(fy));
+                float32x4_t v[3];
+                for (int r = 0; r < 3; r++)
+                {
+                    float32x4_t xy = vaddq_f32(vmulq_f32(vld1q_f32(t[r * 4]), x), vmulq_f32(vld1q_f32(t[r * 4 + 1]), y));
+                    v[r] = vsubq_f32(xy, vld1q_f32(t[r * 4 + 2]));
+                    vst1q_f32(o[r] + i, vld1q_f32(t[r * 4 + 3]));
+                }
+                float32x4_t len = vsqrtq_f32(vaddq_f32(vaddq_f32(vmulq_f32(v[0], v[0]), vmulq_f32(v[1], v[1])), vmulq_f32(v[2], v[2])));
+                for (int r = 0; r < 3; r++) vst1q_f32(d[r] + i, vdivq_f32(v[r], len));
+            }
+            float* ot[3] = {o[0] + i, o[1] + i, o[2] + i};
+            float* dt[3] = {d[0] + i, d[1] + i, d[2] + i};
+            ray_dirs_scalar(c, cam + i, px + i, py + i, n - i, ot, dt);
+        }
+
+        void f32_to_f16_neon(const float* src, uint16_t* dst, size_t n)
+        {
+            size_t i = 0;
+            for (; i + 4 <= n; i += 4)
+            {
+                vst1_u16(dst + i, vreinterpret_u16_f16(vcvt_f16_f32(vld1q_f32(src + i))));
+            }
+            f32_to_f16_scalar(src + i, dst + i, n - i);
+        }
+
+        void f16_to_f32_neon(const uint16_t* src, float* dst, size_t n)
+        {
+            size_t i = 0;
+            for (; i + 4 <= n; i += 4)
+            {
+                vst1q_f32(dst + i, vcvt_f32_f16(vreinterpret_f16_u16(vld1_u16(src + i))));
+            }
+            f16_to_f32_scalar(src + i, dst + i, n - i);
+        }
+
+        void shade_rgba_neon(const float* src, size_t n, const ShadeParams& p, uint32_t channels, float* const out[4], size_t step)
+        {
+            // vld4 deinterleaves four pixels into one register per channel; vst3/vst4 interleave them back
+            const float32x4_t one = vdupq_n_f32(1.0f);
+            size_t i = 0;
+            if (step == 1 || step == channels)
+            {
+                for (; i + 4 <= n; i += 4)
+                {
+                    float32x4x4_t v = vld4q_f32(src + i * 4);
+                    float32x4_t t = vsubq_f32(one, v.val[3]);
+                    float32x4_t m = p.straight ? v.val[3] : one;
+                    for (int c = 0; c < 4; c++)
+                    {
+                        float bg = c < 3 ? p.background[c] : 0.0f;
+                        float32x4_t r = vaddq_f32(vmulq_f32(v.val[c], c < 3 ? m : one), vmulq_f32(vdupq_n_f32(bg), t));
+                        v.val[c] = vaddq_f32(vmulq_f32(r, vdupq_n_f32(p.scale[c])), vdupq_n_f32(p.bias[c]));
+                    }
+                    if (step == 1)
+                    {
+                        for (uint32_t c = 0; c < channels; c++) vst1q_f32(out[c] + i, v.val[c]);
+                    }
+                    else if (channels == 4)
+                    {
+                        vst4q_f32(out[0] + i * 4, v);
+                    }
+                    else
+                    {
+                        float32x4x3_t rgb = {{v.val[0], v.val[1], v.val[2]}};
+                        vst3q_f32(out[0] + i * 3, rgb);
+                    }
+                }
+            }
+            float* rest[4] = {out[0] + i * step, out[1] + i * step, out[2] + i * step, out[3] + i * step};
+            shade_rgba_scalar(src + i * 4, n - i, p, channels, rest, step);
+        }
+#endif
+
+        ConvertKernels select_kernels()
+        {
+            ConvertKernels best{"scalar", rgba8_to_f32_scalar, f32_to_f16_scalar, f16_to_f32_scalar, ray_dirs_scalar, shade_rgba_scalar};
+            ConvertKernels all[4];
+            int n = 0;
+            all[n++] = best;
+#if DATASET_X86
+            bool f16c = cpu_has("f16c");
+            f32_to_f16_fn to_f16 = f16c ? f32_to_f16_f16c : f32_to_f16_scalar;
+            f16_to_f32_fn from_f16 = f16c ? f16_to_f32_f16c : f16_to_f32_scalar;
+            if (cpu_has("sse4.1")) all[n++] = best = ConvertKernels{"sse41", rgba8_to_f32_sse41, f32_to_f16_scalar, f16_to_f32_scalar, ray_dirs_scalar, shade_rgba_sse41};
+            if (cpu_has("avx2")) all[n++] = best = ConvertKernels{"avx2", rgba8_to_f32_avx2, to_f16, from_f16, ray_dirs_avx2, shade_rgba_avx2};
+            if (cpu_has("avx512f")) all[n++] = best = ConvertKernels{"avx512", rgba8_to_f32_avx512, to_f16, from_f16, ray_dirs_avx2, shade_rgba_avx2};
+#elif DATASET_NEON
+            all[n++] = best = ConvertKernels{"neon", rgba8_to_f32_neon, f32_to_f16_neon, f16_to_f32_neon, ray_dirs_neon, shade_rgba_neon};
+#endif
+            const char* force = std::getenv("DATASET_SIMD");
+            if (force)
+            {
+                for (int k = 0; k < n; k++)
+                {
+                    if (!std::strcmp(force, all[k].name)) return all[k];
+                }
+            }
+            return best;
+        }
+    }
+
+    void rgba8_to_f32_scalar(const unsigned char* src, float* dst, size_t pixels, const float* table)
+    {
+        for (size_t i = 0; i < pixels; i++)
+        {
+            dst[i * 4 + 0] = table[src[i * 4 + 0] * 4 + 0];
+            dst[i * 4 + 1] = table[src[i * 4 + 1] * 4 + 1];
+            dst[i * 4 + 2] = table[src[i * 4 + 2] * 4 + 2];
+            dst[i * 4 + 3] = table[src[i * 4 + 3] * 4 + 3];
+        }
+    }
+
+    // Round-to-nearest-even float to half (F. Giesen's float_to_half_fast3_rtne)
+    uint16_t f32_to_f16(float f)
+    {
+        uint32_t u;
+        std::memcpy(&u, &f, 4);
+        uint32_t sign = u & 0x80000000u;
+        u ^= sign;
+        uint16_t o;
+        if (u >= (127u + 16u) << 23)
+        {
+            o = u > 0x7f800000u ? 0x7e00 : 0x7c00;
+        }
+        else if (u < 113u << 23)
+        {
+            const uint32_t magic_u = ((127u - 15u) + (23u - 10u) + 1u) << 23;
+            float magic;
+            std::memcpy(&magic, &magic_u, 4);
+            float v;
+            std::memcpy(&v, &u, 4);
+            v += magic;
+            std::memcpy(&u, &v, 4);
+            o = (uint16_t)(u - magic_u);
+        }
+        else
+        {
+            uint32_t mant_odd = (u >> 13) & 1;
+            u += ((uint32_t)(15 - 127) << 23) + 0xfff;
+            u += mant_odd;
+            o = (uint16_t)(u >> 13);
+        }
+        return (uint16_t)(o | (sign >> 16));
+    }
+
+    float f16_to_f32(uint16_t h)
+    {
+        uint32_t sign = (uint32_t)(h & 0x8000) << 16;
+        uint32_t e = (h >> 10) & 0x1f;
+        uint32_t m = h & 0x3ff;
+        uint32_t u;
+        if (e == 0)
+        {
+            float v = (float)m * 5.9604644775390625e-8f;
+            std::memcpy(&u, &v, 4);
+            u |= sign;
+        }
+        else if (e == 31)
+        {
+            u = sign | 0x7f800000u | (m << 13);
+        }
+        else
+        {
+            u = sign | ((e + 112) << 23) | (m << 13);
+        }
+        float f;
+        std::memcpy(&f, &u, 4);
+        return f;
+    }
+
+    void f32_to_f16_scalar(const float* src, uint16_t* dst, size_t n)
+    {
+        for (size_t i = 0; i < n; i++) dst[i] = f32_to_f16(src[i]);
+    }
+
+    void f16_to_f32_scalar(const uint16_t* src, float* dst, size_t n)
+    {
+        for (size_t i = 0; i < n; i++) dst[i] = f16_to_f32(src[i]);
+    }
+
+    void ray_dirs_scalar(const CameraSOAView& c, const uint32_t* cam, const float* px, const float* py, size_t n, float* const o[3], float* const d[3])
+    {
+        for (size_t i = 0; i < n; i++)
+        {
+            const float* t = c.T3x4 + (size_t)cam[i] * 12;
+            float x = (px[i] - c.cx[cam[i]]) / c.fx[cam[i]];
+            float y = (c.cy[cam[i]] - py[i]) / c.fy[cam[i]];
+            float v[3];
+            for (int r = 0; r < 3; r++)
+            {
+                float xy = t[r * 4] * x + t[r * 4 + 1] * y;
+                v[r] = xy - t[r * 4 + 2];
+                o[r][i] = t[r * 4 + 3];
+            }
+            float len = std::sqrt(v[0] * v[0] + v[1] * v[1] + v[2] * v[2]);
+            for (int r = 0; r < 3; r++) d[r][i] = v[r] / len;
+        }
+    }
+
+    void shade_rgba_scalar(const float* src, size_t n, const ShadeParams& p, uint32_t channels, float* const out[4], size_t step)
+    {
+        // Alpha goes through the same multiply-add as color (times 1, plus 0) to match the vector kernels
+        const float bg[4] = {p.background[0], p.background[1], p.background[2], 0.0f};
+        for (size_t i = 0; i < n; i++)
+        {
+            const float* s = src + i * 4;
+            float t = 1.0f - s[3];
+            float m = p.straight ? s[3] : 1.0f;
+            for (uint32_t c = 0; c < channels; c++)
+            {
+                float v = s[c] * (c < 3 ? m : 1.0f) + bg[c] * t;
+                out[c][i * step] = v * p.scale[c] + p.bias[c];
+            }
+        }
+    }
+
+    const ConvertKernels& convert_kernels()
+    {
+        static const ConvertKernels k = select_kernels();
+        return k;
+    }
+
+    const float* srgb_to_linear_table()
+    {
+        return tables().srgb;
+    }
+
+    const float* unorm8_table()
+    {
+        return tables().unorm;
+    }
+
+    unsigned char linear_to_srgb8(float v)
+    {
+        const float* mid = tables().srgb_mid;
+        unsigned lo = 0;
+        unsigned hi = 255;
+        while (lo < hi)
+        {
+            unsigned m = (lo + hi) / 2;
+            if (v >= mid[m])
+            {
+                lo = m + 1;
+            }
+            else
+            {
+                hi = m;
+            }
+        }
+        return (unsigned char)lo;
+    }
+
+    bool decode_row_f32(const unsigned char* s, PixelFormat pf, size_t n, bool srgb, float* d)
+    {
+        const auto& k = convert_kernels();
+        const float* table = srgb ? srgb_to_linear_table() : unorm8_table();
+        switch (pf)
+        {
+        case PixelFormat::RGBA8:
+            k.rgba8_to_f32(s, d, n, table);
+            return true;
+        case PixelFormat::RGBA32F:
+            std::memcpy(d, s, n * 16);
+            return true;
+        case PixelFormat::RGBA16F:
+            k.f16_to_f32((const uint16_t*)s, d, n * 4);
+            return true;
+        case PixelFormat::RGB8:
+            for (size_t x = 0; x < n; x++)
+            {
+                d[x * 4 + 0] = table[s[x * 3 + 0] * 4 + 0];
+                d[x * 4 + 1] = table[s[x * 3 + 1] * 4 + 1];
+                d[x * 4 + 2] = table[s[x * 3 + 2] * 4 + 2];
+                d[x * 4 + 3] = 1.0f;
+            }
+            return true;
+        case PixelFormat::RGB16F:
+        {
+            thread_local std::vector<float> f;
+            f.resize(n * 3);
+            k.f16_to_f32((const uint16_t*)s, f.data(), n * 3);
+            for (size_t x = 0; x < n; x++)
+            {
+                d[x * 4 + 0] = f[x * 3 + 0];
+                d[x * 4 + 1] = f[x * 3 + 1];
+                d[x * 4 + 2] = f[x * 3 + 2];
+                d[x * 4 + 3] = 1.0f;
+            }
+            return true;
+        }
+        }
+        return false;
+    }
+
+    bool encode_row_f32(const float* s, PixelFormat pf, size_t n, unsigned char* d)
+    {
+        const auto& k = convert_kernels();
+        auto unorm8 = [](float v)
+        {
+            v = v < 0.0f ? 0.0f : v > 1.0f ? 1.0f : v;
+            return (unsigned char)(v * 255.0f + 0.5f);
+        };
+        switch (pf)
+        {
+        case PixelFormat::RGBA8:
+            for (size_t x = 0; x < n; x++)
+            {
+                d[x * 4 + 0] = linear_to_srgb8(s[x * 4 + 0]);
+                d[x * 4 + 1] = linear_to_srgb8(s[x * 4 + 1]);
+                d[x * 4 + 2] = linear_to_srgb8(s[x * 4 + 2]);
+                d[x * 4 + 3] = unorm8(s[x * 4 + 3]);
+            }
+            return true;
+        case PixelFormat::RGBA32F:
+            std::memcpy(d, s, n * 16);
+            return true;
+        case PixelFormat::RGBA16F:
+            k.f32_to_f16(s, (uint16_t*)d, n * 4);
+            return true;
+        case PixelFormat::RGB8:
+            for (size_t x = 0; x < n; x++)
+            {
+                d[x * 3 + 0] = linear_to_srgb8(s[x * 4 + 0]);
+                d[x * 3 + 1] = linear_to_srgb8(s[x * 4 + 1]);
+                d[x * 3 + 2] = linear_to_srgb8(s[x * 4 + 2]);
+            }
+            return true;
+        case PixelFormat::RGB16F:
+        {
+            thread_local std::vector<float> f;
+            f.resize(n * 3);
+            for (size_t x = 0; x < n; x++)
+            {
+                f[x * 3 + 0] = s[x * 4 + 0];
+                f[x * 3 + 1] = s[x * 4 + 1];
+                f[x * 3 + 2] = s[x * 4 + 2];
+            }
+            k.f32_to_f16(f.data(), (uint16_t*)d, n * 3);
+            return true;
+        }
+        }
+        return false;
+    }
+}
\ No newline at end of file
@@ -0,0 +1,66 @@
+#ifndef DATASET_CONVERT_H
+#define DATASET_CONVERT_H
+
+#include <cstddef>
+#include <cstdint>
+#include "dataset.h"
+
+namespace dataset::detail
+{
+    // Expands interleaved RGBA8 to RGBA32F through a 1024-entry table indexed by byte * 4 + channel, so
+    // every kernel produces exactly the scalar reference result.
+    using rgba8_to_f32_fn = void (*)(const unsigned char* src, float* dst, size_t pixels, const float* table);
+    // IEEE binary16 with round-to-nearest-even, matching F16C/NEON hardware conversion
+    using f32_to_f16_fn = void (*)(const float* src, uint16_t* dst, size_t n);
+    using f16_to_f32_fn = void (*)(const uint16_t* src, float* dst, size_t n);
+    // World-space rays through pixel positions (px, py) of cameras cam[k] in the NeRF/OpenGL convention
+    // (camera looks down -z, +y up). Directions are unit length and bit-identical to the scalar kernel.
+    using ray_dirs_fn = void (*)(const CameraSOAView& c, const uint32_t* cam, const float* px, const float* py, size_t n, float* const o[3], float* const d[3]);
+
+    // Per-pixel shading of decoded float RGBA: rgb = rgb * (straight ? a : 1) + background * (1 - a), then
+    // every channel v * scale + bias. A zero background with straight unset leaves color untouched.
+    struct ShadeParams
+    {
+        bool straight;
+        float background[3];
+        float scale[4];
+        float bias[4];
+    };
+    // Shades n pixels and writes channel c of pixel i to out[c][i * step] for c < channels: step 1 is planar,
+    // otherwise out[c] = out[0] + c interleaved. Bit-identical to the scalar kernel.
+    using shade_rgba_fn = void (*)(const float* src, size_t n, const ShadeParams& p, uint32_t channels, float* const out[4], size_t step);
+
+    struct ConvertKernels
+    {
+        const char* name;
+        rgba8_to_f32_fn rgba8_to_f32;
+        f32_to_f16_fn f32_to_f16;
+        f16_to_f32_fn f16_to_f32;
+        ray_dirs_fn ray_dirs;
+        shade_rgba_fn shade_rgba;
+    };
+
+    // Best kernel set for this CPU, picked once; DATASET_SIMD=scalar|sse41|avx2|avx512|neon forces one
+    const ConvertKernels& convert_kernels();
+    // sRGB-decoded RGB with alpha / 255
+    const float* srgb_to_linear_table();
+    // All four channels / 255
+    const float* unorm8_table();
+
+    void rgba8_to_f32_scalar(const unsigned char* src, float* dst, size_t pixels, const float* table);
+    void f32_to_f16_scalar(const float* src, uint16_t* dst, size_t n);
+    void f16_to_f32_scalar(const uint16_t* src, float* dst, size_t n);
+    void ray_dirs_scalar(const CameraSOAView& c, const uint32_t* cam, const float* px, const float* py, size_t n, float* const o[3], float* const d[3]);
+    void shade_rgba_scalar(const float* src, size_t n, const ShadeParams& p, uint32_t channels, float* const out[4], size_t step);
+    uint16_t f32_to_f16(float f);
+    float f16_to_f32(uint16_t h);
+    // Round-to-nearest sRGB encoding of a linear value, the inverse of srgb_to_linear_table()
+    unsigned char linear_to_srgb8(float v);
+
+    // Decodes n stored pixels to float RGBA (alpha 1 for RGB formats); srgb linearizes 8-bit color
+    bool decode_row_f32(const unsigned char* s, PixelFormat pf, size_t n, bool srgb, float* d);
+    // Encodes n linear float RGBA pixels to the stored format; 8-bit formats are sRGB encoded, RGB drops alpha
+    bool encode_row_f32(const float* s, PixelFormat pf, size_t n, unsigned char* d);
+}
+
+#endif
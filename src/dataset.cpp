@@ -7,11 +7,29 @@
 #include <filesystem>
 #include <atomic>
 #include <thread>
+#include <mutex>
+#include <condition_variable>
 #include <cstring>
 #include <cmath>
+#include <cctype>
+#include <algorithm>
+#include <functional>
+#include <list>
+#include <unordered_map>
+#include <chrono>
+#include <future>
+#include <memory>
+#include <string_view>
+#include <span>
 #include <simdjson.h>
 #include <spng.h>
+#include <libdeflate.h>
 #include "mmio.h"
+#include "aio.h"
+#include "convert.h"
+#include "exr.h"
+#include "mips.h"
+#include "parallel.h"
 namespace fs = std::filesystem;
 
 namespace dataset
@@ -33,6 +51,33 @@ namespace dataset
             uint32_t pixel_format;
             uint32_t color_space;
             uint64_t caps_bits;
+            // version 3+: directory of optional sections that follow the pixel data
+            uint64_t sects_off;
+            uint32_t sect_count;
+            uint32_t reserved1;
+        };
+
+        constexpr uint32_t kHdrVersion = 4;
+        // Hdr::flags low byte: log2 of the tile edge for tiled packs, 0 for scanline rows
+        constexpr uint32_t kFlagTileShiftMask = 0xff;
+
+        enum SectKind : uint32_t
+        {
+            SectMips = 1,
+            SectRays = 2,
+            SectManifest = 3,
+            SectChecksums = 4,
+            SectFill = 5,
+            SectImportance = 6,
+            SectShards = 7,
+        };
+
+        struct SectRec
+        {
+            uint32_t kind;
+            uint32_t flags;
+            uint64_t off;
+            uint64_t bytes;
         };
 
         struct SceneRec
@@ -67,20 +112,270 @@ namespace dataset
             uint32_t roi_y;
             uint32_t roi_w;
             uint32_t roi_h;
+            // version 4+: size of the frame block (all levels) and of its stored form, smaller when compressed
+            uint64_t block_bytes;
+            uint64_t stored_bytes;
+        };
+
+        constexpr size_t kFrameRecV3Bytes = offsetof(FrameRec, block_bytes);
+
+        // SectMips holds frames * stride records (stride = section flags), level 0 included
+        struct MipRec
+        {
+            uint64_t off;
+            uint32_t width;
+            uint32_t height;
+            uint32_t row_stride;
+            uint32_t reserved;
+        };
+
+        // SectRays starts with one record per frame; offsets are relative to the section
+        struct RayRec
+        {
+            uint64_t dir_off;
+            uint64_t near_off;
+            uint64_t far_off;
+            uint32_t width;
+            uint32_t height;
+        };
+
+        // SectManifest: one record per frame after the head, then the source paths they point into (offsets
+        // relative to the section)
+        struct ManifestHead
+        {
+            uint64_t config_hash;
+            uint64_t count;
+        };
+
+        struct ManifestRec
+        {
+            uint64_t size;
+            int64_t mtime_ns;
+            uint64_t path_off;
+            uint32_t path_len;
+            uint32_t crc32;
+        };
+
+        // SectChecksums: CRC-32 of the header, the scene record, the camera block (CamSOA and its arrays), the
+        // frame table, every earlier section (directory order) and every frame's stored bytes. It is written
+        // last and does not cover itself.
+        struct SumHead
+        {
+            uint32_t hdr_crc;
+            uint32_t scene_crc;
+            uint32_t cam_crc;
+            uint32_t frames_crc;
+            uint32_t sect_count;
+            uint32_t reserved;
+            uint64_t frame_count;
+        };
+
+        // sect_count of these follow SumHead, then frame_count uint32_t frame checksums
+        struct SumSect
+        {
+            uint32_t kind;
+            uint32_t crc;
+        };
+
+        // SectImportance (flags = tile edge): the head, one record per frame, the frame probabilities and their
+        // prefix sums (frame_count floats each from frames_off), then per frame its tile probabilities and their
+        // prefix sums from off. Offsets are relative to the section.
+        struct ImpHead
+        {
+            uint32_t tile;
+            uint32_t source;
+            float floor;
+            uint32_t reserved;
+            uint64_t frame_count;
+            uint64_t frames_off;
+        };
+
+        struct ImpRec
+        {
+            uint64_t off;
+            double total; // sum of the frame's raw tile weights, which the frame probabilities are derived from
+            uint32_t tiles_x;
+            uint32_t tiles_y;
+        };
+
+        // SectFill: the stored pixel (pixel_stride bytes) that frames of cropped packs read as outside their ROI
+        constexpr size_t kFillBytes = 16;
+
+        // SectShards (index packs, CapSharded): the head, one record per shard, the shard of every frame
+        // (frame_count uint32_t from map_off) and the shard file names, relative to the index's directory.
+        // Offsets are relative to the section. Shard k's file is mapped at virt_off of the pack's address range,
+        // where the frame table points its frames' blocks.
+        struct ShardHead
+        {
+            uint64_t pack_id;
+            uint32_t shard_count;
+            uint32_t reserved;
+            uint64_t frame_count;
+            uint64_t map_off;
+        };
+
+        struct ShardRec
+        {
+            uint64_t virt_off;
+            uint64_t bytes; // size of the shard file
+            uint64_t frame_count;
+            uint64_t name_off;
+            uint32_t name_len;
+            uint32_t reserved;
+        };
+
+        // Start of every shard file, frame blocks following from the first block_align boundary. pack_id ties it
+        // to the index it was written with.
+        struct ShardHdr
+        {
+            char magic[4];
+            uint32_t version;
+            uint64_t pack_id;
+            uint32_t shard;
+            uint32_t shard_count;
+            uint64_t bytes;
+        };
+
+        constexpr uint32_t kShardVersion = 1;
+        // Shard slots of the address range start on this boundary, which covers any page size in use
+        constexpr uint64_t kShardSlotAlign = 1ull << 16;
+
+        // Archive of hostpacks: header, catalog sorted by name, the names, then the member packs
+        struct ArcHdr
+        {
+            char magic[4];
+            uint32_t version;
+            uint64_t scene_count;
+            uint64_t catalog_off;
+            uint64_t names_off;
+            uint64_t bytes_total;
+        };
+
+        constexpr uint32_t kArcVersion = 1;
+
+        // Member offsets are absolute and block aligned; name_off is relative to ArcHdr::names_off
+        struct ArcEntry
+        {
+            uint64_t off;
+            uint64_t bytes;
+            uint64_t name_off;
+            uint32_t name_len;
+            uint32_t reserved;
+        };
+
+        struct ArchiveImpl
+        {
+            detail::mmap_ro map;
+            std::string path;
+            const ArcEntry* cat = nullptr;
+            size_t count = 0;
+            const char* names = nullptr;
+
+            ~ArchiveImpl()
+            {
+                detail::munmap_file(map);
+            }
+        };
+
+        // Scenes hold the same shared_ptr, so the mapping outlives whichever of them closes last
+        struct ArchiveBox
+        {
+            std::shared_ptr<ArchiveImpl> a;
+        };
+
+        inline std::string_view entry_name(const ArchiveImpl* a, const ArcEntry& e)
+        {
+            return std::string_view(a->names + e.name_off, e.name_len);
+        }
+
+        // Decompressed blocks of compressed frames; pinned entries are never evicted
+        struct FrameCache
+        {
+            struct Entry
+            {
+                std::vector<unsigned char> data;
+                uint32_t pins;
+                bool ready;
+                bool failed;
+                std::list<size_t>::iterator lru;
+            };
+            std::mutex mu;
+            std::condition_variable cv;
+            std::unordered_map<size_t, Entry> entries;
+            // Unpinned frames, most recently released first
+            std::list<size_t> lru;
+            uint64_t bytes;
+            uint64_t budget;
+        };
+
+        // Background prefetch/evict along a caller-declared frame order
+        struct Readahead
+        {
+            std::thread th;
+            std::mutex mu;
+            std::condition_variable cv;
+            std::vector<size_t> order;
+            size_t pos;
+            size_t ahead; // order[..ahead) has been prefetched
+            size_t behind; // order[..behind) has been evicted
+            uint32_t lookahead;
+            bool evict_behind;
+            bool stop;
         };
 
         struct PackHandleImpl
         {
             detail::mmap_ro map;
+            // Archive scenes: keeps the archive mapping map is a view of alive, and map is not unmapped
+            std::shared_ptr<void> owner;
+            std::string path;
             Hdr hdr;
             SceneRec scene;
             CamSOA cam;
-            std::vector<FrameRec> frames;
+            // In place in the mapping; records are checked when a frame is touched (frame_ok), not at open
+            std::span<const FrameRec> frames;
+            // Version 3 records widened to FrameRec, the one table open still copies
+            std::vector<FrameRec> frames_v3;
             const char* base;
+            const MipRec* mips;
+            uint32_t mip_stride;
+            const char* rays;
+            uint64_t rays_bytes;
+            const char* imp;
+            uint64_t imp_bytes;
+            const SumHead* sums;
+            const uint32_t* frame_crc;
+            const unsigned char* fill;
+            // Index packs: map reserves the whole address range and holds the index file at its start; shards[k]
+            // is shard k's file in its slot, empty when this handle does not own it
+            const ShardRec* shard_recs;
+            const uint32_t* frame_shards;
+            std::vector<detail::mmap_ro> shards;
+            std::vector<std::string> shard_paths;
+            // Frame probabilities and prefix sums renormalised over the owned frames, when some are not
+            std::vector<float> owned_imp;
+            // OpenOptions::verify_frames: per frame 0 = unchecked, 1 = good, 2 = corrupt
+            std::unique_ptr<std::atomic<uint8_t>[]> verified;
+            FrameCache cache;
+            Readahead ra;
+            // Running ROI pixel counts, ray_cdf[i + 1] - ray_cdf[i] for frame i, built by the first sample_rays
+            std::vector<uint64_t> ray_cdf;
+            std::once_flag ray_cdf_once;
+            // AccessCounters for pack_stats; counted even through const paths
+            mutable std::atomic<uint64_t> views{0};
+            mutable std::atomic<uint64_t> acquires{0};
+            mutable std::atomic<uint64_t> cache_hits{0};
+            mutable std::atomic<uint64_t> cache_misses{0};
+            mutable std::atomic<uint64_t> reader_loads{0};
+            mutable std::atomic<uint64_t> reader_bytes{0};
+            mutable std::atomic<uint64_t> prefetches{0};
+            mutable std::atomic<uint64_t> evictions{0};
         };
 
         std::atomic<int32_t> g_last_error{0};
 
+        constexpr uint64_t kDefaultMemoryBudget = 1ull << 30;
+
         inline size_t rup(size_t x, size_t a)
         {
             return (x + (a - 1)) & ~(a - 1);
@@ -91,6 +386,18 @@ namespace dataset
             g_last_error.store((int32_t)e, std::memory_order_relaxed);
         }
 
+        const SectRec* find_sect(const PackHandleImpl* h, uint32_t kind)
+        {
+            const Hdr& hd = h->hdr;
+            if (!hd.sect_count || hd.sects_off + sizeof(SectRec) * hd.sect_count > h->map.bytes) return nullptr;
+            const SectRec* dir = (const SectRec*)(h->base + hd.sects_off);
+            for (uint32_t k = 0; k < hd.sect_count; k++)
+            {
+                if (dir[k].kind == kind && dir[k].off + dir[k].bytes <= h->map.bytes) return &dir[k];
+            }
+            return nullptr;
+        }
+
         struct PngImg
         {
             int w;
@@ -98,424 +405,4591 @@ namespace dataset
             std::vector<unsigned char> rgba;
         };
 
-        PngImg decode_png_rgba8(const std::string& path)
+        struct PngSrc
         {
-            PngImg out{0, 0, {}};
-            auto m = dataset::detail::mmap_file_ro(path);
-            if (!m.ptr)
+            detail::mmap_ro map;
+            spng_ctx* ctx;
+            spng_ihdr ih;
+        };
+
+        bool png_open(const std::string& path, PngSrc& s)
+        {
+            s.ctx = nullptr;
+            s.map = detail::mmap_file_ro(path);
+            if (!s.map.ptr)
             {
                 set_error(Error::IoFail);
-                return out;
+                return false;
             }
-            spng_ctx* ctx = spng_ctx_new(0);
-            spng_set_png_buffer(ctx, m.ptr, m.bytes);
-            spng_ihdr ih;
-            if (spng_get_ihdr(ctx, &ih))
+            s.ctx = spng_ctx_new(0);
+            spng_set_png_buffer(s.ctx, s.map.ptr, s.map.bytes);
+            if (spng_get_ihdr(s.ctx, &s.ih))
             {
-                spng_ctx_free(ctx);
-                dataset::detail::munmap_file(m);
+                spng_ctx_free(s.ctx);
+                s.ctx = nullptr;
+                detail::munmap_file(s.map);
                 set_error(Error::BadConfig);
-                return out;
+                return false;
             }
+            return true;
+        }
+
+        void png_close(PngSrc& s)
+        {
+            if (s.ctx) spng_ctx_free(s.ctx);
+            s.ctx = nullptr;
+            detail::munmap_file(s.map);
+        }
+
+        bool probe_png(const std::string& path, uint32_t& w, uint32_t& h)
+        {
+            PngSrc s;
+            if (!png_open(path, s)) return false;
+            w = s.ih.width;
+            h = s.ih.height;
+            png_close(s);
+            return true;
+        }
+
+        // crc is the CRC-32 of the whole file, taken from the mapping the decoder reads
+        template <class Reserve>
+        PngImg decode_png_rgba8(const std::string& path, uint32_t& crc, Reserve&& reserve)
+        {
+            PngImg out{0, 0, {}};
+            PngSrc s;
+            if (!png_open(path, s)) return out;
+            crc = libdeflate_crc32(0, s.map.ptr, s.map.bytes);
             size_t n = 0;
-            spng_decoded_image_size(ctx, SPNG_FMT_RGBA8, &n);
-            out.w = (int)ih.width;
-            out.h = (int)ih.height;
+            spng_decoded_image_size(s.ctx, SPNG_FMT_RGBA8, &n);
+            // The caller may block here until enough of the memory budget is free
+            if (!reserve(s.ih.width, s.ih.height))
+            {
+                png_close(s);
+                return out;
+            }
+            out.w = (int)s.ih.width;
+            out.h = (int)s.ih.height;
             out.rgba.resize(n);
-            if (spng_decode_image(ctx, out.rgba.data(), n, SPNG_FMT_RGBA8, 0))
+            if (spng_decode_image(s.ctx, out.rgba.data(), n, SPNG_FMT_RGBA8, 0))
             {
                 out.w = 0;
                 out.h = 0;
                 out.rgba.clear();
                 set_error(Error::BadConfig);
             }
-            spng_ctx_free(ctx);
-            dataset::detail::munmap_file(m);
+            png_close(s);
             return out;
         }
 
-        void srgb_lut(float lut[256])
+        // How decoded RGBA8 rows turn into the pack's pixel format
+        struct PixelEncode
         {
-            for (int i = 0; i < 256; i++)
-            {
-                float c = float(i) / 255.0f;
-                lut[i] = c <= 0.04045f ? c / 12.92f : std::pow((c + 0.055f) / 1.055f, 2.4f);
-            }
-        }
+            PixelFormat pf;
+            uint32_t pixel_stride;
+            bool premultiply;
+            float bg[3];
+            uint32_t bg8[3];
+        };
 
-        int write_exact(std::ofstream& fo, const void* p, size_t n)
+        bool has_alpha(PixelFormat pf)
         {
-            fo.write((const char*)p, (std::streamsize)n);
-            return fo ? 0 : -1;
+            return pf == PixelFormat::RGBA8 || pf == PixelFormat::RGBA32F || pf == PixelFormat::RGBA16F;
         }
 
-        struct NSItem
+        PixelEncode make_encode(const BuildConfig& cfg)
         {
-            std::string path;
-            float T[12];
-        };
+            PixelEncode e{};
+            e.pf = cfg.pixel_format;
+            e.pixel_stride = pixel_format_bytes(cfg.pixel_format);
+            e.premultiply = cfg.premultiply_alpha && has_alpha(cfg.pixel_format);
+            for (int c = 0; c < 3; c++)
+            {
+                float b = cfg.background[c] < 0.0f ? 0.0f : cfg.background[c] > 1.0f ? 1.0f : cfg.background[c];
+                e.bg[c] = b;
+                e.bg8[c] = (uint32_t)(b * 255.0f + 0.5f);
+            }
+            return e;
+        }
 
-        struct NSMeta
+        // RGBA8 rows are stored as decoded unless alpha is premultiplied
+        bool raw_rgba8(const PixelEncode& e)
         {
-            int w;
-            int h;
-            float fx;
-            float fy;
-            float cx;
-            float cy;
-            std::vector<NSItem> items;
-        };
+            return e.pf == PixelFormat::RGBA8 && !e.premultiply;
+        }
 
-        bool load_nerf_synthetic(const std::string& root, const std::string& cfg, NSMeta& out)
+        void convert_row(const unsigned char* s, int w, const PixelEncode& e, unsigned char* d, uint32_t row_stride)
         {
-            fs::path p(cfg);
-            if (!fs::exists(p))
+            size_t n = (size_t)w;
+            size_t used = n * e.pixel_stride;
+            const auto& k = detail::convert_kernels();
+            if (e.pf == PixelFormat::RGBA8)
             {
-                fs::path a = fs::path(root) / "transforms.json";
-                fs::path b = fs::path(root) / "transforms_train.json";
-                if (fs::exists(a))
+                if (!e.premultiply)
                 {
-                    p = a;
+                    if (d != s) std::memcpy(d, s, used);
                 }
-                else if (fs::exists(b))
+                else
                 {
-                    p = b;
+                    for (size_t x = 0; x < n; x++)
+                    {
+                        uint32_t a = s[x * 4 + 3];
+                        for (int c = 0; c < 3; c++) d[x * 4 + c] = (unsigned char)((s[x * 4 + c] * a + 127) / 255);
+                        d[x * 4 + 3] = (unsigned char)a;
+                    }
                 }
-                else
+            }
+            else if (e.pf == PixelFormat::RGB8)
+            {
+                // Composited in the stored sRGB encoding, as NeRF loaders blend 8-bit backgrounds
+                for (size_t x = 0; x < n; x++)
                 {
-                    set_error(Error::BadConfig);
-                    return false;
+                    uint32_t a = s[x * 4 + 3];
+                    for (int c = 0; c < 3; c++) d[x * 3 + c] = (unsigned char)((s[x * 4 + c] * a + e.bg8[c] * (255 - a) + 127) / 255);
                 }
             }
-            std::ifstream fi(p, std::ios::binary);
-            if (!fi)
+            else if (e.pf == PixelFormat::RGBA32F && !e.premultiply)
             {
-                set_error(Error::IoFail);
-                return false;
+                k.rgba8_to_f32(s, (float*)d, n, detail::srgb_to_linear_table());
             }
-            std::string s((std::istreambuf_iterator<char>(fi)), std::istreambuf_iterator<char>());
-            // Use DOM parser here for robustness
-            simdjson::dom::parser dparser;
-            simdjson::dom::element ddoc = dparser.parse(s);
-            out = NSMeta{};
-            auto arr = ddoc["frames"].get_array();
-            for (auto v : arr)
-            {
-                auto fo = v.get_object();
-                NSItem it;
-                std::string rel = std::string(fo["file_path"].get_string().value());
-                fs::path full = fs::path(root) / rel;
-                if (full.extension().empty()) full.replace_extension(".png");
-                it.path = full.string();
-                // transform_matrix is a 4x4 nested array
-                auto tm_rows = fo["transform_matrix"].get_array();
-                int r = 0;
-                for (auto row : tm_rows)
-                {
-                    int c = 0;
-                    for (auto x : row.get_array())
-                    {
-                        double d = x.get_double();
-                        if (r < 3 && c < 4) it.T[r * 4 + c] = float(d);
-                        c++;
+            else
+            {
+                thread_local std::vector<float> f;
+                f.resize(n * 4);
+                float* v = f.data();
+                k.rgba8_to_f32(s, v, n, detail::srgb_to_linear_table());
+                size_t ch = 4;
+                if (e.premultiply)
+                {
+                    for (size_t x = 0; x < n; x++)
+                    {
+                        float a = v[x * 4 + 3];
+                        v[x * 4 + 0] *= a;
+                        v[x * 4 + 1] *= a;
+                        v[x * 4 + 2] *= a;
+                    }
+                }
+                else if (!has_alpha(e.pf))
+                {
+                    // Linear-light composite, packed to RGB in place
+                    ch = 3;
+                    for (size_t x = 0; x < n; x++)
+                    {
+                        float a = v[x * 4 + 3];
+                        float r = v[x * 4 + 0] * a + e.bg[0] * (1.0f - a);
+                        float g = v[x * 4 + 1] * a + e.bg[1] * (1.0f - a);
+                        float b = v[x * 4 + 2] * a + e.bg[2] * (1.0f - a);
+                        v[x * 3 + 0] = r;
+                        v[x * 3 + 1] = g;
+                        v[x * 3 + 2] = b;
                     }
-                    r++;
                 }
-                out.items.push_back(std::move(it));
+                if (e.pf == PixelFormat::RGBA32F)
+                {
+                    std::memcpy(d, v, n * 16);
+                }
+                else
+                {
+                    k.f32_to_f16(v, (uint16_t*)d, n * ch);
+                }
             }
-            
-            return true;
+            std::memset(d + used, 0, row_stride - used);
         }
-    }
 
-    Error last_error()
-    {
-        return (Error)g_last_error.load(std::memory_order_relaxed);
-    }
-
-    int build_hostpack(const BuildConfig& cfg, const std::string& out_path)
-    {
-        g_last_error.store(0, std::memory_order_relaxed);
-        NSMeta meta;
-        if (!load_nerf_synthetic(cfg.dataset_root, cfg.config_path, meta)) return -1;
-        size_t N = meta.items.size();
-        if (!N)
+        // Converts rows [y0, y1) of decoded RGBA8 at src, a band at a time
+        void convert_rows(const unsigned char* src, int w, size_t y0, size_t y1, const PixelEncode& e, uint32_t row_stride, unsigned char* dst)
         {
-            set_error(Error::BadConfig);
-            return -1;
-        }
-        std::vector<PngImg> imgs(N);
-        std::atomic<size_t> next{0};
-        uint32_t th = cfg.threads ? cfg.threads : std::thread::hardware_concurrency();
-        if (!th) th = 1;
-        std::vector<std::thread> threads;
-        threads.reserve(th);
-        for (uint32_t t = 0; t < th; t++)
-        {
-            threads.emplace_back([&]
+            size_t rb = (size_t)w * 4;
+            detail::for_bands(y1 - y0, row_stride, [&](size_t b0, size_t b1)
             {
-                for (;;)
+                for (size_t y = y0 + b0; y < y0 + b1; y++)
                 {
-                    size_t i = next.fetch_add(1, std::memory_order_relaxed);
-                    if (i >= N) break;
-                    imgs[i] = decode_png_rgba8(meta.items[i].path);
+                    convert_row(src + (y - y0) * rb, w, e, dst + y * row_stride, row_stride);
                 }
             });
         }
-        for (auto& thd : threads) thd.join();
-        for (size_t i = 0; i < N; i++)
+
+        void convert_frame(const PngImg& img, const PixelEncode& e, uint32_t row_stride, unsigned char* dst)
+        {
+            convert_rows(img.rgba.data(), img.w, 0, (size_t)img.h, e, row_stride, dst);
+        }
+
+        // Decodes straight into the frame's final location; rows are converted and padded in place so no
+        // whole-image intermediate is needed except for interlaced sources.
+        bool decode_png_into(const std::string& path, const FrameRec& fr, const PixelEncode& e, unsigned char* dst, uint32_t& crc)
         {
-            if (!imgs[i].w)
+            PngSrc s;
+            if (!png_open(path, s)) return false;
+            crc = libdeflate_crc32(0, s.map.ptr, s.map.bytes);
+            if (s.ih.width != fr.width || s.ih.height != fr.height)
             {
-                set_error(Error::IoFail);
-                return -1;
+                png_close(s);
+                set_error(Error::BadConfig);
+                return false;
+            }
+            int w = (int)fr.width;
+            int h = (int)fr.height;
+            size_t rb = (size_t)w * 4;
+            bool ok = true;
+            if (raw_rgba8(e) && fr.row_stride == rb)
+            {
+                ok = !spng_decode_image(s.ctx, dst, rb * h, SPNG_FMT_RGBA8, 0);
             }
+            else if (s.ih.interlace_method)
+            {
+                std::vector<unsigned char> rgba(rb * h);
+                ok = !spng_decode_image(s.ctx, rgba.data(), rgba.size(), SPNG_FMT_RGBA8, 0);
+                if (ok) convert_rows(rgba.data(), w, 0, (size_t)h, e, fr.row_stride, dst);
+            }
+            else
+            {
+                // Decoding is serial, so rows come out in chunks of a few bands that are converted in
+                // parallel. Only RGBA8 rows are as wide as the decoded row and can be converted in place.
+                size_t chunk = std::max<size_t>(1, 16 * detail::kBandBytes / rb);
+                bool in_place = e.pf == PixelFormat::RGBA8;
+                std::vector<unsigned char> scratch(in_place ? 0 : rb * std::min(chunk, (size_t)h));
+                ok = !spng_decode_image(s.ctx, nullptr, 0, SPNG_FMT_RGBA8, SPNG_DECODE_PROGRESSIVE);
+                for (size_t y0 = 0; ok && y0 < (size_t)h; y0 += chunk)
+                {
+                    size_t y1 = std::min(y0 + chunk, (size_t)h);
+                    for (size_t y = y0; y < y1; y++)
+                    {
+                        unsigned char* r = in_place ? dst + y * fr.row_stride : scratch.data() + (y - y0) * rb;
+                        int rc = spng_decode_row(s.ctx, r, rb);
+                        if (rc && rc != SPNG_EOI)
+                        {
+                            ok = false;
+                            break;
+                        }
+                    }
+                    if (!ok) break;
+                    if (in_place)
+                    {
+                        detail::for_bands(y1 - y0, fr.row_stride, [&](size_t b0, size_t b1)
+                        {
+                            for (size_t y = y0 + b0; y < y0 + b1; y++)
+                            {
+                                unsigned char* d = dst + y * fr.row_stride;
+                                convert_row(d, w, e, d, fr.row_stride);
+                            }
+                        });
+                    }
+                    else
+                    {
+                        convert_rows(scratch.data(), w, y0, y1, e, fr.row_stride, dst);
+                    }
+                }
+            }
+            png_close(s);
+            if (!ok) set_error(Error::BadConfig);
+            return ok;
         }
-        std::ofstream fo(out_path, std::ios::binary | std::ios::trunc);
-        if (!fo)
+
+        bool is_exr(const std::string& path)
         {
-            set_error(Error::IoFail);
-            return -1;
+            std::string x = fs::path(path).extension().string();
+            for (char& c : x) c = (char)std::tolower((unsigned char)c);
+            return x == ".exr";
         }
-        Hdr hdr{};
-        std::memcpy(hdr.magic, "HPK1", 4);
-        hdr.version = 2;
-        hdr.flags = 0;
-        hdr.pixel_format = (uint32_t)cfg.pixel_format;
-        hdr.color_space = (uint32_t)ColorSpace::Linear;
-        hdr.caps_bits = 0;
 
-        auto wr = [&](const void* p, size_t n)
+        bool probe_image(const std::string& path, uint32_t& w, uint32_t& h)
         {
-            return write_exact(fo, p, n);
-        };
+            if (!is_exr(path)) return probe_png(path, w, h);
+            detail::ExrSrc* s = detail::exr_open(path);
+            if (!s)
+            {
+                set_error(Error::BadConfig);
+                return false;
+            }
+            detail::exr_size(s, w, h);
+            detail::exr_close(s);
+            return true;
+        }
 
-        auto align_block = [&](size_t a)
+        // Stores a row of linear float RGBA with associated alpha, as EXR keeps it. The 8-bit background is
+        // given in sRGB, so it is linearized before compositing.
+        void convert_row_f32(float* v, int w, const PixelEncode& e, unsigned char* d, uint32_t row_stride)
         {
-            size_t cur = (size_t)fo.tellp();
-            size_t need = rup(cur, a) - cur;
-            if (need)
+            size_t n = (size_t)w;
+            if (has_alpha(e.pf) && !e.premultiply)
             {
-                static const char z[64] = {0};
-                while (need)
+                for (size_t x = 0; x < n; x++)
                 {
-                    size_t m = need > 64 ? 64 : need;
-                    wr(z, m);
-                    need -= m;
-                }
-            }
-        };
-        // Reserve space for header at the beginning
-        fo.seekp(sizeof(Hdr), std::ios::beg);
-        align_block(cfg.block_align);
-        hdr.scene_off = (uint64_t)fo.tellp();
-        SceneRec scene{};
-        scene.aabb_min[0] = scene.aabb_min[1] = scene.aabb_min[2] = -1;
-        scene.aabb_max[0] = scene.aabb_max[1] = scene.aabb_max[2] = 1;
-        wr(&scene, sizeof(scene));
-
-        align_block(cfg.block_align);
-        hdr.cam_off = (uint64_t)fo.tellp();
-        CamSOA cam{};
-        cam.count = (uint32_t)N;
-        size_t fx_off = hdr.cam_off + sizeof(CamSOA);
-        size_t fy_off = fx_off + sizeof(float) * N;
-        size_t cx_off = fy_off + sizeof(float) * N;
-        size_t cy_off = cx_off + sizeof(float) * N;
-        size_t T_off = cy_off + sizeof(float) * N;
-        size_t w_off = T_off + sizeof(float) * 12 * N;
-        size_t h_off = w_off + sizeof(uint32_t) * N;
-        size_t time_off = h_off + sizeof(uint32_t) * N;
-        cam.fx_off = fx_off;
-        cam.fy_off = fy_off;
-        cam.cx_off = cx_off;
-        cam.cy_off = cy_off;
-        cam.T_off = T_off;
-        cam.w_off = w_off;
-        cam.h_off = h_off;
-        cam.time_off = time_off;
-        wr(&cam, sizeof(cam));
-
-        std::vector<float> fx(N), fy(N), cx(N), cy(N), T(12 * N);
-        std::vector<uint32_t> ww(N), hh(N), tt(N);
-        for (size_t i = 0; i < N; i++)
-        {
-            fx[i] = meta.fx;
-            fy[i] = meta.fy;
-            cx[i] = meta.cx;
-            cy[i] = meta.cy;
-            ww[i] = (uint32_t)imgs[i].w;
-            hh[i] = (uint32_t)imgs[i].h;
-            tt[i] = (uint32_t)i;
-            for (int j = 0; j < 12; j++)
+                    float a = v[x * 4 + 3];
+                    float inv = a > 0.0f ? 1.0f / a : 0.0f;
+                    v[x * 4 + 0] *= inv;
+                    v[x * 4 + 1] *= inv;
+                    v[x * 4 + 2] *= inv;
+                }
+            }
+            else if (!has_alpha(e.pf))
             {
-                T[i * 12 + j] = meta.items[i].T[j];
+                float bg[3];
+                for (int c = 0; c < 3; c++) bg[c] = e.pf == PixelFormat::RGB8 ? detail::srgb_to_linear_table()[e.bg8[c] * 4 + c] : e.bg[c];
+                for (size_t x = 0; x < n; x++)
+                {
+                    float a = v[x * 4 + 3];
+                    for (int c = 0; c < 3; c++) v[x * 4 + c] += bg[c] * (1.0f - a);
+                }
             }
-        }
-        wr(fx.data(), sizeof(float) * N);
-        wr(fy.data(), sizeof(float) * N);
-        wr(cx.data(), sizeof(float) * N);
-        wr(cy.data(), sizeof(float) * N);
-        wr(T.data(), sizeof(float) * 12 * N);
-        wr(ww.data(), sizeof(uint32_t) * N);
-        wr(hh.data(), sizeof(uint32_t) * N);
-        wr(tt.data(), sizeof(uint32_t) * N);
-
-        align_block(cfg.block_align);
-        hdr.frames_off = (uint64_t)fo.tellp();
-        std::vector<FrameRec> frs(N);
-        wr(frs.data(), sizeof(FrameRec) * N);
-
-        align_block(cfg.block_align);
-        hdr.pixels_off = (uint64_t)fo.tellp();
-
-        float lutf[256];
-        if (cfg.pixel_format == PixelFormat::RGBA32F)
-        {
-            srgb_lut(lutf);
+            detail::encode_row_f32(v, e.pf, n, d);
+            size_t used = n * e.pixel_stride;
+            std::memset(d + used, 0, row_stride - used);
         }
 
-        std::vector<unsigned char> row;
-        for (size_t i = 0; i < N; i++)
+        // EXR frames skip the RGBA8 stage. Float formats that keep the file's values as they are (no alpha to
+        // undo or composite) are read straight into the frame; the rest go through float rows a chunk at a
+        // time, converted in bands.
+        bool decode_exr_into(detail::ExrSrc* s, const FrameRec& fr, const PixelEncode& e, unsigned char* dst)
         {
-            int w = imgs[i].w;
-            int h = imgs[i].h;
-            uint32_t pixel_stride = cfg.pixel_format == PixelFormat::RGBA8 ? 4u : 16u;
-            uint32_t row_stride = (uint32_t)rup((size_t)w * pixel_stride, cfg.row_align);
-            frs[i].camera_id = (uint32_t)i;
-            frs[i].mip_levels = 1;
-            frs[i].pixel_off = (uint64_t)fo.tellp();
-            frs[i].width = (uint32_t)w;
-            frs[i].height = (uint32_t)h;
-            frs[i].row_stride = row_stride;
-            frs[i].pixel_stride = pixel_stride;
-            frs[i].roi_x = 0;
-            frs[i].roi_y = 0;
-            frs[i].roi_w = (uint32_t)w;
-            frs[i].roi_h = (uint32_t)h;
-            row.resize(row_stride);
-            if (cfg.pixel_format == PixelFormat::RGBA8)
-            {
-                const unsigned char* src = imgs[i].rgba.data();
-                for (int y = 0; y < h; y++)
-                {
-                    std::memcpy(row.data(), src + (size_t)y * w * 4, (size_t)w * 4);
-                    wr(row.data(), row_stride);
+            uint32_t w = 0;
+            uint32_t h = 0;
+            detail::exr_size(s, w, h);
+            if (w != fr.width || h != fr.height)
+            {
+                set_error(Error::BadConfig);
+                return false;
+            }
+            bool half = e.pf == PixelFormat::RGBA16F || e.pf == PixelFormat::RGB16F;
+            bool direct = (half || e.pf == PixelFormat::RGBA32F) && (!detail::exr_has_alpha(s) || e.premultiply);
+            size_t used = (size_t)w * e.pixel_stride;
+            bool ok = true;
+            if (direct)
+            {
+                ok = detail::exr_read(s, 0, h, half, has_alpha(e.pf) ? 4 : 3, e.pixel_stride, fr.row_stride, dst);
+                if (ok && fr.row_stride > used)
+                {
+                    detail::for_bands(h, fr.row_stride, [&](size_t y0, size_t y1)
+                    {
+                        for (size_t y = y0; y < y1; y++) std::memset(dst + y * fr.row_stride + used, 0, fr.row_stride - used);
+                    });
                 }
             }
             else
             {
-                const unsigned char* src = imgs[i].rgba.data();
-                float* dstf = (float*)row.data();
-                for (int y = 0; y < h; y++)
-                {
-                    const unsigned char* s = src + (size_t)y * w * 4;
-                    for (int x = 0; x < w; x++)
-                    {
-                        unsigned char r = s[x * 4 + 0];
-                        unsigned char g = s[x * 4 + 1];
-                        unsigned char b = s[x * 4 + 2];
-                        unsigned char a = s[x * 4 + 3];
-                        dstf[x * 4 + 0] = lutf[r];
-                        dstf[x * 4 + 1] = lutf[g];
-                        dstf[x * 4 + 2] = lutf[b];
-                        dstf[x * 4 + 3] = float(a) / 255.0f;
-                    }
-                    wr(row.data(), row_stride);
+                size_t rb = (size_t)w * 16;
+                size_t chunk = std::min<size_t>(std::max<size_t>(1, 16 * detail::kBandBytes / rb), h);
+                std::vector<float> rows(chunk * w * 4);
+                for (size_t y0 = 0; ok && y0 < h; y0 += chunk)
+                {
+                    size_t y1 = std::min(y0 + chunk, (size_t)h);
+                    ok = detail::exr_read(s, (uint32_t)y0, (uint32_t)y1, false, 4, 16, rb, rows.data());
+                    if (!ok) break;
+                    detail::for_bands(y1 - y0, fr.row_stride, [&](size_t b0, size_t b1)
+                    {
+                        for (size_t y = y0 + b0; y < y0 + b1; y++)
+                        {
+                            convert_row_f32(rows.data() + (y - y0) * w * 4, (int)w, e, dst + y * fr.row_stride, fr.row_stride);
+                        }
+                    });
                 }
             }
-            align_block(cfg.block_align);
+            if (!ok) set_error(Error::BadConfig);
+            return ok;
         }
 
-        size_t cur = (size_t)fo.tellp();
-        fo.seekp(hdr.frames_off, std::ios::beg);
-        wr(frs.data(), sizeof(FrameRec) * N);
-        fo.seekp(cur, std::ios::beg);
-        hdr.end_off = (uint64_t)cur;
-        hdr.bytes_total = hdr.end_off;
-        fo.seekp(0, std::ios::beg);
-        wr(&hdr, sizeof(Hdr));
-        fo.flush();
-        if (!fo)
+        uint32_t exr_crc(const detail::ExrSrc* s)
         {
-            set_error(Error::IoFail);
-            return -1;
+            size_t n = 0;
+            const void* p = detail::exr_bytes(s, n);
+            return libdeflate_crc32(0, p, n);
         }
-        return 0;
-    }
 
-    PackHandle open_hostpack(const std::string& hostpack_path)
-    {
-        g_last_error.store(0, std::memory_order_relaxed);
-        auto* h = new PackHandleImpl();
-        h->map = detail::mmap_file_ro(hostpack_path);
-        if (!h->map.ptr)
+        // Decodes a PNG or EXR source straight into the frame's final location, with the CRC-32 of the file
+        bool decode_image_into(const std::string& path, const FrameRec& fr, const PixelEncode& e, unsigned char* dst, uint32_t& crc)
         {
-            delete h;
-            set_error(Error::IoFail);
-            return nullptr;
+            if (!is_exr(path)) return decode_png_into(path, fr, e, dst, crc);
+            detail::ExrSrc* s = detail::exr_open(path);
+            if (!s)
+            {
+                set_error(Error::BadConfig);
+                return false;
+            }
+            crc = exr_crc(s);
+            bool ok = decode_exr_into(s, fr, e, dst);
+            detail::exr_close(s);
+            return ok;
         }
-        h->base = (const char*)h->map.ptr;
-        std::memcpy(&h->hdr, h->base, sizeof(Hdr));
-        if (std::memcmp(h->hdr.magic, "HPK1", 4) != 0)
+
+        int write_exact(std::ostream& fo, const void* p, size_t n)
+        {
+            fo.write((const char*)p, (std::streamsize)n);
+            return fo ? 0 : -1;
+        }
+
+        // Identity of a source file as recorded in the manifest
+        struct SrcPrint
+        {
+            uint64_t size;
+            int64_t mtime_ns;
+            uint32_t crc32;
+        };
+
+        // Pinhole intrinsics in pixels of a w x h image, rescaled when the decoded image differs. fx 0 leaves
+        // them to the field of view, cx or cy below 0 puts the principal point at the centre and w or h 0
+        // means the decoded size.
+        struct Intrinsics
+        {
+            float fx;
+            float fy;
+            float cx;
+            float cy;
+            uint32_t w;
+            uint32_t h;
+        };
+
+        constexpr Intrinsics kNoIntrinsics{0, 0, -1, -1, 0, 0};
+
+        struct NSItem
+        {
+            std::string path;
+            float T[12];
+            Intrinsics k;
+            SrcPrint print;
+        };
+
+        struct NSMeta
+        {
+            // Manifest-wide intrinsics, for frames that do not carry their own
+            Intrinsics k;
+            // Field of view in radians, 0 when absent; intrinsics follow from it once image sizes are known
+            float angle_x;
+            float angle_y;
+            std::vector<NSItem> items;
+            uint64_t source_bytes; // manifest files read
+        };
+
+        // Fills what a frame's own intrinsics leave unset from the manifest-wide ones
+        void merge_intrinsics(Intrinsics& k, const Intrinsics& top)
+        {
+            if (k.fx <= 0) k.fx = top.fx;
+            if (k.fy <= 0) k.fy = top.fy;
+            if (k.cx < 0) k.cx = top.cx;
+            if (k.cy < 0) k.cy = top.cy;
+            if (!k.w) k.w = top.w;
+            if (!k.h) k.h = top.h;
+        }
+
+        // instant-ngp intrinsics keys, at the top level or per frame. Returns false for any other key.
+        bool read_intrinsic(std::string_view key, simdjson::ondemand::value v, Intrinsics& k, bool& ok)
+        {
+            float* f = key == "fl_x" ? &k.fx : key == "fl_y" ? &k.fy : key == "cx" ? &k.cx : key == "cy" ? &k.cy : nullptr;
+            uint32_t* n = key == "w" ? &k.w : key == "h" ? &k.h : nullptr;
+            if (!f && !n) return false;
+            double d = 0;
+            ok = v.get_double().get(d) == simdjson::SUCCESS;
+            if (f) *f = (float)d;
+            else *n = d > 0 && d < 4294967296.0 ? (uint32_t)d : 0;
+            return true;
+        }
+
+        bool read_pose(simdjson::ondemand::value v, float T[12])
+        {
+            // transform_matrix is a 4x4 nested array, camera to world
+            simdjson::ondemand::array rows;
+            if (v.get_array().get(rows)) return false;
+            int r = 0;
+            for (auto row : rows)
+            {
+                simdjson::ondemand::array cols;
+                if (row.get_array().get(cols)) return false;
+                int c = 0;
+                for (auto x : cols)
+                {
+                    double d = 0;
+                    if (x.get_double().get(d)) return false;
+                    if (r < 3 && c < 4) T[r * 4 + c] = float(d);
+                    c++;
+                }
+                r++;
+            }
+            return r >= 3;
+        }
+
+        // NeRF synthetic and instant-ngp transforms, read in one on-demand pass; rel gets each frame's
+        // file_path as written
+        bool parse_transforms(const fs::path& p, NSMeta& out, std::vector<std::string>& rel)
+        {
+            simdjson::padded_string json;
+            if (simdjson::padded_string::load(p.string()).get(json))
+            {
+                set_error(Error::IoFail);
+                return false;
+            }
+            simdjson::ondemand::parser parser;
+            simdjson::ondemand::document doc;
+            simdjson::ondemand::object top;
+            if (parser.iterate(json).get(doc) || doc.get_object().get(top))
+            {
+                set_error(Error::BadConfig);
+                return false;
+            }
+            bool ok = true;
+            out = NSMeta{};
+            out.k = kNoIntrinsics;
+            out.source_bytes = json.size();
+            bool has_frames = false;
+            for (auto fv : top)
+            {
+                simdjson::ondemand::field f;
+                std::string_view key;
+                if (std::move(fv).get(f) || f.unescaped_key().get(key))
+                {
+                    ok = false;
+                    break;
+                }
+                double d = 0;
+                if (key == "camera_angle_x" || key == "camera_angle_y")
+                {
+                    ok = !f.value().get_double().get(d);
+                    (key == "camera_angle_x" ? out.angle_x : out.angle_y) = float(d);
+                }
+                else if (key == "frames")
+                {
+                    simdjson::ondemand::array arr;
+                    size_t n = 0;
+                    if (f.value().get_array().get(arr) || arr.count_elements().get(n))
+                    {
+                        ok = false;
+                        break;
+                    }
+                    out.items.reserve(n);
+                    rel.reserve(n);
+                    for (auto e : arr)
+                    {
+                        simdjson::ondemand::object fo;
+                        if (e.get_object().get(fo))
+                        {
+                            ok = false;
+                            break;
+                        }
+                        NSItem& it = out.items.emplace_back();
+                        it.k = kNoIntrinsics;
+                        bool has_path = false;
+                        bool has_pose = false;
+                        for (auto iv : fo)
+                        {
+                            simdjson::ondemand::field g;
+                            std::string_view k;
+                            if (std::move(iv).get(g) || g.unescaped_key().get(k))
+                            {
+                                ok = false;
+                                break;
+                            }
+                            std::string_view path;
+                            if (k == "file_path")
+                            {
+                                ok = !has_path && !g.value().get_string().get(path);
+                                rel.emplace_back(path);
+                                has_path = true;
+                            }
+                            else if (k == "transform_matrix")
+                            {
+                                ok = read_pose(g.value(), it.T);
+                                has_pose = true;
+                            }
+                            else
+                            {
+                                read_intrinsic(k, g.value(), it.k, ok);
+                            }
+                            if (!ok) break;
+                        }
+                        ok = ok && has_path && has_pose;
+                        if (!ok) break;
+                    }
+                    has_frames = true;
+                }
+                else
+                {
+                    read_intrinsic(key, f.value(), out.k, ok);
+                }
+                if (!ok) break;
+            }
+            if (!ok || !has_frames || rel.size() != out.items.size())
+            {
+                set_error(Error::BadConfig);
+                return false;
+            }
+            for (auto& it : out.items) merge_intrinsics(it.k, out.k);
+            return true;
+        }
+
+        struct BinReader
+        {
+            const unsigned char* p;
+            const unsigned char* end;
+            bool ok;
+
+            template <class T>
+            T get()
+            {
+                T v{};
+                if ((size_t)(end - p) < sizeof(T))
+                {
+                    ok = false;
+                    return v;
+                }
+                std::memcpy(&v, p, sizeof(T));
+                p += sizeof(T);
+                return v;
+            }
+        };
+
+        // COLMAP sparse model (cameras.bin, images.bin) in dir, images named relative to root/images. World to
+        // camera poses in the OpenCV convention become camera to world in the NeRF one; frames are ordered
+        // by image name. Lens distortion parameters are ignored.
+        bool parse_colmap(const fs::path& dir, NSMeta& out, std::vector<std::string>& rel)
+        {
+            detail::mmap_ro cm = detail::mmap_file_ro((dir / "cameras.bin").string());
+            detail::mmap_ro im = detail::mmap_file_ro((dir / "images.bin").string());
+            if (!cm.ptr || !im.ptr)
+            {
+                detail::munmap_file(cm);
+                detail::munmap_file(im);
+                set_error(Error::IoFail);
+                return false;
+            }
+            // Parameter counts by model id; models up to RADIAL and the radial fisheyes have one focal length
+            static const uint32_t kParams[] = {3, 4, 4, 5, 8, 8, 12, 5, 4, 5, 12};
+            auto single_focal = [](int32_t m) { return m == 0 || m == 2 || m == 3 || m == 8 || m == 9; };
+            std::unordered_map<int32_t, Intrinsics> cams;
+            BinReader c{(const unsigned char*)cm.ptr, (const unsigned char*)cm.ptr + cm.bytes, true};
+            uint64_t nc = c.get<uint64_t>();
+            for (uint64_t j = 0; j < nc && c.ok; j++)
+            {
+                int32_t id = c.get<int32_t>();
+                int32_t model = c.get<int32_t>();
+                uint64_t w = c.get<uint64_t>();
+                uint64_t h = c.get<uint64_t>();
+                if (model < 0 || model >= (int32_t)std::size(kParams) || w > UINT32_MAX || h > UINT32_MAX)
+                {
+                    c.ok = false;
+                    break;
+                }
+                double prm[12];
+                for (uint32_t q = 0; q < kParams[model]; q++) prm[q] = c.get<double>();
+                bool one = single_focal(model);
+                cams[id] = Intrinsics{(float)prm[0], (float)(one ? prm[0] : prm[1]), (float)prm[one ? 1 : 2], (float)prm[one ? 2 : 3], (uint32_t)w, (uint32_t)h};
+            }
+            struct Img
+            {
+                std::string name;
+                float T[12];
+                Intrinsics k;
+            };
+            std::vector<Img> imgs;
+            BinReader r{(const unsigned char*)im.ptr, (const unsigned char*)im.ptr + im.bytes, c.ok};
+            uint64_t ni = r.get<uint64_t>();
+            imgs.reserve(ni < im.bytes / 64 ? ni : im.bytes / 64);
+            for (uint64_t j = 0; j < ni && r.ok; j++)
+            {
+                r.get<int32_t>();
+                double q[4];
+                double t[3];
+                for (double& v : q) v = r.get<double>();
+                for (double& v : t) v = r.get<double>();
+                auto cam = cams.find(r.get<int32_t>());
+                const unsigned char* z = r.p < r.end ? (const unsigned char*)std::memchr(r.p, 0, r.end - r.p) : nullptr;
+                if (!r.ok || cam == cams.end() || !z)
+                {
+                    r.ok = false;
+                    break;
+                }
+                Img& m = imgs.emplace_back();
+                m.name.assign((const char*)r.p, z - r.p);
+                m.k = cam->second;
+                r.p = z + 1;
+                uint64_t pts = r.get<uint64_t>();
+                if (pts > (uint64_t)(r.end - r.p) / 24)
+                {
+                    r.ok = false;
+                    break;
+                }
+                r.p += pts * 24;
+                double n = std::sqrt(q[0] * q[0] + q[1] * q[1] + q[2] * q[2] + q[3] * q[3]);
+                if (!(n > 0))
+                {
+                    r.ok = false;
+                    break;
+                }
+                double w = q[0] / n, x = q[1] / n, y = q[2] / n, zq = q[3] / n;
+                double R[3][3] = {
+                    {1 - 2 * (y * y + zq * zq), 2 * (x * y - w * zq), 2 * (x * zq + w * y)},
+                    {2 * (x * y + w * zq), 1 - 2 * (x * x + zq * zq), 2 * (y * zq - w * x)},
+                    {2 * (x * zq - w * y), 2 * (y * zq + w * x), 1 - 2 * (x * x + y * y)}};
+                // Camera to world is R^T with centre -R^T t; NeRF cameras look down -z with +y up, so the
+                // y and z axes flip
+                for (int row = 0; row < 3; row++)
+                {
+                    for (int col = 0; col < 3; col++) m.T[row * 4 + col] = (float)(R[col][row] * (col ? -1.0 : 1.0));
+                    m.T[row * 4 + 3] = (float)-(R[0][row] * t[0] + R[1][row] * t[1] + R[2][row] * t[2]);
+                }
+            }
+            detail::munmap_file(cm);
+            detail::munmap_file(im);
+            if (!r.ok || imgs.empty())
+            {
+                set_error(Error::BadConfig);
+                return false;
+            }
+            std::sort(imgs.begin(), imgs.end(), [](const Img& a, const Img& b) { return a.name < b.name; });
+            out = NSMeta{};
+            out.k = kNoIntrinsics;
+            out.source_bytes = cm.bytes + im.bytes;
+            out.items.resize(imgs.size());
+            rel.resize(imgs.size());
+            for (size_t j = 0; j < imgs.size(); j++)
+            {
+                std::memcpy(out.items[j].T, imgs[j].T, sizeof(imgs[j].T));
+                out.items[j].k = imgs[j].k;
+                rel[j] = "images/" + imgs[j].name;
+            }
+            return true;
+        }
+
+        // Joins every manifest path onto the dataset root; extensionless paths name a PNG, or an EXR when only
+        // that exists. The existence checks dominate for large manifests, so they run in parallel.
+        void resolve_paths(const std::string& root, const std::vector<std::string>& rel, std::vector<NSItem>& items, uint32_t threads)
+        {
+            fs::path base(root);
+            detail::parallel_for(items.size(), threads, [&](size_t i)
+            {
+                fs::path full = base / rel[i];
+                if (full.extension().empty())
+                {
+                    std::error_code ec;
+                    fs::path exr = fs::path(full).replace_extension(".exr");
+                    full.replace_extension(".png");
+                    if (!fs::exists(full, ec) && fs::exists(exr, ec)) full = exr;
+                }
+                items[i].path = full.string();
+            });
+        }
+
+        struct CamTables
+        {
+            std::vector<float> fx, fy, cx, cy, T;
+            std::vector<uint32_t> w, h, t;
+        };
+
+        uint32_t tile_shift_of(uint32_t tile_size)
+        {
+            uint32_t s = 0;
+            while ((1u << s) < tile_size) s++;
+            return s;
+        }
+
+        void init_header(const BuildConfig& cfg, Hdr& hdr)
+        {
+            hdr = Hdr{};
+            std::memcpy(hdr.magic, "HPK1", 4);
+            hdr.version = kHdrVersion;
+            hdr.flags = 0;
+            hdr.pixel_format = (uint32_t)cfg.pixel_format;
+            hdr.color_space = (uint32_t)ColorSpace::Linear;
+            hdr.caps_bits = 0;
+            if (cfg.premultiply_alpha && has_alpha(cfg.pixel_format)) hdr.caps_bits |= CapPremultipliedAlpha;
+            if (cfg.mip_levels > 1) hdr.caps_bits |= CapMips;
+            if (cfg.tile_size)
+            {
+                hdr.flags |= tile_shift_of(cfg.tile_size) & kFlagTileShiftMask;
+                hdr.caps_bits |= CapTiled;
+            }
+            if (cfg.ray_table) hdr.caps_bits |= CapRayTable;
+            if (cfg.compress_level) hdr.caps_bits |= CapDeflate;
+            if (cfg.crop_alpha) hdr.caps_bits |= CapCropped;
+            if (cfg.importance != ImportanceSource::None) hdr.caps_bits |= CapImportance;
+        }
+
+        // Camera and frame tables laid out from start; returns their block aligned end
+        uint64_t plan_tables(size_t N, uint64_t start, size_t block_align, Hdr& hdr, CamSOA& cam)
+        {
+            hdr.cam_off = start;
+            cam = CamSOA{};
+            cam.count = (uint32_t)N;
+            cam.fx_off = hdr.cam_off + sizeof(CamSOA);
+            cam.fy_off = cam.fx_off + sizeof(float) * N;
+            cam.cx_off = cam.fy_off + sizeof(float) * N;
+            cam.cy_off = cam.cx_off + sizeof(float) * N;
+            cam.T_off = cam.cy_off + sizeof(float) * N;
+            cam.w_off = cam.T_off + sizeof(float) * 12 * N;
+            cam.h_off = cam.w_off + sizeof(uint32_t) * N;
+            cam.time_off = cam.h_off + sizeof(uint32_t) * N;
+            hdr.frames_off = rup(cam.time_off + sizeof(uint32_t) * N, block_align);
+            return rup(hdr.frames_off + sizeof(FrameRec) * N, block_align);
+        }
+
+        // Section offsets ahead of the pixel data depend only on the frame count
+        void plan_sections(size_t N, size_t block_align, Hdr& hdr, CamSOA& cam)
+        {
+            hdr.scene_off = rup(sizeof(Hdr), block_align);
+            hdr.pixels_off = plan_tables(N, rup(hdr.scene_off + sizeof(SceneRec), block_align), block_align, hdr, cam);
+        }
+
+        SceneRec default_scene()
+        {
+            SceneRec scene{};
+            scene.aabb_min[0] = scene.aabb_min[1] = scene.aabb_min[2] = -1;
+            scene.aabb_max[0] = scene.aabb_max[1] = scene.aabb_max[2] = 1;
+            return scene;
+        }
+
+        void fill_camera_tables(const NSMeta& meta, CamTables& c)
+        {
+            size_t N = meta.items.size();
+            c.fx.resize(N);
+            c.fy.resize(N);
+            c.cx.resize(N);
+            c.cy.resize(N);
+            c.T.resize(12 * N);
+            c.w.resize(N);
+            c.h.resize(N);
+            c.t.resize(N);
+            for (size_t i = 0; i < N; i++)
+            {
+                c.fx[i] = 0;
+                c.fy[i] = 0;
+                c.cx[i] = 0;
+                c.cy[i] = 0;
+                c.t[i] = (uint32_t)i;
+                for (int j = 0; j < 12; j++)
+                {
+                    c.T[i * 12 + j] = meta.items[i].T[j];
+                }
+            }
+        }
+
+        // Pinhole intrinsics once decoded sizes are in c.w and c.h: a frame's own focal lengths scaled to the
+        // decoded image, else the field of view, where a missing camera_angle_y means square pixels
+        void fill_intrinsics(const NSMeta& meta, CamTables& c)
+        {
+            for (size_t i = 0; i < c.fx.size(); i++)
+            {
+                const Intrinsics& k = meta.items[i].k;
+                float w = (float)c.w[i];
+                float h = (float)c.h[i];
+                if (k.fx > 0)
+                {
+                    float sx = k.w ? w / (float)k.w : 1.0f;
+                    float sy = k.h ? h / (float)k.h : 1.0f;
+                    c.fx[i] = k.fx * sx;
+                    c.fy[i] = (k.fy > 0 ? k.fy : k.fx) * sy;
+                    c.cx[i] = k.cx >= 0 ? k.cx * sx : 0.5f * w;
+                    c.cy[i] = k.cy >= 0 ? k.cy * sy : 0.5f * h;
+                }
+                else if (meta.angle_x > 0)
+                {
+                    c.fx[i] = 0.5f * w / std::tan(0.5f * meta.angle_x);
+                    c.fy[i] = meta.angle_y > 0 ? 0.5f * h / std::tan(0.5f * meta.angle_y) : c.fx[i];
+                    c.cx[i] = 0.5f * w;
+                    c.cy[i] = 0.5f * h;
+                }
+            }
+        }
+
+        FrameRec make_frame_rec(size_t i, uint32_t w, uint32_t h, uint32_t pixel_stride, uint32_t row_align)
+        {
+            FrameRec fr{};
+            fr.camera_id = (uint32_t)i;
+            fr.mip_levels = 1;
+            fr.pixel_off = 0;
+            fr.width = w;
+            fr.height = h;
+            fr.row_stride = (uint32_t)rup((size_t)w * pixel_stride, row_align);
+            fr.pixel_stride = pixel_stride;
+            fr.roi_x = 0;
+            fr.roi_y = 0;
+            fr.roi_w = w;
+            fr.roi_h = h;
+            return fr;
+        }
+
+        // Lays out the frame's levels back to back, each starting on a row_align boundary; offsets are
+        // relative to the frame's pixel_off. Levels are of the stored ROI, and tiled ones are whole tiles with
+        // row_stride spanning one row of tiles. Returns the frame's block size.
+        size_t plan_levels(FrameRec& fr, uint32_t levels, uint32_t row_align, uint32_t tile, std::vector<MipRec>& lv)
+        {
+            uint32_t chain = detail::mip_chain_length(fr.roi_w, fr.roi_h);
+            uint32_t n = levels < 1 ? 1 : levels > chain ? chain : levels;
+            lv.resize(n);
+            size_t off = 0;
+            uint32_t w = fr.roi_w;
+            uint32_t h = fr.roi_h;
+            for (uint32_t l = 0; l < n; l++)
+            {
+                off = rup(off, row_align);
+                lv[l] = MipRec{};
+                lv[l].off = off;
+                lv[l].width = w;
+                lv[l].height = h;
+                if (tile)
+                {
+                    size_t tiles_x = (w + tile - 1) / tile;
+                    size_t tiles_y = (h + tile - 1) / tile;
+                    lv[l].row_stride = (uint32_t)(tiles_x * tile * tile * fr.pixel_stride);
+                    off += (size_t)lv[l].row_stride * tiles_y;
+                }
+                else
+                {
+                    lv[l].row_stride = l ? (uint32_t)rup((size_t)w * fr.pixel_stride, row_align) : fr.row_stride;
+                    off += (size_t)lv[l].row_stride * h;
+                }
+                w = w > 1 ? w >> 1 : 1;
+                h = h > 1 ? h >> 1 : 1;
+            }
+            fr.mip_levels = n;
+            fr.row_stride = lv[0].row_stride;
+            return off;
+        }
+
+        // Reorders scanline levels into their tiled layout; texels past the image edge stay zero
+        void tile_levels(const std::vector<MipRec>& lin, const unsigned char* src, const std::vector<MipRec>& lv, uint32_t tile, uint32_t ps, unsigned char* dst)
+        {
+            uint32_t shift = tile_shift_of(tile);
+            for (size_t l = 0; l < lv.size(); l++)
+            {
+                const MipRec& s = lin[l];
+                const MipRec& d = lv[l];
+                uint32_t tiles_y = (d.height + tile - 1) / tile;
+                ImageView v{};
+                v.data = dst + d.off;
+                v.row_stride = d.row_stride;
+                v.pixel_stride = ps;
+                v.tile_shift = shift;
+                // Bands are whole rows of tiles, each cleared by the band that fills it
+                detail::for_bands(tiles_y, d.row_stride, [&](size_t t0, size_t t1)
+                {
+                    std::memset(dst + d.off + t0 * d.row_stride, 0, (t1 - t0) * d.row_stride);
+                    uint32_t y1 = (uint32_t)std::min<size_t>(t1 * tile, s.height);
+                    for (uint32_t y = (uint32_t)(t0 * tile); y < y1; y++)
+                    {
+                        const unsigned char* row = src + s.off + (size_t)y * s.row_stride;
+                        for (uint32_t x = 0; x < s.width; x++)
+                        {
+                            std::memcpy((void*)pixel_address(v, x, y), row + (size_t)x * ps, ps);
+                        }
+                    }
+                });
+            }
+        }
+
+        // Fills levels 1.. of a frame block from its stored base level. The chain is carried in premultiplied
+        // linear float so no level is filtered from an already quantized one.
+        void write_mips(const PixelEncode& e, MipFilter filter, const std::vector<MipRec>& lv, unsigned char* block)
+        {
+            if (lv.size() < 2) return;
+            bool srgb = e.pf == PixelFormat::RGBA8 || e.pf == PixelFormat::RGB8;
+            bool straight = has_alpha(e.pf) && !e.premultiply;
+            size_t w0 = lv[0].width;
+            std::vector<float> cur(w0 * lv[0].height * 4);
+            // Filter overshoot over nearly transparent texels would blow up when unpremultiplied, so straight
+            // color is capped at the base level's brightest value
+            std::vector<float> row_max(lv[0].height, 0.0f);
+            detail::for_bands(lv[0].height, w0 * 16, [&](size_t y0, size_t y1)
+            {
+                for (size_t y = y0; y < y1; y++)
+                {
+                    float* c = cur.data() + y * w0 * 4;
+                    detail::decode_row_f32(block + lv[0].off + y * lv[0].row_stride, e.pf, lv[0].width, srgb, c);
+                    if (!straight) continue;
+                    float m = 0.0f;
+                    for (size_t i = 0; i < w0 * 4; i += 4)
+                    {
+                        m = std::fmax(m, std::fmax(c[i + 0], std::fmax(c[i + 1], c[i + 2])));
+                        c[i + 0] *= c[i + 3];
+                        c[i + 1] *= c[i + 3];
+                        c[i + 2] *= c[i + 3];
+                    }
+                    row_max[y] = m;
+                }
+            });
+            float cmax = 0.0f;
+            for (float m : row_max) cmax = std::fmax(cmax, m);
+            std::vector<float> next;
+            for (size_t l = 1; l < lv.size(); l++)
+            {
+                const MipRec& s = lv[l - 1];
+                const MipRec& d = lv[l];
+                next.resize((size_t)d.width * d.height * 4);
+                detail::downsample_rgba32f(cur.data(), s.width, s.height, next.data(), d.width, d.height, filter);
+                detail::for_bands(d.height, (size_t)d.width * 16, [&](size_t y0, size_t y1)
+                {
+                    std::vector<float> row(straight ? (size_t)d.width * 4 : 0);
+                    for (size_t y = y0; y < y1; y++)
+                    {
+                        const float* src = next.data() + y * d.width * 4;
+                        if (straight)
+                        {
+                            for (size_t x = 0; x < d.width; x++)
+                            {
+                                float a = src[x * 4 + 3] > 1.0f ? 1.0f : src[x * 4 + 3];
+                                float inv = a > 0.0f ? 1.0f / a : 0.0f;
+                                row[x * 4 + 0] = std::fmin(src[x * 4 + 0] * inv, cmax);
+                                row[x * 4 + 1] = std::fmin(src[x * 4 + 1] * inv, cmax);
+                                row[x * 4 + 2] = std::fmin(src[x * 4 + 2] * inv, cmax);
+                                row[x * 4 + 3] = a;
+                            }
+                            src = row.data();
+                        }
+                        unsigned char* dr = block + d.off + y * d.row_stride;
+                        detail::encode_row_f32(src, e.pf, d.width, dr);
+                        size_t used = (size_t)d.width * e.pixel_stride;
+                        std::memset(dr + used, 0, d.row_stride - used);
+                    }
+                });
+                cur.swap(next);
+            }
+        }
+
+        // Stored layout of a frame plus, for tiled packs, the scanline layout it is built in first
+        struct FramePlan
+        {
+            FrameRec fr;
+            std::vector<MipRec> lv;
+            size_t bytes;
+            FrameRec lin_fr;
+            std::vector<MipRec> lin;
+            size_t lin_bytes;
+            uint32_t crc; // of the stored bytes
+            std::vector<float> imp; // tile probabilities of the importance table, row-major
+            double imp_total; // raw weight they were normalized from
+        };
+
+        // A w x h frame storing only roi
+        FramePlan plan_frame(size_t i, uint32_t w, uint32_t h, const PixelRect& roi, const BuildConfig& cfg, const PixelEncode& e)
+        {
+            FramePlan p{};
+            p.fr = make_frame_rec(i, w, h, e.pixel_stride, cfg.row_align);
+            p.fr.roi_x = roi.x;
+            p.fr.roi_y = roi.y;
+            p.fr.roi_w = roi.width;
+            p.fr.roi_h = roi.height;
+            p.fr.row_stride = (uint32_t)rup((size_t)roi.width * e.pixel_stride, cfg.row_align);
+            p.lin_fr = p.fr;
+            p.bytes = plan_levels(p.fr, cfg.mip_levels, cfg.row_align, cfg.tile_size, p.lv);
+            if (cfg.tile_size) p.lin_bytes = plan_levels(p.lin_fr, cfg.mip_levels, cfg.row_align, 0, p.lin);
+            p.fr.block_bytes = p.bytes;
+            p.fr.stored_bytes = p.bytes;
+            return p;
+        }
+
+        FramePlan plan_frame(size_t i, uint32_t w, uint32_t h, const BuildConfig& cfg, const PixelEncode& e)
+        {
+            return plan_frame(i, w, h, PixelRect{0, 0, w, h}, cfg, e);
+        }
+
+        // Completes a frame whose base level sits in scanline layout at lin (the final block when untiled)
+        void finish_frame(const FramePlan& p, const BuildConfig& cfg, const PixelEncode& e, unsigned char* lin, unsigned char* block)
+        {
+            if (!cfg.tile_size)
+            {
+                write_mips(e, cfg.mip_filter, p.lv, block);
+                return;
+            }
+            write_mips(e, cfg.mip_filter, p.lin, lin);
+            tile_levels(p.lin, lin, p.lv, cfg.tile_size, e.pixel_stride, block);
+        }
+
+        // Bounding box of the pixels with non-zero alpha in a w x h RGBA image whose rows are row_elems apart,
+        // found a row band at a time; false when every pixel is transparent
+        template <class T>
+        bool alpha_bounds(const T* px, uint32_t w, uint32_t h, size_t row_elems, PixelRect& r)
+        {
+            std::mutex mu;
+            uint32_t x0 = w;
+            uint32_t y0 = h;
+            uint32_t x1 = 0;
+            uint32_t y1 = 0;
+            detail::for_bands(h, (size_t)w * 4 * sizeof(T), [&](size_t b0, size_t b1)
+            {
+                uint32_t bx0 = w;
+                uint32_t by0 = h;
+                uint32_t bx1 = 0;
+                uint32_t by1 = 0;
+                for (size_t y = b0; y < b1; y++)
+                {
+                    const T* row = px + y * row_elems;
+                    uint32_t l = 0;
+                    while (l < w && !(row[(size_t)l * 4 + 3] > 0)) l++;
+                    if (l == w) continue;
+                    // Columns left of the band's right edge so far cannot widen it
+                    uint32_t r = w;
+                    while (r > std::max(l + 1, bx1) && !(row[(size_t)(r - 1) * 4 + 3] > 0)) r--;
+                    bx0 = std::min(bx0, l);
+                    bx1 = std::max(bx1, r);
+                    by0 = std::min(by0, (uint32_t)y);
+                    by1 = (uint32_t)y + 1;
+                }
+                std::lock_guard<std::mutex> lk(mu);
+                x0 = std::min(x0, bx0);
+                y0 = std::min(y0, by0);
+                x1 = std::max(x1, bx1);
+                y1 = std::max(y1, by1);
+            });
+            if (x1 <= x0) return false;
+            r = PixelRect{x0, y0, x1 - x0, y1 - y0};
+            return true;
+        }
+
+        // Stored rectangle of a w x h frame: its alpha bounds (a single pixel when it is fully transparent)
+        // grown by the margin, then with mips out to whole texels of the coarsest level so every level's ROI
+        // starts on a texel of the frame's own chain
+        PixelRect crop_rect(const BuildConfig& cfg, bool found, PixelRect b, uint32_t w, uint32_t h)
+        {
+            if (!found) b = PixelRect{0, 0, 1, 1};
+            uint32_t chain = detail::mip_chain_length(w, h);
+            uint32_t levels = std::clamp(cfg.mip_levels, 1u, chain);
+            uint64_t a = 1ull << (levels - 1);
+            uint64_t m = cfg.crop_margin;
+            uint64_t x0 = (b.x > m ? b.x - m : 0) / a * a;
+            uint64_t y0 = (b.y > m ? b.y - m : 0) / a * a;
+            uint64_t x1 = std::min<uint64_t>((b.x + b.width + m + a - 1) / a * a, w);
+            uint64_t y1 = std::min<uint64_t>((b.y + b.height + m + a - 1) / a * a, h);
+            return PixelRect{(uint32_t)x0, (uint32_t)y0, (uint32_t)(x1 - x0), (uint32_t)(y1 - y0)};
+        }
+
+        // Moves the rows of r to the front of img, leaving an r.width x r.height image
+        void crop_rgba8(PngImg& img, const PixelRect& r)
+        {
+            if (r.width == (uint32_t)img.w && r.height == (uint32_t)img.h) return;
+            size_t src_rb = (size_t)img.w * 4;
+            size_t rb = (size_t)r.width * 4;
+            unsigned char* p = img.rgba.data();
+            for (size_t y = 0; y < r.height; y++) std::memmove(p + y * rb, p + (r.y + y) * src_rb + (size_t)r.x * 4, rb);
+            img.w = (int)r.width;
+            img.h = (int)r.height;
+            img.rgba.resize(rb * r.height);
+        }
+
+        // Converts the ROI of a whole w-wide float RGBA image (modified in place) into the frame's rows
+        void convert_roi_f32(float* rgba, uint32_t w, const FrameRec& fr, const PixelEncode& e, unsigned char* dst)
+        {
+            detail::for_bands(fr.roi_h, fr.row_stride, [&](size_t y0, size_t y1)
+            {
+                for (size_t y = y0; y < y1; y++)
+                {
+                    float* src = rgba + ((fr.roi_y + y) * w + fr.roi_x) * 4;
+                    convert_row_f32(src, (int)fr.roi_w, e, dst + y * fr.row_stride, fr.row_stride);
+                }
+            });
+        }
+
+        struct TailSect
+        {
+            uint32_t kind;
+            uint32_t flags;
+            std::vector<unsigned char> data;
+            // Bulky sections continue with pieces produced straight into the output at piece_off
+            std::vector<uint64_t> piece_off;
+            std::vector<uint64_t> piece_bytes;
+            std::function<void(size_t piece, unsigned char* dst)> gen;
+        };
+
+        uint64_t sect_bytes(const TailSect& t)
+        {
+            return t.piece_off.empty() ? t.data.size() : t.piece_off.back() + t.piece_bytes.back();
+        }
+
+        // Optional sections follow the pixel data, each block aligned, and are located through a directory
+        // written after them. Returns the end of the file.
+        uint64_t plan_tail(uint64_t start, size_t block_align, const std::vector<TailSect>& ts, std::vector<SectRec>& dir, Hdr& hdr)
+        {
+            dir.clear();
+            uint64_t off = start;
+            for (const auto& t : ts)
+            {
+                off = rup(off, block_align);
+                dir.push_back(SectRec{t.kind, t.flags, off, sect_bytes(t)});
+                off += sect_bytes(t);
+            }
+            hdr.sects_off = 0;
+            hdr.sect_count = (uint32_t)dir.size();
+            if (!dir.empty())
+            {
+                off = rup(off, block_align);
+                hdr.sects_off = off;
+                off = rup(off + sizeof(SectRec) * dir.size(), block_align);
+            }
+            return off;
+        }
+
+        TailSect make_mip_table(const std::vector<FramePlan>& plans)
+        {
+            uint32_t stride = 1;
+            for (const auto& p : plans) stride = p.lv.size() > stride ? (uint32_t)p.lv.size() : stride;
+            TailSect t{SectMips, stride, {}, {}, {}, {}};
+            t.data.resize(sizeof(MipRec) * stride * plans.size());
+            MipRec* out = (MipRec*)t.data.data();
+            for (size_t i = 0; i < plans.size(); i++)
+            {
+                for (size_t l = 0; l < plans[i].lv.size(); l++)
+                {
+                    out[i * stride + l] = plans[i].lv[l];
+                    out[i * stride + l].off += plans[i].fr.pixel_off;
+                }
+            }
+            return t;
+        }
+
+        TailSect make_fill(const PixelEncode& e)
+        {
+            TailSect t{SectFill, 0, std::vector<unsigned char>(kFillBytes, 0), {}, {}, {}};
+            if (e.pf == PixelFormat::RGB8)
+            {
+                for (int c = 0; c < 3; c++) t.data[c] = (unsigned char)e.bg8[c];
+            }
+            else if (e.pf == PixelFormat::RGB16F)
+            {
+                uint16_t v[3];
+                for (int c = 0; c < 3; c++) v[c] = detail::f32_to_f16(e.bg[c]);
+                std::memcpy(t.data.data(), v, sizeof(v));
+            }
+            return t;
+        }
+
+        uint32_t worker_count(const BuildConfig& cfg)
+        {
+            uint32_t th = cfg.threads ? cfg.threads : std::thread::hardware_concurrency();
+            return th ? th : 1;
+        }
+
+        // Where a build accumulates its BuildStats; builds run without one when the caller did not ask
+        struct BuildTrace
+        {
+            std::mutex mu;
+            BuildStats* out;
+        };
+
+        // Times consecutive pieces of work on one thread: each lap charges the wall and thread CPU time since
+        // the previous one to a stage. Does nothing without a trace.
+        struct StageTimer
+        {
+            BuildTrace* tr;
+            std::chrono::steady_clock::time_point w0;
+            double c0;
+
+            explicit StageTimer(BuildTrace* t) : tr(t), c0(0)
+            {
+                restart();
+            }
+
+            void restart()
+            {
+                if (!tr) return;
+                w0 = std::chrono::steady_clock::now();
+                c0 = detail::thread_cpu_seconds();
+            }
+
+            // idle is wall time spent blocked inside the lap (waiting on the memory budget), left out of it.
+            // Decode, convert and compress laps count toward the running worker's busy time.
+            void lap(BuildStage s, uint64_t in, uint64_t out, uint64_t items = 1, double idle = 0)
+            {
+                if (!tr) return;
+                auto w1 = std::chrono::steady_clock::now();
+                double c1 = detail::thread_cpu_seconds();
+                double wall = std::chrono::duration<double>(w1 - w0).count() - idle;
+                {
+                    std::lock_guard<std::mutex> lk(tr->mu);
+                    StageStats& st = tr->out->stages[(size_t)s];
+                    st.wall_seconds += wall;
+                    st.cpu_seconds += c1 - c0;
+                    st.bytes_in += in;
+                    st.bytes_out += out;
+                    st.items += items;
+                    if (s == BuildStage::Decode || s == BuildStage::Convert || s == BuildStage::Compress)
+                    {
+                        int slot = tbb::this_task_arena::current_thread_index();
+                        std::vector<double>& busy = tr->out->thread_busy_seconds;
+                        if (slot >= 0 && (size_t)slot < busy.size()) busy[slot] += wall;
+                    }
+                }
+                w0 = w1;
+                c0 = c1;
+            }
+        };
+
+        bool frame_packed(const FrameRec& fr)
+        {
+            return fr.stored_bytes < fr.block_bytes;
+        }
+
+        // View of one level of frame i whose block (all levels, decompressed) starts at block
+        ImageView frame_view(const PackHandleImpl* h, size_t i, uint32_t level, const char* block)
+        {
+            ImageView v{};
+            const FrameRec& fr = h->frames[i];
+            v.pixel_stride = fr.pixel_stride;
+            v.format = (PixelFormat)h->hdr.pixel_format;
+            v.tile_shift = h->hdr.flags & kFlagTileShiftMask;
+            v.fill = h->fill;
+            if (level == 0)
+            {
+                v.data = (const void*)block;
+                v.width = fr.width;
+                v.height = fr.height;
+                v.row_stride = fr.row_stride;
+                v.roi_x = fr.roi_x;
+                v.roi_y = fr.roi_y;
+                v.roi_w = fr.roi_w;
+                v.roi_h = fr.roi_h;
+                return v;
+            }
+            if (!h->mips || level >= fr.mip_levels || level >= h->mip_stride) return ImageView{};
+            // Levels are of the stored ROI, whose corner the builder aligns to the chain's coarsest texel
+            const MipRec& m = h->mips[i * h->mip_stride + level];
+            v.data = (const void*)(block + (m.off - fr.pixel_off));
+            v.width = std::max(fr.width >> level, 1u);
+            v.height = std::max(fr.height >> level, 1u);
+            v.row_stride = m.row_stride;
+            v.roi_x = std::min(fr.roi_x >> level, v.width - 1);
+            v.roi_y = std::min(fr.roi_y >> level, v.height - 1);
+            v.roi_w = std::min(m.width, v.width - v.roi_x);
+            v.roi_h = std::min(m.height, v.height - v.roi_y);
+            return v;
+        }
+
+        struct Decompressor
+        {
+            libdeflate_decompressor* d = libdeflate_alloc_decompressor();
+
+            ~Decompressor()
+            {
+                if (d) libdeflate_free_decompressor(d);
+            }
+        };
+
+        bool inflate_block(const void* src, size_t stored_bytes, void* dst, size_t block_bytes)
+        {
+            thread_local Decompressor dc;
+            return dc.d && libdeflate_deflate_decompress(dc.d, src, stored_bytes, dst, block_bytes, nullptr) == LIBDEFLATE_SUCCESS;
+        }
+
+        bool inflate_frame(const PackHandleImpl* h, const FrameRec& fr, std::vector<unsigned char>& out)
+        {
+            if (fr.pixel_off + fr.stored_bytes > h->map.bytes) return false;
+            out.resize(fr.block_bytes);
+            return inflate_block(h->base + fr.pixel_off, fr.stored_bytes, out.data(), out.size());
+        }
+
+        // Caller holds c.mu
+        void trim_cache(FrameCache& c)
+        {
+            while (c.bytes > c.budget && !c.lru.empty())
+            {
+                auto it = c.entries.find(c.lru.back());
+                c.bytes -= it->second.data.size();
+                c.entries.erase(it);
+                c.lru.pop_back();
+            }
+        }
+
+        void drop_pin(FrameCache& c, std::unordered_map<size_t, FrameCache::Entry>::iterator it)
+        {
+            if (--it->second.pins) return;
+            if (it->second.failed)
+            {
+                c.entries.erase(it);
+                return;
+            }
+            c.lru.push_front(it->first);
+            it->second.lru = c.lru.begin();
+            trim_cache(c);
+        }
+
+        // Returns the decompressed block of frame i, pinned; the first thread to miss decompresses it while
+        // later callers for the same frame wait for the result
+        const unsigned char* pin_frame(PackHandleImpl* h, size_t i)
+        {
+            FrameCache& c = h->cache;
+            std::unique_lock<std::mutex> lk(c.mu);
+            auto [it, fresh] = c.entries.try_emplace(i);
+            FrameCache::Entry& e = it->second;
+            (fresh ? h->cache_misses : h->cache_hits).fetch_add(1, std::memory_order_relaxed);
+            if (!fresh)
+            {
+                if (e.pins == 0 && e.ready) c.lru.erase(e.lru);
+                e.pins++;
+                c.cv.wait(lk, [&] { return e.ready; });
+                if (!e.failed) return e.data.data();
+                drop_pin(c, it);
+                set_error(Error::BadPack);
+                return nullptr;
+            }
+            e.pins = 1;
+            lk.unlock();
+            std::vector<unsigned char> data;
+            bool ok = inflate_frame(h, h->frames[i], data);
+            lk.lock();
+            e.data = std::move(data);
+            e.ready = true;
+            e.failed = !ok;
+            c.cv.notify_all();
+            if (!ok)
+            {
+                drop_pin(c, it);
+                set_error(Error::BadPack);
+                return nullptr;
+            }
+            c.bytes += e.data.size();
+            trim_cache(c);
+            return e.data.data();
+        }
+
+        void unpin_frame(PackHandleImpl* h, size_t i)
+        {
+            FrameCache& c = h->cache;
+            std::lock_guard<std::mutex> lk(c.mu);
+            auto it = c.entries.find(i);
+            if (it != c.entries.end() && it->second.pins) drop_pin(c, it);
+        }
+
+        // Stored extent of frame i: the compressed stream, or the raw block with all its levels
+        void frame_extent(const PackHandleImpl* h, size_t i, uint64_t& off, uint64_t& bytes)
+        {
+            const FrameRec& fr = h->frames[i];
+            off = fr.pixel_off;
+            if (fr.stored_bytes)
+            {
+                bytes = fr.stored_bytes;
+                return;
+            }
+            // Packs before version 4 do not record block sizes
+            uint32_t shift = h->hdr.flags & kFlagTileShiftMask;
+            uint32_t levels = h->mips ? std::min(fr.mip_levels, h->mip_stride) : 1;
+            bytes = 0;
+            for (uint32_t l = 0; l < levels; l++)
+            {
+                uint64_t rel = 0;
+                uint32_t height = fr.height;
+                uint32_t rs = fr.row_stride;
+                if (l)
+                {
+                    const MipRec& m = h->mips[i * h->mip_stride + l];
+                    rel = m.off - fr.pixel_off;
+                    height = m.height;
+                    rs = m.row_stride;
+                }
+                uint64_t rows = shift ? (height + (1u << shift) - 1) >> shift : height;
+                bytes = std::max(bytes, rel + rows * rs);
+            }
+        }
+
+        uint32_t importance_tile(const BuildConfig& cfg)
+        {
+            return cfg.importance_tile ? cfg.importance_tile : 16;
+        }
+
+        // Record of frame i's importance table once its tables are known to lie inside the section
+        const ImpRec* importance_rec(const PackHandleImpl* h, size_t i)
+        {
+            if (!h->imp || i >= h->frames.size()) return nullptr;
+            const ImpRec& r = ((const ImpRec*)(h->imp + sizeof(ImpHead)))[i];
+            uint64_t n = (uint64_t)r.tiles_x * r.tiles_y;
+            if (!n || r.off % 4 || r.off > h->imp_bytes || n > (h->imp_bytes - r.off) / 8) return nullptr;
+            return &r;
+        }
+
+        // Mapping that holds frame i's stored bytes and where it starts in the pack's address range: the whole
+        // pack, or the frame's shard file for index packs (empty when the handle does not own it)
+        const detail::mmap_ro& frame_map(const PackHandleImpl* h, size_t i, uint64_t& start)
+        {
+            static const detail::mmap_ro none;
+            start = 0;
+            if (!h->frame_shards) return h->map;
+            uint32_t s = h->frame_shards[i];
+            if (s >= h->shards.size()) return none;
+            start = h->shard_recs[s].virt_off;
+            return h->shards[s];
+        }
+
+        bool owns_frame(const PackHandleImpl* h, size_t i)
+        {
+            uint64_t start;
+            return i < h->frames.size() && frame_map(h, i, start).ptr;
+        }
+
+        // Whether frame i can be touched: its record and level table stay inside its block, and the block (or
+        // its compressed stream) inside the pack, or the shard file the handle maps it from. O(levels), so open
+        // never walks the frame table.
+        bool frame_ok(const PackHandleImpl* h, size_t i)
+        {
+            if (i >= h->frames.size()) return false;
+            const FrameRec& fr = h->frames[i];
+            uint64_t start;
+            const detail::mmap_ro& m = frame_map(h, i, start);
+            if (!m.ptr) return false;
+            uint64_t size = start + m.bytes;
+            if (fr.camera_id >= h->cam.count || fr.pixel_off < start || fr.pixel_off > size) return false;
+            if (fr.roi_x > fr.width || fr.roi_w > fr.width - fr.roi_x || fr.roi_y > fr.height || fr.roi_h > fr.height - fr.roi_y) return false;
+            uint32_t shift = h->hdr.flags & kFlagTileShiftMask;
+            if (shift > 8) return false;
+            uint32_t levels = h->mips ? std::min(fr.mip_levels, h->mip_stride) : 1;
+            uint64_t need = 0;
+            for (uint32_t l = 0; l < levels; l++)
+            {
+                uint64_t rel = 0;
+                uint32_t width = fr.roi_w;
+                uint32_t height = fr.roi_h;
+                uint32_t rs = fr.row_stride;
+                if (l)
+                {
+                    const MipRec& m = h->mips[i * h->mip_stride + l];
+                    // Levels of compressed frames sit in the inflated block, which may outgrow the file
+                    if (m.off < fr.pixel_off || m.off - fr.pixel_off > (frame_packed(fr) ? fr.block_bytes : size)) return false;
+                    rel = m.off - fr.pixel_off;
+                    width = m.width;
+                    height = m.height;
+                    rs = m.row_stride;
+                }
+                // A row (tile row when tiled) has to hold the level's width
+                uint64_t row = shift ? ((((uint64_t)width + (1u << shift) - 1) >> shift) << (2 * shift)) * fr.pixel_stride : (uint64_t)width * fr.pixel_stride;
+                if (rs < row) return false;
+                uint64_t rows = shift ? (height + (1u << shift) - 1) >> shift : height;
+                need = std::max(need, rel + rows * rs);
+            }
+            uint64_t room = size - fr.pixel_off;
+            // DEFLATE cannot expand past 1032:1, which also caps what a corrupt record makes us allocate
+            if (frame_packed(fr)) return fr.stored_bytes <= room && need <= fr.block_bytes && fr.block_bytes / 1032 <= fr.stored_bytes;
+            return need <= room && (!fr.stored_bytes || fr.stored_bytes <= room);
+        }
+
+        // Lazy verification: the first access to a frame checks its stored bytes against the checksum table
+        bool frame_verified(const PackHandleImpl* h, size_t i)
+        {
+            if (!h->verified) return true;
+            uint8_t st = h->verified[i].load(std::memory_order_acquire);
+            if (!st)
+            {
+                const FrameRec& fr = h->frames[i];
+                st = libdeflate_crc32(0, h->base + fr.pixel_off, fr.stored_bytes) == h->frame_crc[i] ? 1 : 2;
+                h->verified[i].store(st, std::memory_order_release);
+            }
+            return st == 1;
+        }
+
+        // Pages of the pack's [off, off + bytes) and how many of them are in RAM, from a resident_pages map
+        // (empty when residency is unknown)
+        ResidentRange range_residency(const std::vector<unsigned char>& pages, size_t page, size_t lead, uint64_t off, uint64_t bytes)
+        {
+            ResidentRange r{bytes, 0, 0};
+            if (!bytes) return r;
+            uint64_t p0 = (lead + off) / page;
+            uint64_t p1 = (lead + off + bytes - 1) / page + 1;
+            r.pages = p1 - p0;
+            for (uint64_t p = p0; p < p1 && p < pages.size(); p++) r.resident_pages += pages[p] != 0;
+            return r;
+        }
+
+        void add_range(ResidentRange& a, const ResidentRange& b)
+        {
+            a.bytes += b.bytes;
+            a.pages += b.pages;
+            a.resident_pages += b.resident_pages;
+        }
+
+        bool advise_frames(const PackHandleImpl* h, const size_t* idx, size_t count, detail::Advice a)
+        {
+            if (a == detail::Advice::WillNeed) h->prefetches.fetch_add(count, std::memory_order_relaxed);
+            if (a == detail::Advice::DontNeed) h->evictions.fetch_add(count, std::memory_order_relaxed);
+            bool ok = true;
+            for (size_t k = 0; k < count; k++)
+            {
+                if (!frame_ok(h, idx[k]))
+                {
+                    ok = false;
+                    continue;
+                }
+                uint64_t off;
+                uint64_t bytes;
+                uint64_t start;
+                frame_extent(h, idx[k], off, bytes);
+                // Through the shard's own mapping so page cache hints reach the right file
+                const detail::mmap_ro& m = frame_map(h, idx[k], start);
+                ok = detail::advise_range(m, (size_t)(off - start), (size_t)bytes, a) && ok;
+            }
+            return ok;
+        }
+
+        void readahead_loop(PackHandleImpl* h)
+        {
+            Readahead& r = h->ra;
+            std::unique_lock<std::mutex> lk(r.mu);
+            std::vector<size_t> fetch;
+            std::vector<size_t> drop;
+            for (;;)
+            {
+                auto target = [&] { return std::min(r.order.size(), r.pos + r.lookahead); };
+                r.cv.wait(lk, [&] { return r.stop || r.ahead < target() || (r.evict_behind && r.behind < r.pos); });
+                if (r.stop) return;
+                size_t end = target();
+                fetch.assign(r.order.begin() + std::max(r.ahead, r.pos), r.order.begin() + end);
+                drop.clear();
+                if (r.evict_behind && r.behind < r.pos)
+                {
+                    for (size_t k = r.behind; k < r.pos; k++)
+                    {
+                        if (std::find(r.order.begin() + r.pos, r.order.begin() + end, r.order[k]) == r.order.begin() + end) drop.push_back(r.order[k]);
+                    }
+                }
+                r.ahead = end;
+                r.behind = r.pos;
+                lk.unlock();
+                advise_frames(h, drop.data(), drop.size(), detail::Advice::DontNeed);
+                advise_frames(h, fetch.data(), fetch.size(), detail::Advice::WillNeed);
+                lk.lock();
+            }
+        }
+
+        void stop_readahead(PackHandleImpl* h)
+        {
+            Readahead& r = h->ra;
+            {
+                std::lock_guard<std::mutex> lk(r.mu);
+                r.stop = true;
+            }
+            r.cv.notify_all();
+            if (r.th.joinable()) r.th.join();
+            r.stop = false;
+        }
+
+        // Recycled page-aligned read buffers; a buffer outliving its reader is simply freed
+        struct BufferPool
+        {
+            std::mutex mu;
+            std::vector<std::pair<void*, size_t>> free;
+            size_t keep = 0;
+
+            ~BufferPool()
+            {
+                for (auto& b : free) detail::free_aligned(b.first);
+            }
+        };
+
+        constexpr size_t kReadBufferAlign = 4096;
+
+        std::shared_ptr<unsigned char> pool_take(const std::shared_ptr<BufferPool>& pool, size_t bytes)
+        {
+            size_t cap = rup(bytes ? bytes : 1, kReadBufferAlign);
+            void* p = nullptr;
+            {
+                std::lock_guard<std::mutex> lk(pool->mu);
+                for (size_t k = 0; k < pool->free.size(); k++)
+                {
+                    if (pool->free[k].second < cap || pool->free[k].second > 2 * cap) continue;
+                    p = pool->free[k].first;
+                    cap = pool->free[k].second;
+                    pool->free[k] = pool->free.back();
+                    pool->free.pop_back();
+                    break;
+                }
+            }
+            if (!p) p = detail::aligned_bytes(kReadBufferAlign, cap);
+            if (!p) return nullptr;
+            std::weak_ptr<BufferPool> wp = pool;
+            return std::shared_ptr<unsigned char>((unsigned char*)p, [wp, cap](unsigned char* q)
+            {
+                if (auto sp = wp.lock())
+                {
+                    std::lock_guard<std::mutex> lk(sp->mu);
+                    if (sp->free.size() < sp->keep)
+                    {
+                        sp->free.emplace_back(q, cap);
+                        return;
+                    }
+                }
+                detail::free_aligned(q);
+            });
+        }
+
+        struct FrameReaderImpl
+        {
+            PackHandleImpl* h;
+            detail::AsyncReader* io;
+            size_t align; // O_DIRECT granularity, 0 = page cache only
+            std::shared_ptr<BufferPool> pool;
+        };
+
+        // Awaiting coroutines never run on the io_uring completion thread: one that submits more reads from
+        // there would wait on the very completions it is holding up
+        void resume_on_worker(FrameReaderImpl* r, std::coroutine_handle<> c)
+        {
+            detail::aio_post(r->io, [c] { c.resume(); });
+        }
+
+        using ReadDone = std::function<void(Error, std::shared_ptr<const unsigned char>)>;
+
+        // Queues the read of frame i into ops. With dst the decompressed block lands there, otherwise in a
+        // pooled buffer handed to done. done always runs on a reader thread, errors found here included.
+        // Reads bypass the mapping, so with verify_frames every read is checked, not just the first
+        bool read_verified(const PackHandleImpl* h, size_t i, const unsigned char* stored)
+        {
+            if (!h->verified) return true;
+            bool good = libdeflate_crc32(0, stored, h->frames[i].stored_bytes) == h->frame_crc[i];
+            if (!good) h->verified[i].store(2, std::memory_order_release);
+            return good;
+        }
+
+        void plan_read(FrameReaderImpl* r, size_t i, unsigned char* dst, size_t dst_bytes, ReadDone done, std::vector<detail::ReadOp>& ops)
+        {
+            PackHandleImpl* h = r->h;
+            auto fail = [&](Error e) { detail::aio_post(r->io, [done, e] { done(e, nullptr); }); };
+            if (i >= h->frames.size()) return fail(Error::BadConfig);
+            if (!frame_ok(h, i)) return fail(Error::BadPack);
+            uint64_t off;
+            uint64_t bytes;
+            frame_extent(h, i, off, bytes);
+            const FrameRec& fr = h->frames[i];
+            bool packed = frame_packed(fr);
+            if (off + bytes > h->map.bytes) return fail(Error::BadPack);
+            h->reader_loads.fetch_add(1, std::memory_order_relaxed);
+            h->reader_bytes.fetch_add(bytes, std::memory_order_relaxed);
+            if (dst && dst_bytes < (packed ? fr.block_bytes : bytes)) return fail(Error::BadConfig);
+            // Archive scenes start part way into the file; shard files (reader file k + 1) at their slot
+            uint64_t start;
+            const detail::mmap_ro& m = frame_map(h, i, start);
+            off = off - start + m.file_off;
+            uint32_t file = h->frame_shards ? h->frame_shards[i] + 1 : 0;
+            size_t a = r->align;
+            size_t lead = a ? (size_t)(off % a) : 0;
+            size_t want = a ? rup(lead + bytes, a) : (size_t)bytes;
+            if (dst && !packed)
+            {
+                // Straight into the caller's memory, through O_DIRECT only when everything lines up
+                if (!a || lead || want > dst_bytes || (uintptr_t)dst % a) want = bytes;
+                ops.push_back(detail::ReadOp{off, want, (size_t)bytes, dst, [r, i, dst, done](bool ok)
+                {
+                    if (!ok) return done(Error::IoFail, nullptr);
+                    done(read_verified(r->h, i, dst) ? Error::Ok : Error::BadPack, nullptr);
+                }, file});
+                return;
+            }
+            std::shared_ptr<unsigned char> buf = pool_take(r->pool, want);
+            if (!buf) return fail(Error::NoMemory);
+            ops.push_back(detail::ReadOp{off - lead, want, lead + (size_t)bytes, buf.get(), [r, i, dst, lead, buf, done](bool ok)
+            {
+                if (!ok) return done(Error::IoFail, nullptr);
+                if (!read_verified(r->h, i, buf.get() + lead)) return done(Error::BadPack, nullptr);
+                if (!frame_packed(r->h->frames[i])) return done(Error::Ok, std::shared_ptr<const unsigned char>(buf, buf.get() + lead));
+                // Keep the completion thread free for the next read
+                detail::aio_post(r->io, [r, i, dst, lead, buf, done]
+                {
+                    const FrameRec& fr = r->h->frames[i];
+                    std::shared_ptr<unsigned char> out;
+                    unsigned char* to = dst;
+                    if (!to)
+                    {
+                        out = pool_take(r->pool, fr.block_bytes);
+                        to = out.get();
+                    }
+                    if (!to) return done(Error::NoMemory, nullptr);
+                    bool good = inflate_block(buf.get() + lead, fr.stored_bytes, to, fr.block_bytes);
+                    done(good ? Error::Ok : Error::BadPack, good ? std::move(out) : nullptr);
+                });
+            }, file});
+        }
+
+        // splitmix64; every chunk of rays gets its own stream so a batch does not depend on the thread count
+        inline uint64_t next_rand(uint64_t& s)
+        {
+            uint64_t z = (s += 0x9e3779b97f4a7c15ull);
+            z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+            z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+            return z ^ (z >> 31);
+        }
+
+        constexpr size_t kRayChunk = 4096;
+
+        // w pixels of row y of v from column x0, in frame coordinates: a pointer into the view when they are all
+        // stored in scanline order, else assembled in buf with the fill pixel standing in outside the ROI.
+        // A view with an empty ROI covers the whole frame.
+        const unsigned char* view_row(const ImageView& v, uint32_t x0, uint32_t y, uint32_t w, unsigned char* buf)
+        {
+            static const unsigned char zero[kFillBytes] = {0};
+            uint32_t ps = v.pixel_stride;
+            uint32_t rw = v.roi_w ? v.roi_w : v.width;
+            uint32_t rh = v.roi_h ? v.roi_h : v.height;
+            uint64_t x1 = (uint64_t)x0 + w;
+            uint64_t a = std::clamp<uint64_t>(v.roi_x, x0, x1);
+            uint64_t b = std::clamp<uint64_t>((uint64_t)v.roi_x + rw, a, x1);
+            if (y < v.roi_y || y - v.roi_y >= rh) a = b = x1;
+            uint32_t ry = y - v.roi_y;
+            if (!v.tile_shift && a == x0 && b == x1) return (const unsigned char*)pixel_address(v, x0 - v.roi_x, ry);
+            const unsigned char* f = v.fill ? (const unsigned char*)v.fill : zero;
+            for (uint64_t x = x0; x < a; x++) std::memcpy(buf + (x - x0) * ps, f, ps);
+            for (uint64_t x = b; x < x1; x++) std::memcpy(buf + (x - x0) * ps, f, ps);
+            if (a == b) return buf;
+            if (!v.tile_shift)
+            {
+                std::memcpy(buf + (a - x0) * ps, pixel_address(v, (uint32_t)a - v.roi_x, ry), (b - a) * ps);
+                return buf;
+            }
+            // Z order scatters a tile row, so tiled views are copied pixel by pixel
+            for (uint64_t x = a; x < b; x++) std::memcpy(buf + (x - x0) * ps, pixel_address(v, (uint32_t)x - v.roi_x, ry), ps);
+            return buf;
+        }
+
+        // Shape and conversion of one gather_frames call
+        struct GatherPlan
+        {
+            PixelRect r;
+            TensorLayout layout;
+            TensorType type;
+            uint32_t channels;
+            size_t elem;
+            bool srgb;
+            bool copy8; // 8-bit pack to U8 with nothing to convert: bytes are copied
+            detail::ShadeParams shade;
+        };
+
+        // Converts rows [y0, y1) of the plan's rect of v into the tensor frame at base
+        bool gather_rows(const GatherPlan& g, const ImageView& v, char* base, size_t y0, size_t y1)
+        {
+            const detail::ConvertKernels& k = detail::convert_kernels();
+            uint32_t w = g.r.width;
+            uint32_t nc = g.channels;
+            uint32_t ps = v.pixel_stride;
+            size_t plane = (size_t)g.r.height * w;
+            bool nhwc = g.layout == TensorLayout::NHWC;
+            thread_local std::vector<unsigned char> row;
+            thread_local std::vector<float> rgba;
+            thread_local std::vector<float> tmp;
+            row.resize((size_t)w * ps);
+            rgba.resize((size_t)w * 4);
+            tmp.resize(g.type == TensorType::F32 ? 0 : (size_t)w * nc);
+            for (size_t y = y0; y < y1; y++)
+            {
+                const unsigned char* s = view_row(v, g.r.x, g.r.y + (uint32_t)y, w, row.data());
+                if (g.copy8)
+                {
+                    unsigned char* d = (unsigned char*)base;
+                    if (nhwc && ps == nc)
+                    {
+                        std::memcpy(d + y * w * nc, s, (size_t)w * nc);
+                    }
+                    else if (nhwc)
+                    {
+                        d += y * w * nc;
+                        for (uint32_t x = 0; x < w; x++)
+                        {
+                            for (uint32_t c = 0; c < nc; c++) d[(size_t)x * nc + c] = s[(size_t)x * ps + c];
+                        }
+                    }
+                    else
+                    {
+                        for (uint32_t c = 0; c < nc; c++)
+                        {
+                            unsigned char* p = d + c * plane + y * w;
+                            for (uint32_t x = 0; x < w; x++) p[x] = s[(size_t)x * ps + c];
+                        }
+                    }
+                    continue;
+                }
+                if (!detail::decode_row_f32(s, v.format, w, g.srgb, rgba.data())) return false;
+                // F32 is shaded straight into the tensor, F16 and U8 through one row of floats in tensor order
+                float* f = g.type == TensorType::F32 ? (float*)base + (nhwc ? y * w * nc : y * w) : tmp.data();
+                float* out[4];
+                for (uint32_t c = 0; c < 4; c++)
+                {
+                    uint32_t cc = c < nc ? c : 0;
+                    out[c] = nhwc ? f + cc : g.type == TensorType::F32 ? f + cc * plane : f + (size_t)cc * w;
+                }
+                k.shade_rgba(rgba.data(), w, g.shade, nc, out, nhwc ? nc : 1);
+                if (g.type == TensorType::F32) continue;
+                auto put = [&](const float* src, size_t n, size_t at)
+                {
+                    if (g.type == TensorType::F16)
+                    {
+                        k.f32_to_f16(src, (uint16_t*)base + at, n);
+                        return;
+                    }
+                    unsigned char* d = (unsigned char*)base + at;
+                    for (size_t j = 0; j < n; j++)
+                    {
+                        float x = src[j] > 0.0f ? (src[j] < 1.0f ? src[j] : 1.0f) : 0.0f;
+                        d[j] = (unsigned char)(x * 255.0f + 0.5f);
+                    }
+                };
+                if (nhwc)
+                {
+                    put(tmp.data(), (size_t)w * nc, y * w * nc);
+                    continue;
+                }
+                for (uint32_t c = 0; c < nc; c++) put(tmp.data() + (size_t)c * w, w, c * plane + y * w);
+            }
+            return true;
+        }
+
+        // Level 0 of a frame being built as frame_view will show it once the block is in the pack
+        ImageView plan_view(const FramePlan& p, const BuildConfig& cfg, const PixelEncode& e, const unsigned char* block, const void* fill)
+        {
+            ImageView v{};
+            v.data = block;
+            v.format = e.pf;
+            v.width = p.fr.width;
+            v.height = p.fr.height;
+            v.row_stride = p.fr.row_stride;
+            v.pixel_stride = p.fr.pixel_stride;
+            v.roi_x = p.fr.roi_x;
+            v.roi_y = p.fr.roi_y;
+            v.roi_w = p.fr.roi_w;
+            v.roi_h = p.fr.roi_h;
+            v.tile_shift = cfg.tile_size ? tile_shift_of(cfg.tile_size) : 0;
+            v.fill = cfg.crop_alpha ? fill : nullptr;
+            return v;
+        }
+
+        // Tile table of a finished frame into p.imp. A pixel weighs its alpha and/or the forward differences of
+        // alpha-premultiplied luma and of alpha to its right and lower neighbours; each tile's probability is
+        // its share of the frame's weight, mixed with its share of the pixels by the floor.
+        void importance_weights(const ImageView& v, const BuildConfig& cfg, bool premultiplied, FramePlan& p)
+        {
+            uint32_t T = importance_tile(cfg);
+            uint32_t W = v.width;
+            uint32_t H = v.height;
+            uint32_t tx = (W + T - 1) / T;
+            uint32_t ty = (H + T - 1) / T;
+            bool by_alpha = (uint32_t)cfg.importance & (uint32_t)ImportanceSource::Alpha;
+            bool by_grad = (uint32_t)cfg.importance & (uint32_t)ImportanceSource::Gradient;
+            std::vector<double> raw((size_t)tx * ty, 0.0);
+            // Bands are whole rows of tiles, reading one row past their last
+            detail::for_bands(ty, (size_t)W * T * 16, [&](size_t t0, size_t t1)
+            {
+                std::vector<unsigned char> buf((size_t)W * v.pixel_stride);
+                std::vector<float> cur((size_t)W * 4);
+                std::vector<float> nxt((size_t)W * 4);
+                std::vector<float> lc(W);
+                std::vector<float> ln(W);
+                auto load = [&](uint32_t y, std::vector<float>& rgba, std::vector<float>& luma)
+                {
+                    detail::decode_row_f32(view_row(v, 0, y, W, buf.data()), v.format, W, false, rgba.data());
+                    for (uint32_t x = 0; x < W; x++)
+                    {
+                        const float* q = rgba.data() + (size_t)x * 4;
+                        float l = 0.2126f * q[0] + 0.7152f * q[1] + 0.0722f * q[2];
+                        luma[x] = premultiplied ? l : l * q[3];
+                    }
+                };
+                uint32_t y0 = (uint32_t)t0 * T;
+                uint32_t y1 = (uint32_t)std::min<uint64_t>((uint64_t)t1 * T, H);
+                load(y0, cur, lc);
+                for (uint32_t y = y0; y < y1; y++)
+                {
+                    bool below = y + 1 < H;
+                    if (below) load(y + 1, nxt, ln);
+                    double* row = raw.data() + (size_t)(y / T) * tx;
+                    for (uint32_t x = 0; x < W; x++)
+                    {
+                        float a = cur[(size_t)x * 4 + 3];
+                        float w = by_alpha ? a : 0.0f;
+                        if (by_grad && x + 1 < W) w += std::fabs(lc[x + 1] - lc[x]) + std::fabs(cur[(size_t)x * 4 + 7] - a);
+                        if (by_grad && below) w += std::fabs(ln[x] - lc[x]) + std::fabs(nxt[(size_t)x * 4 + 3] - a);
+                        // Negative and NaN weights (out-of-range float frames) count as nothing
+                        if (w > 0.0f) row[x / T] += w;
+                    }
+                    std::swap(cur, nxt);
+                    std::swap(lc, ln);
+                }
+            });
+            double total = 0.0;
+            for (double w : raw) total += w;
+            double fl = total > 0.0 ? cfg.importance_floor : 1.0;
+            double pixels = (double)W * H;
+            p.imp.resize(raw.size());
+            for (uint32_t y = 0; y < ty; y++)
+            {
+                for (uint32_t x = 0; x < tx; x++)
+                {
+                    double area = (double)std::min(T, W - x * T) * std::min(T, H - y * T);
+                    size_t t = (size_t)y * tx + x;
+                    double w = total > 0.0 ? raw[t] / total : 0.0;
+                    p.imp[t] = (float)((1.0 - fl) * w + fl * area / pixels);
+                }
+            }
+            p.imp_total = total;
+        }
+
+        uint32_t oct_encode(const float d[3])
+        {
+            float n = std::fabs(d[0]) + std::fabs(d[1]) + std::fabs(d[2]);
+            float x = d[0] / n;
+            float y = d[1] / n;
+            if (d[2] < 0)
+            {
+                float ox = x;
+                x = std::copysign(1.0f - std::fabs(y), ox);
+                y = std::copysign(1.0f - std::fabs(ox), y);
+            }
+            auto q = [](float v) { return (uint32_t)(uint16_t)(int16_t)std::lround(std::clamp(v, -1.0f, 1.0f) * 32767.0f); };
+            return q(x) | (q(y) << 16);
+        }
+
+        // Per-frame pixel-centre rays, generated a frame at a time so the table never sits in memory whole
+        TailSect make_ray_table(const CamTables& ct, const SceneRec& scene)
+        {
+            size_t N = ct.w.size();
+            TailSect t{SectRays, 0, {}, {}, {}, {}};
+            t.data.resize(sizeof(RayRec) * N);
+            RayRec* recs = (RayRec*)t.data.data();
+            uint64_t off = rup(t.data.size(), 64);
+            for (size_t i = 0; i < N; i++)
+            {
+                uint64_t px = (uint64_t)ct.w[i] * ct.h[i];
+                uint64_t plane = rup(px * 4, 64);
+                recs[i] = RayRec{off, off + plane, off + 2 * plane, ct.w[i], ct.h[i]};
+                t.piece_off.push_back(off);
+                t.piece_bytes.push_back(3 * plane);
+                off += 3 * plane;
+            }
+            t.gen = [&ct, scene](size_t i, unsigned char* dst)
+            {
+                size_t N = ct.w.size();
+                CameraSOAView cams{ct.fx.data(), ct.fy.data(), ct.cx.data(), ct.cy.data(), ct.T.data(), ct.w.data(), ct.h.data(), ct.t.data(), N};
+                uint32_t w = ct.w[i];
+                uint32_t h = ct.h[i];
+                size_t plane = rup((size_t)w * h * 4, 64);
+                uint32_t* oct = (uint32_t*)dst;
+                float* tn = (float*)(dst + plane);
+                float* tf = (float*)(dst + 2 * plane);
+                std::memset(dst, 0, 3 * plane);
+                std::vector<uint32_t> cam(w, (uint32_t)i);
+                std::vector<float> px(w), py(w), o(3 * w), d(3 * w);
+                float* op[3] = {o.data(), o.data() + w, o.data() + 2 * w};
+                float* dp[3] = {d.data(), d.data() + w, d.data() + 2 * w};
+                for (uint32_t x = 0; x < w; x++) px[x] = (float)x + 0.5f;
+                for (uint32_t y = 0; y < h; y++)
+                {
+                    std::fill(py.begin(), py.end(), (float)y + 0.5f);
+                    detail::convert_kernels().ray_dirs(cams, cam.data(), px.data(), py.data(), w, op, dp);
+                    for (uint32_t x = 0; x < w; x++)
+                    {
+                        float dir[3] = {dp[0][x], dp[1][x], dp[2][x]};
+                        // Slab test; NaN from a zero component on a slab plane is dropped by fmax/fmin
+                        float t0 = 0.0f;
+                        float t1 = INFINITY;
+                        for (int a = 0; a < 3; a++)
+                        {
+                            float inv = 1.0f / dir[a];
+                            float ta = (scene.aabb_min[a] - op[a][x]) * inv;
+                            float tb = (scene.aabb_max[a] - op[a][x]) * inv;
+                            t0 = std::fmax(t0, std::fmin(ta, tb));
+                            t1 = std::fmin(t1, std::fmax(ta, tb));
+                        }
+                        size_t k = (size_t)y * w + x;
+                        oct[k] = oct_encode(dir);
+                        tn[k] = t0;
+                        tf[k] = t1 > t0 ? t1 : t0;
+                    }
+                }
+            };
+            return t;
+        }
+
+        struct Compressor
+        {
+            libdeflate_compressor* c;
+
+            explicit Compressor(uint32_t level) : c(level ? libdeflate_alloc_compressor((int)level) : nullptr) {}
+            ~Compressor()
+            {
+                if (c) libdeflate_free_compressor(c);
+            }
+            Compressor(const Compressor&) = delete;
+            Compressor& operator=(const Compressor&) = delete;
+        };
+
+        // Replaces a frame block with its DEFLATE stream unless that does not save anything
+        void deflate_block(libdeflate_compressor* c, std::vector<unsigned char>& block, FrameRec& fr)
+        {
+            std::vector<unsigned char> out(libdeflate_deflate_compress_bound(c, block.size()));
+            size_t n = libdeflate_deflate_compress(c, block.data(), block.size(), out.data(), out.size());
+            if (n == 0 || n >= block.size()) return;
+            out.resize(n);
+            block = std::move(out);
+            fr.stored_bytes = n;
+        }
+
+        // Inclusive prefix sums of w, pinned to exactly 1 from the last non-zero weight on so that any u below 1
+        // lands on an entry that can be drawn
+        void prefix_cdf(const float* w, size_t n, float* cdf)
+        {
+            double acc = 0.0;
+            size_t last = 0;
+            for (size_t k = 0; k < n; k++)
+            {
+                acc += w[k];
+                cdf[k] = (float)acc;
+                if (w[k] > 0.0f) last = k;
+            }
+            for (size_t k = last; k < n; k++) cdf[k] = 1.0f;
+        }
+
+        // Frame probabilities mix each frame's share of the raw weight with its share of the pixels by the
+        // floor, as its tile table does; tile tables are written a frame at a time from the plans
+        TailSect make_importance(const std::vector<FramePlan>& plans, const BuildConfig& cfg)
+        {
+            size_t N = plans.size();
+            uint32_t tile = importance_tile(cfg);
+            TailSect t{SectImportance, tile, {}, {}, {}, {}};
+            uint64_t frames_off = rup(sizeof(ImpHead) + sizeof(ImpRec) * N, 64);
+            t.data.resize(frames_off + sizeof(float) * 2 * N);
+            ImpHead head{tile, (uint32_t)cfg.importance, cfg.importance_floor, 0, N, frames_off};
+            std::memcpy(t.data.data(), &head, sizeof(head));
+            ImpRec* recs = (ImpRec*)(t.data.data() + sizeof(ImpHead));
+            float* weight = (float*)(t.data.data() + frames_off);
+            double total = 0.0;
+            double pixels = 0.0;
+            for (const FramePlan& p : plans)
+            {
+                total += p.imp_total;
+                pixels += (double)p.fr.width * p.fr.height;
+            }
+            double fl = total > 0.0 ? cfg.importance_floor : 1.0;
+            uint64_t off = rup(t.data.size(), 64);
+            for (size_t i = 0; i < N; i++)
+            {
+                const FramePlan& p = plans[i];
+                double w = total > 0.0 ? p.imp_total / total : 0.0;
+                weight[i] = (float)((1.0 - fl) * w + fl * (double)p.fr.width * p.fr.height / pixels);
+                uint32_t tx = (p.fr.width + tile - 1) / tile;
+                uint32_t ty = (p.fr.height + tile - 1) / tile;
+                recs[i] = ImpRec{off, p.imp_total, tx, ty};
+                t.piece_off.push_back(off);
+                t.piece_bytes.push_back(sizeof(float) * 2 * p.imp.size());
+                off = rup(off + sizeof(float) * 2 * p.imp.size(), 64);
+            }
+            prefix_cdf(weight, N, weight + N);
+            t.gen = [&plans](size_t i, unsigned char* dst)
+            {
+                const std::vector<float>& w = plans[i].imp;
+                std::memcpy(dst, w.data(), sizeof(float) * w.size());
+                prefix_cdf(w.data(), w.size(), (float*)dst + w.size());
+            };
+            return t;
+        }
+
+        // Settings that change stored frame bytes; frames only carry over between packs that agree on them
+        uint64_t config_hash(const BuildConfig& cfg)
+        {
+            uint32_t key[10];
+            key[0] = (uint32_t)cfg.pixel_format;
+            key[1] = cfg.row_align;
+            key[2] = cfg.premultiply_alpha;
+            key[3] = cfg.mip_levels > 1 ? cfg.mip_levels : 1;
+            key[4] = (uint32_t)cfg.mip_filter;
+            key[5] = cfg.tile_size;
+            key[6] = cfg.compress_level;
+            std::memcpy(key + 7, cfg.background, sizeof(cfg.background));
+            uint32_t h = libdeflate_crc32(0, key, sizeof(key));
+            // Folded in only when set so uncropped packs keep the hash they always had
+            if (cfg.crop_alpha)
+            {
+                uint32_t crop[2] = {1, cfg.crop_margin};
+                h = libdeflate_crc32(h, crop, sizeof(crop));
+            }
+            if (cfg.importance != ImportanceSource::None)
+            {
+                uint32_t imp[3] = {(uint32_t)cfg.importance, importance_tile(cfg), 0};
+                std::memcpy(imp + 2, &cfg.importance_floor, sizeof(float));
+                h = libdeflate_crc32(h, imp, sizeof(imp));
+            }
+            return h;
+        }
+
+        bool stat_source(const std::string& path, SrcPrint& p)
+        {
+            std::error_code ec;
+            p.size = fs::file_size(path, ec);
+            if (ec) return false;
+            auto t = fs::last_write_time(path, ec);
+            if (ec) return false;
+            p.mtime_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(t.time_since_epoch()).count();
+            p.crc32 = 0;
+            return true;
+        }
+
+        bool crc_source(const std::string& path, uint32_t& crc)
+        {
+            detail::mmap_ro m = detail::mmap_file_ro(path);
+            if (!m.ptr) return false;
+            crc = libdeflate_crc32(0, m.ptr, m.bytes);
+            detail::munmap_file(m);
+            return true;
+        }
+
+        TailSect make_manifest(const BuildConfig& cfg, const NSMeta& meta)
+        {
+            size_t N = meta.items.size();
+            size_t recs = sizeof(ManifestHead) + sizeof(ManifestRec) * N;
+            size_t names = 0;
+            for (const auto& it : meta.items) names += it.path.size();
+            TailSect t{SectManifest, 0, {}, {}, {}, {}};
+            t.data.resize(recs + names);
+            ManifestHead mh{config_hash(cfg), N};
+            std::memcpy(t.data.data(), &mh, sizeof(mh));
+            uint64_t at = recs;
+            for (size_t i = 0; i < N; i++)
+            {
+                const NSItem& it = meta.items[i];
+                ManifestRec r{it.print.size, it.print.mtime_ns, at, (uint32_t)it.path.size(), it.print.crc32};
+                std::memcpy(t.data.data() + sizeof(ManifestHead) + sizeof(ManifestRec) * i, &r, sizeof(r));
+                std::memcpy(t.data.data() + at, it.path.data(), it.path.size());
+                at += it.path.size();
+            }
+            return t;
+        }
+
+        // CamSOA followed by its arrays, as laid out by plan_tables
+        uint32_t cam_crc(const CamSOA& cam, const CamTables& ct)
+        {
+            size_t N = ct.w.size();
+            uint32_t c = libdeflate_crc32(0, &cam, sizeof(cam));
+            c = libdeflate_crc32(c, ct.fx.data(), sizeof(float) * N);
+            c = libdeflate_crc32(c, ct.fy.data(), sizeof(float) * N);
+            c = libdeflate_crc32(c, ct.cx.data(), sizeof(float) * N);
+            c = libdeflate_crc32(c, ct.cy.data(), sizeof(float) * N);
+            c = libdeflate_crc32(c, ct.T.data(), sizeof(float) * 12 * N);
+            c = libdeflate_crc32(c, ct.w.data(), sizeof(uint32_t) * N);
+            c = libdeflate_crc32(c, ct.h.data(), sizeof(uint32_t) * N);
+            return libdeflate_crc32(c, ct.t.data(), sizeof(uint32_t) * N);
+        }
+
+        // Sized up front so the tail can be planned; fill_checksums writes it once everything else is known
+        TailSect make_checksums(size_t N, size_t sects)
+        {
+            TailSect t{SectChecksums, 0, {}, {}, {}, {}};
+            t.data.resize(sizeof(SumHead) + sizeof(SumSect) * sects + sizeof(uint32_t) * N);
+            return t;
+        }
+
+        // hdr must be final; dir and sect_crc cover the sections ahead of this one
+        void fill_checksums(TailSect& t, const Hdr& hdr, const SceneRec& scene, const CamSOA& cam, const CamTables& ct, const std::vector<FrameRec>& frs, const std::function<uint32_t(size_t)>& frame_crc, const std::vector<SectRec>& dir, const std::vector<uint32_t>& sect_crc)
+        {
+            size_t N = frs.size();
+            SumHead sh{};
+            sh.hdr_crc = libdeflate_crc32(0, &hdr, sizeof(hdr));
+            sh.scene_crc = libdeflate_crc32(0, &scene, sizeof(scene));
+            sh.cam_crc = cam_crc(cam, ct);
+            sh.frames_crc = libdeflate_crc32(0, frs.data(), sizeof(FrameRec) * N);
+            sh.sect_count = (uint32_t)sect_crc.size();
+            sh.frame_count = N;
+            unsigned char* p = t.data.data();
+            std::memcpy(p, &sh, sizeof(sh));
+            p += sizeof(sh);
+            for (size_t k = 0; k < sect_crc.size(); k++)
+            {
+                SumSect ss{dir[k].kind, sect_crc[k]};
+                std::memcpy(p, &ss, sizeof(ss));
+                p += sizeof(ss);
+            }
+            for (size_t i = 0; i < N; i++)
+            {
+                uint32_t c = frame_crc(i);
+                std::memcpy(p, &c, sizeof(uint32_t));
+                p += sizeof(uint32_t);
+            }
+        }
+
+        struct PrevSource
+        {
+            std::string path;
+            SrcPrint print;
+        };
+
+        bool read_manifest(const PackHandleImpl* h, uint64_t& cfg_hash, std::vector<PrevSource>& out)
+        {
+            const SectRec* sr = find_sect(h, SectManifest);
+            if (!sr || sr->bytes < sizeof(ManifestHead)) return false;
+            const char* p = h->base + sr->off;
+            ManifestHead mh;
+            std::memcpy(&mh, p, sizeof(mh));
+            if (mh.count != h->frames.size() || mh.count > (sr->bytes - sizeof(ManifestHead)) / sizeof(ManifestRec)) return false;
+            cfg_hash = mh.config_hash;
+            out.resize(mh.count);
+            for (size_t i = 0; i < mh.count; i++)
+            {
+                ManifestRec r;
+                std::memcpy(&r, p + sizeof(ManifestHead) + sizeof(ManifestRec) * i, sizeof(r));
+                if (r.path_off > sr->bytes || r.path_len > sr->bytes - r.path_off) return false;
+                out[i].path.assign(p + r.path_off, r.path_len);
+                out[i].print = SrcPrint{r.size, r.mtime_ns, r.crc32};
+            }
+            return true;
+        }
+
+        // Frames an incremental build takes from an earlier pack instead of decoding them again
+        struct Reuse
+        {
+            const PackHandleImpl* old;
+            std::vector<int64_t> src; // per frame: index in old, -1 = decode
+            size_t reused;
+            // Frames of old keep their blocks where they are and everything new goes past its end
+            bool in_place;
+            uint64_t hashed_bytes; // sources read to fingerprint them
+        };
+
+        // Plan of frame j of an earlier pack renumbered as frame i, level offsets relative to its block
+        FramePlan reuse_plan(const PackHandleImpl* h, size_t j, size_t i)
+        {
+            FramePlan p{};
+            p.fr = h->frames[j];
+            p.fr.camera_id = (uint32_t)i;
+            uint32_t levels = h->mips ? std::min(p.fr.mip_levels, h->mip_stride) : 1;
+            p.lv.resize(levels);
+            for (uint32_t l = 0; l < levels; l++)
+            {
+                if (h->mips)
+                {
+                    p.lv[l] = h->mips[j * h->mip_stride + l];
+                    p.lv[l].off -= p.fr.pixel_off;
+                }
+                else
+                {
+                    p.lv[l] = MipRec{0, p.fr.roi_w, p.fr.roi_h, p.fr.row_stride, 0};
+                }
+            }
+            p.bytes = p.fr.block_bytes;
+            if (const ImpRec* r = importance_rec(h, j))
+            {
+                const float* w = (const float*)(h->imp + r->off);
+                p.imp.assign(w, w + (size_t)r->tiles_x * r->tiles_y);
+                p.imp_total = r->total;
+            }
+            // Carrying the old checksum over keeps corruption of the old pack detectable in the new one
+            p.crc = h->frame_crc ? h->frame_crc[j] : libdeflate_crc32(0, h->base + p.fr.pixel_off, p.fr.stored_bytes);
+            return p;
+        }
+
+        // True when rebuilding would write exactly what old already holds
+        bool pack_current(const BuildConfig& cfg, const NSMeta& meta, const Reuse& reuse)
+        {
+            const PackHandleImpl* old = reuse.old;
+            size_t N = meta.items.size();
+            if (reuse.reused != N || old->frames.size() != N) return false;
+            for (size_t i = 0; i < N; i++)
+            {
+                if (reuse.src[i] != (int64_t)i) return false;
+            }
+            Hdr hdr;
+            init_header(cfg, hdr);
+            const SectRec* sr = find_sect(old, SectManifest);
+            TailSect mf = make_manifest(cfg, meta);
+            if (hdr.caps_bits != old->hdr.caps_bits || !old->sums || !sr || sr->bytes != mf.data.size() || std::memcmp(old->base + sr->off, mf.data.data(), mf.data.size()) != 0) return false;
+            CamTables ct;
+            fill_camera_tables(meta, ct);
+            for (size_t i = 0; i < N; i++)
+            {
+                ct.w[i] = old->frames[i].width;
+                ct.h[i] = old->frames[i].height;
+            }
+            fill_intrinsics(meta, ct);
+            const CamSOA& c = old->cam;
+            auto same = [&](uint64_t off, const void* p, size_t n) { return off + n <= old->map.bytes && std::memcmp(old->base + off, p, n) == 0; };
+            return same(c.fx_off, ct.fx.data(), sizeof(float) * N) && same(c.fy_off, ct.fy.data(), sizeof(float) * N) &&
+                   same(c.cx_off, ct.cx.data(), sizeof(float) * N) && same(c.cy_off, ct.cy.data(), sizeof(float) * N) &&
+                   same(c.T_off, ct.T.data(), sizeof(float) * 12 * N);
+        }
+
+        // Bytes of old that an in-place update leaves behind unreferenced: superseded tables and sections
+        uint64_t dead_bytes(const PackHandleImpl* old)
+        {
+            size_t N = old->frames.size();
+            uint64_t live = old->hdr.pixels_off + sizeof(CamSOA) + (sizeof(float) * 16 + sizeof(uint32_t) * 3 + sizeof(FrameRec)) * N;
+            for (const auto& fr : old->frames) live += fr.stored_bytes;
+            const SectRec* dir = old->hdr.sect_count ? (const SectRec*)(old->base + old->hdr.sects_off) : nullptr;
+            for (uint32_t k = 0; k < old->hdr.sect_count; k++) live += dir[k].bytes;
+            return old->map.bytes > live ? old->map.bytes - live : 0;
+        }
+
+        // Records every source's size and mtime and matches them against the manifest of old (when given). Only
+        // a source whose size matches but whose mtime moved is hashed here, where its CRC-32 decides reuse;
+        // every other CRC is taken by the decode pass from the bytes it reads anyway.
+        bool fingerprint_sources(const BuildConfig& cfg, NSMeta& meta, const PackHandleImpl* old, Reuse& reuse)
+        {
+            size_t N = meta.items.size();
+            std::vector<PrevSource> prev;
+            uint64_t prev_cfg = 0;
+            if (old && (!read_manifest(old, prev_cfg, prev) || prev_cfg != config_hash(cfg))) prev.clear();
+            std::unordered_map<std::string, size_t> by_path;
+            for (size_t j = 0; j < prev.size(); j++) by_path.emplace(prev[j].path, j);
+            reuse = Reuse{old, std::vector<int64_t>(N, -1), 0, false, 0};
+            std::atomic<bool> failed{false};
+            std::atomic<size_t> reused{0};
+            std::atomic<uint64_t> hashed{0};
+            detail::parallel_for(N, worker_count(cfg), [&](size_t i)
+            {
+                NSItem& it = meta.items[i];
+                if (failed.load(std::memory_order_relaxed)) return;
+                if (!stat_source(it.path, it.print))
+                {
+                    failed.store(true, std::memory_order_relaxed);
+                    return;
+                }
+                auto f = by_path.find(it.path);
+                const SrcPrint* was = f != by_path.end() && prev[f->second].print.size == it.print.size ? &prev[f->second].print : nullptr;
+                if (!was) return;
+                if (was->mtime_ns == it.print.mtime_ns)
+                {
+                    it.print.crc32 = was->crc32;
+                }
+                else
+                {
+                    if (!crc_source(it.path, it.print.crc32))
+                    {
+                        failed.store(true, std::memory_order_relaxed);
+                        return;
+                    }
+                    hashed.fetch_add(it.print.size, std::memory_order_relaxed);
+                    if (was->crc32 != it.print.crc32) return;
+                }
+                if (!frame_ok(reuse.old, f->second)) return;
+                if (cfg.importance != ImportanceSource::None && !importance_rec(reuse.old, f->second)) return;
+                reuse.src[i] = (int64_t)f->second;
+                reused.fetch_add(1, std::memory_order_relaxed);
+            });
+            if (failed.load())
+            {
+                set_error(Error::IoFail);
+                return false;
+            }
+            reuse.reused = reused.load();
+            reuse.hashed_bytes = hashed.load();
+            if (!reuse.reused) return true;
+            size_t M = old->frames.size();
+            reuse.in_place = N >= M;
+            for (size_t i = 0; i < M && reuse.in_place; i++) reuse.in_place = reuse.src[i] == (int64_t)i;
+            return true;
+        }
+
+        // Shard files of an index pack being written: contiguous runs of frames, cut where the running size comes
+        // closest to an even share of the bytes
+        struct ShardSet
+        {
+            std::vector<size_t> cut; // shard k holds frames [cut[k], cut[k + 1])
+            std::vector<std::string> paths;
+            std::vector<ShardRec> recs;
+            std::vector<uint32_t> owner; // per frame
+            uint64_t head; // ShardHdr area before the first block
+            uint64_t pack_id;
+        };
+
+        ShardSet plan_shards(const std::string& index_path, const std::vector<uint64_t>& bytes, uint32_t K, uint32_t block_align)
+        {
+            size_t N = bytes.size();
+            ShardSet ss;
+            std::vector<uint64_t> acc(N + 1, 0);
+            for (size_t i = 0; i < N; i++) acc[i + 1] = acc[i] + rup(bytes[i], block_align);
+            ss.cut.assign(K + 1, 0);
+            ss.cut[K] = N;
+            for (uint32_t k = 1; k < K; k++)
+            {
+                uint64_t target = acc[N] / K * k + acc[N] % K * k / K;
+                size_t c = (size_t)(std::lower_bound(acc.begin(), acc.end(), target) - acc.begin());
+                if (c > 0 && target - acc[c - 1] < acc[c] - target) c--;
+                ss.cut[k] = std::clamp(c, ss.cut[k - 1] + 1, N - (K - k));
+            }
+            ss.recs.resize(K);
+            ss.owner.resize(N);
+            fs::path dir = fs::path(index_path).parent_path();
+            std::string stem = fs::path(index_path).filename().string();
+            for (uint32_t k = 0; k < K; k++)
+            {
+                ss.paths.push_back((dir / (stem + ".shard" + std::to_string(k))).string());
+                ss.recs[k].frame_count = ss.cut[k + 1] - ss.cut[k];
+                for (size_t i = ss.cut[k]; i < ss.cut[k + 1]; i++) ss.owner[i] = k;
+            }
+            ss.head = rup(sizeof(ShardHdr), block_align);
+            ss.pack_id = 0;
+            return ss;
+        }
+
+        // The SectShards section, sized for ss; place_shards fills it in
+        TailSect make_shard_sect(ShardSet& ss)
+        {
+            uint32_t K = (uint32_t)ss.recs.size();
+            uint64_t name_off = rup(sizeof(ShardHead) + sizeof(ShardRec) * K, 8) + sizeof(uint32_t) * ss.owner.size();
+            for (uint32_t k = 0; k < K; k++)
+            {
+                ss.recs[k].name_off = name_off;
+                ss.recs[k].name_len = (uint32_t)fs::path(ss.paths[k]).filename().string().size();
+                name_off += ss.recs[k].name_len;
+            }
+            return TailSect{SectShards, K, std::vector<unsigned char>(name_off), {}, {}, {}};
+        }
+
+        // Gives the shards their slots past the index's end, moves frame blocks from shard offsets to the pack's
+        // address range and fills in the section; recs[k].bytes must be final
+        void place_shards(ShardSet& ss, uint64_t index_end, std::vector<FrameRec>& frs, TailSect& t)
+        {
+            uint32_t K = (uint32_t)ss.recs.size();
+            size_t N = frs.size();
+            uint64_t slot = rup(index_end, kShardSlotAlign);
+            for (uint32_t k = 0; k < K; k++)
+            {
+                ss.recs[k].virt_off = slot;
+                slot = rup(slot + ss.recs[k].bytes, kShardSlotAlign);
+            }
+            for (size_t i = 0; i < N; i++) frs[i].pixel_off += ss.recs[ss.owner[i]].virt_off;
+            ss.pack_id = (uint64_t)libdeflate_crc32(0, frs.data(), sizeof(FrameRec) * N) << 32 | libdeflate_crc32(0, ss.recs.data(), sizeof(ShardRec) * K);
+            ShardHead sh{};
+            sh.pack_id = ss.pack_id;
+            sh.shard_count = K;
+            sh.frame_count = N;
+            sh.map_off = rup(sizeof(ShardHead) + sizeof(ShardRec) * K, 8);
+            unsigned char* sp = t.data.data();
+            std::memcpy(sp, &sh, sizeof(sh));
+            std::memcpy(sp + sizeof(sh), ss.recs.data(), sizeof(ShardRec) * K);
+            std::memcpy(sp + sh.map_off, ss.owner.data(), sizeof(uint32_t) * N);
+            for (uint32_t k = 0; k < K; k++)
+            {
+                std::string name = fs::path(ss.paths[k]).filename().string();
+                std::memcpy(sp + ss.recs[k].name_off, name.data(), name.size());
+            }
+        }
+
+        // Goes in once the shard's blocks are all written, so a shard cut short never passes for a whole one
+        bool write_shard_header(const ShardSet& ss, uint32_t k)
+        {
+            ShardHdr sf{};
+            std::memcpy(sf.magic, "HPS1", 4);
+            sf.version = kShardVersion;
+            sf.pack_id = ss.pack_id;
+            sf.shard = k;
+            sf.shard_count = (uint32_t)ss.recs.size();
+            sf.bytes = ss.recs[k].bytes;
+            std::fstream out(ss.paths[k], std::ios::binary | std::ios::in | std::ios::out);
+            return out && !write_exact(out, &sf, sizeof(sf)) && (bool)out.flush();
+        }
+
+        void remove_shards(const ShardSet& ss)
+        {
+            std::error_code ec;
+            for (const std::string& path : ss.paths) fs::remove(path, ec);
+        }
+
+        // With reuse, frames it maps to an earlier pack are copied from there (or, in place, left where they
+        // are) instead of being decoded. With shards, out_path becomes their index and every frame block goes
+        // straight to its shard's file.
+        int build_stream(const BuildConfig& cfg, NSMeta& meta, const std::string& out_path, const Reuse* reuse, ShardSet* shards, BuildTrace* tr)
+        {
+            size_t N = meta.items.size();
+            StageTimer wt(tr);
+            bool in_place = reuse && reuse->in_place;
+            std::fstream fo(out_path, in_place ? std::ios::binary | std::ios::in | std::ios::out : std::ios::binary | std::ios::out | std::ios::trunc);
+            if (!fo)
+            {
+                set_error(Error::IoFail);
+                return -1;
+            }
+            Hdr hdr;
+            CamSOA cam;
+            init_header(cfg, hdr);
+            if (shards) hdr.caps_bits |= CapSharded;
+            plan_sections(N, cfg.block_align, hdr, cam);
+            std::vector<detail::CopyRange> copies;
+            uint64_t written = 0;
+
+            auto wr_in = [&](std::ostream& o, const void* p, size_t n)
+            {
+                written += n;
+                return write_exact(o, p, n);
+            };
+            auto wr = [&](const void* p, size_t n)
+            {
+                return wr_in(fo, p, n);
+            };
+
+            auto pad_in = [&](std::ostream& o, size_t off)
+            {
+                size_t cur = (size_t)o.tellp();
+                static const char z[64] = {0};
+                while (cur < off)
+                {
+                    size_t m = off - cur > 64 ? 64 : off - cur;
+                    wr_in(o, z, m);
+                    cur += m;
+                }
+            };
+            auto pad_to = [&](size_t off)
+            {
+                pad_in(fo, off);
+            };
+
+            // Shard files are filled one after another as the writer reaches their first frame, each ending on a
+            // block boundary; their headers go in once the index is laid out
+            std::ofstream so;
+            uint32_t shard_open = 0;
+            auto end_shard = [&]
+            {
+                if (!so.is_open()) return true;
+                pad_in(so, rup((size_t)so.tellp(), cfg.block_align));
+                shards->recs[shard_open].bytes = (uint64_t)so.tellp();
+                so.close();
+                return !so.fail();
+            };
+            auto to_shard = [&](uint32_t k)
+            {
+                if (so.is_open() && k == shard_open) return true;
+                if (!end_shard()) return false;
+                so.clear();
+                so.open(shards->paths[k], std::ios::binary | std::ios::trunc);
+                shard_open = k;
+                pad_in(so, shards->head);
+                return (bool)so;
+            };
+            SceneRec scene = default_scene();
+            CamTables ct;
+            fill_camera_tables(meta, ct);
+            auto write_cam_arrays = [&]
+            {
+                wr(ct.fx.data(), sizeof(float) * N);
+                wr(ct.fy.data(), sizeof(float) * N);
+                wr(ct.cx.data(), sizeof(float) * N);
+                wr(ct.cy.data(), sizeof(float) * N);
+                wr(ct.T.data(), sizeof(float) * 12 * N);
+                wr(ct.w.data(), sizeof(uint32_t) * N);
+                wr(ct.h.data(), sizeof(uint32_t) * N);
+                wr(ct.t.data(), sizeof(uint32_t) * N);
+            };
+            std::vector<FrameRec> frs(N);
+            if (in_place)
+            {
+                // Everything goes past the current end; the old tables and tail become dead space once the
+                // header moves over
+                const PackHandleImpl* old = reuse->old;
+                hdr.scene_off = old->hdr.scene_off;
+                hdr.pixels_off = old->hdr.pixels_off;
+                scene = old->scene;
+                fo.seekp(0, std::ios::end);
+                pad_to(rup((size_t)fo.tellp(), cfg.block_align));
+            }
+            else
+            {
+                // Reserve space for header at the beginning
+                fo.seekp(sizeof(Hdr), std::ios::beg);
+                pad_to(hdr.scene_off);
+                wr(&scene, sizeof(scene));
+
+                pad_to(hdr.cam_off);
+                wr(&cam, sizeof(cam));
+                // Image sizes are only known once frames are decoded; the tables are rewritten at the end
+                write_cam_arrays();
+
+                pad_to(hdr.frames_off);
+                wr(frs.data(), sizeof(FrameRec) * N);
+                pad_to(hdr.pixels_off);
+            }
+
+            PixelEncode enc = make_encode(cfg);
+            // What frames read outside a cropped ROI, for the importance pass
+            TailSect fill = make_fill(enc);
+            wt.lap(BuildStage::Write, 0, written, 0);
+
+            // Decode and conversion run on the worker threads while this thread writes finished frames in
+            // manifest order. Every in-flight frame holds its decoded and converted bytes against the memory
+            // budget; the frame the writer waits on is always admitted so the pipeline cannot stall.
+            struct Slot
+            {
+                std::vector<unsigned char> block;
+                size_t charge;
+                bool ready;
+                bool failed;
+                bool reused;
+            };
+            std::vector<Slot> slots(N);
+            std::vector<FramePlan> plans(N);
+            uint64_t budget = cfg.memory_budget ? cfg.memory_budget : kDefaultMemoryBudget;
+            uint64_t in_flight = 0;
+            size_t cursor = 0;
+            bool abort = false;
+            std::mutex mu;
+            std::condition_variable cv_budget;
+            std::condition_variable cv_ready;
+
+            std::atomic<size_t> next{0};
+            uint32_t th = worker_count(cfg);
+            auto pipeline0 = std::chrono::steady_clock::now();
+            // Each item of the arena pulls whole frames in manifest order; with fewer frames than threads the
+            // spare ones work on row bands. The arena is driven from its own thread so this one can write.
+            std::thread pool([&]
+            {
+                detail::parallel_for(std::min<size_t>(th, N), th, [&](size_t)
+                {
+                    Compressor comp(cfg.compress_level);
+                    for (;;)
+                    {
+                        size_t i = next.fetch_add(1, std::memory_order_relaxed);
+                        if (i >= N) break;
+                        size_t charge = 0;
+                        FramePlan& p = plans[i];
+                        StageTimer st(tr);
+                        double idle = 0;
+                        if (reuse && reuse->src[i] >= 0)
+                        {
+                            p = reuse_plan(reuse->old, (size_t)reuse->src[i], i);
+                            ct.w[i] = p.fr.width;
+                            ct.h[i] = p.fr.height;
+                            std::lock_guard<std::mutex> lk(mu);
+                            slots[i].reused = true;
+                            slots[i].ready = true;
+                            cv_ready.notify_one();
+                            continue;
+                        }
+                        bool exr = is_exr(meta.items[i].path);
+                        auto admit = [&](uint32_t w, uint32_t h)
+                        {
+                            p = plan_frame(i, w, h, cfg, enc);
+                            charge = (size_t)w * h * 4 + p.bytes + p.lin_bytes;
+                            // Cropped EXR frames are read whole as float RGBA to find their bounds
+                            if (exr && cfg.crop_alpha) charge += (size_t)w * h * 12;
+                            // Mip generation keeps two float levels alive
+                            if (p.fr.mip_levels > 1) charge += (size_t)w * h * 20;
+                            if (comp.c) charge += libdeflate_deflate_compress_bound(comp.c, p.bytes);
+                            auto t0 = std::chrono::steady_clock::now();
+                            std::unique_lock<std::mutex> lk(mu);
+                            cv_budget.wait(lk, [&] { return abort || i == cursor || in_flight + charge <= budget; });
+                            idle += std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+                            if (abort) return false;
+                            in_flight += charge;
+                            return true;
+                        };
+                        std::vector<unsigned char> block;
+                        bool ok = false;
+                        if (exr)
+                        {
+                            uint32_t w = 0;
+                            uint32_t h = 0;
+                            detail::ExrSrc* s = detail::exr_open(meta.items[i].path);
+                            if (s)
+                            {
+                                detail::exr_size(s, w, h);
+                                meta.items[i].print.crc32 = exr_crc(s);
+                            }
+                            if (s && admit(w, h))
+                            {
+                                std::vector<float> rgba;
+                                if (cfg.crop_alpha)
+                                {
+                                    rgba.resize((size_t)w * h * 4);
+                                    ok = detail::exr_read(s, 0, h, false, 4, 16, (size_t)w * 16, rgba.data());
+                                    st.lap(BuildStage::Decode, meta.items[i].print.size, rgba.size() * sizeof(float), 1, idle);
+                                    PixelRect b{};
+                                    bool found = ok && alpha_bounds(rgba.data(), w, h, (size_t)w * 4, b);
+                                    p = plan_frame(i, w, h, crop_rect(cfg, found, b, w, h), cfg, enc);
+                                }
+                                std::vector<unsigned char> lin(p.lin_bytes);
+                                block.resize(p.bytes);
+                                unsigned char* base = cfg.tile_size ? lin.data() : block.data();
+                                const FrameRec& fr = cfg.tile_size ? p.lin_fr : p.fr;
+                                uint64_t level0 = (uint64_t)fr.row_stride * fr.roi_h;
+                                if (!cfg.crop_alpha)
+                                {
+                                    ok = decode_exr_into(s, fr, enc, base);
+                                    st.lap(BuildStage::Decode, meta.items[i].print.size, level0, 1, idle);
+                                }
+                                else if (ok)
+                                {
+                                    convert_roi_f32(rgba.data(), w, fr, enc, base);
+                                    rgba = std::vector<float>();
+                                }
+                                if (ok)
+                                {
+                                    finish_frame(p, cfg, enc, base, block.data());
+                                    st.lap(BuildStage::Convert, level0, p.bytes);
+                                }
+                            }
+                            if (s) detail::exr_close(s);
+                        }
+                        else
+                        {
+                            PngImg img = decode_png_rgba8(meta.items[i].path, meta.items[i].print.crc32, admit);
+                            ok = img.w != 0;
+                            uint64_t decoded = img.rgba.size();
+                            st.lap(BuildStage::Decode, meta.items[i].print.size, decoded, 1, idle);
+                            if (ok && cfg.crop_alpha)
+                            {
+                                uint32_t w = (uint32_t)img.w;
+                                uint32_t h = (uint32_t)img.h;
+                                PixelRect b{};
+                                bool found = alpha_bounds(img.rgba.data(), w, h, (size_t)w * 4, b);
+                                PixelRect r = crop_rect(cfg, found, b, w, h);
+                                p = plan_frame(i, w, h, r, cfg, enc);
+                                crop_rgba8(img, r);
+                            }
+                            if (ok && raw_rgba8(enc) && !cfg.tile_size && p.bytes == img.rgba.size())
+                            {
+                                block = std::move(img.rgba);
+                            }
+                            else if (ok)
+                            {
+                                std::vector<unsigned char> lin(p.lin_bytes);
+                                block.resize(p.bytes);
+                                unsigned char* base = cfg.tile_size ? lin.data() : block.data();
+                                convert_frame(img, enc, cfg.tile_size ? p.lin_fr.row_stride : p.fr.row_stride, base);
+                                img = PngImg{};
+                                finish_frame(p, cfg, enc, base, block.data());
+                            }
+                            if (ok) st.lap(BuildStage::Convert, decoded, p.bytes);
+                        }
+                        if (ok && cfg.importance != ImportanceSource::None)
+                        {
+                            importance_weights(plan_view(p, cfg, enc, block.data(), fill.data.data()), cfg, enc.premultiply, p);
+                            st.lap(BuildStage::Convert, p.bytes, 0, 0);
+                        }
+                        if (ok)
+                        {
+                            if (comp.c) deflate_block(comp.c, block, p.fr);
+                            p.crc = libdeflate_crc32(0, block.data(), block.size());
+                            st.lap(BuildStage::Compress, p.bytes, block.size());
+                            ct.w[i] = p.fr.width;
+                            ct.h[i] = p.fr.height;
+                        }
+                        std::lock_guard<std::mutex> lk(mu);
+                        slots[i].failed = !ok;
+                        slots[i].block = std::move(block);
+                        slots[i].charge = charge;
+                        slots[i].ready = true;
+                        cv_ready.notify_one();
+                    }
+                });
+            });
+            auto stop = [&]
+            {
+                {
+                    std::lock_guard<std::mutex> lk(mu);
+                    abort = true;
+                }
+                cv_budget.notify_all();
+                pool.join();
+            };
+
+            for (size_t i = 0; i < N; i++)
+            {
+                std::vector<unsigned char> block;
+                size_t charge = 0;
+                bool reused = false;
+                {
+                    std::unique_lock<std::mutex> lk(mu);
+                    cv_ready.wait(lk, [&] { return slots[i].ready; });
+                    reused = slots[i].reused;
+                    if (slots[i].failed)
+                    {
+                        lk.unlock();
+                        stop();
+                        set_error(Error::IoFail);
+                        return -1;
+                    }
+                    block = std::move(slots[i].block);
+                    charge = slots[i].charge;
+                }
+                wt.restart();
+                uint64_t before = written;
+                if (reused && in_place && reuse->src[i] == (int64_t)i)
+                {
+                    // Already in the file
+                }
+                else if (reused)
+                {
+                    // Filled in once the stream is flushed; leave a hole for now
+                    uint64_t at = (uint64_t)fo.tellp();
+                    copies.push_back(detail::CopyRange{plans[i].fr.pixel_off, at, plans[i].fr.stored_bytes});
+                    plans[i].fr.pixel_off = at;
+                    fo.seekp((std::streamoff)(at + plans[i].fr.stored_bytes), std::ios::beg);
+                    pad_to(rup((size_t)fo.tellp(), cfg.block_align));
+                }
+                else if (shards)
+                {
+                    // Offset in the shard file for now; place_shards moves it into the pack's address range
+                    if (!to_shard(shards->owner[i]))
+                    {
+                        stop();
+                        set_error(Error::IoFail);
+                        return -1;
+                    }
+                    plans[i].fr.pixel_off = (uint64_t)so.tellp();
+                    wr_in(so, block.data(), block.size());
+                    pad_in(so, rup((size_t)so.tellp(), cfg.block_align));
+                }
+                else
+                {
+                    plans[i].fr.pixel_off = (uint64_t)fo.tellp();
+                    wr(block.data(), block.size());
+                    pad_to(rup((size_t)fo.tellp(), cfg.block_align));
+                }
+                frs[i] = plans[i].fr;
+                wt.lap(BuildStage::Write, block.size(), written - before, reused ? 0 : 1);
+                block = std::vector<unsigned char>();
+                {
+                    std::lock_guard<std::mutex> lk(mu);
+                    in_flight -= charge;
+                    cursor = i + 1;
+                }
+                cv_budget.notify_all();
+                if (!fo || (shards && !so))
+                {
+                    stop();
+                    set_error(Error::IoFail);
+                    return -1;
+                }
+            }
+            pool.join();
+            if (shards && !end_shard())
+            {
+                set_error(Error::IoFail);
+                return -1;
+            }
+            if (tr)
+            {
+                size_t n_reused = 0;
+                for (const Slot& sl : slots) n_reused += sl.reused;
+                std::lock_guard<std::mutex> lk(tr->mu);
+                tr->out->pipeline_seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - pipeline0).count();
+                tr->out->frames_built += N - n_reused;
+                tr->out->frames_reused += n_reused;
+            }
+            wt.restart();
+            uint64_t tail0 = written;
+
+            fill_intrinsics(meta, ct);
+            if (in_place)
+            {
+                plan_tables(N, rup((size_t)fo.tellp(), cfg.block_align), cfg.block_align, hdr, cam);
+                pad_to(hdr.cam_off);
+                wr(&cam, sizeof(cam));
+                write_cam_arrays();
+                pad_to(hdr.frames_off);
+                wr(frs.data(), sizeof(FrameRec) * N);
+            }
+            std::vector<TailSect> tail;
+            if (cfg.mip_levels > 1) tail.push_back(make_mip_table(plans));
+            if (cfg.ray_table) tail.push_back(make_ray_table(ct, scene));
+            if (cfg.crop_alpha) tail.push_back(fill);
+            if (cfg.importance != ImportanceSource::None) tail.push_back(make_importance(plans, cfg));
+            tail.push_back(make_manifest(cfg, meta));
+            if (shards) tail.push_back(make_shard_sect(*shards));
+            tail.push_back(make_checksums(N, tail.size()));
+            std::vector<SectRec> dir;
+            size_t cur = (size_t)plan_tail((uint64_t)fo.tellp(), cfg.block_align, tail, dir, hdr);
+            hdr.end_off = (uint64_t)cur;
+            hdr.bytes_total = hdr.end_off;
+            if (shards)
+            {
+                // Shard slots follow the index in the address range open reserves
+                place_shards(*shards, hdr.end_off, frs, tail[tail.size() - 2]);
+                for (size_t i = 0; i < N; i++) plans[i].fr.pixel_off = frs[i].pixel_off;
+                if (cfg.mip_levels > 1) tail[0] = make_mip_table(plans);
+            }
+            // Section checksums cover their whole extent, the zero gaps between pieces included
+            std::vector<uint32_t> sect_crc;
+            auto pad_sum = [&](size_t off, uint32_t& crc)
+            {
+                static const unsigned char z[64] = {0};
+                for (size_t at = (size_t)fo.tellp(); at < off; at += 64) crc = libdeflate_crc32(crc, z, off - at > 64 ? 64 : off - at);
+                pad_to(off);
+            };
+            for (size_t k = 0; k < tail.size(); k++)
+            {
+                if (tail[k].kind == SectChecksums) fill_checksums(tail[k], hdr, scene, cam, ct, frs, [&](size_t i) { return plans[i].crc; }, dir, sect_crc);
+                pad_to(dir[k].off);
+                wr(tail[k].data.data(), tail[k].data.size());
+                uint32_t crc = libdeflate_crc32(0, tail[k].data.data(), tail[k].data.size());
+                std::vector<unsigned char> piece;
+                for (size_t j = 0; j < tail[k].piece_off.size(); j++)
+                {
+                    pad_sum(dir[k].off + tail[k].piece_off[j], crc);
+                    piece.resize(tail[k].piece_bytes[j]);
+                    tail[k].gen(j, piece.data());
+                    wr(piece.data(), piece.size());
+                    crc = libdeflate_crc32(crc, piece.data(), piece.size());
+                }
+                sect_crc.push_back(crc);
+            }
+            if (!dir.empty())
+            {
+                pad_to(hdr.sects_off);
+                wr(dir.data(), sizeof(SectRec) * dir.size());
+            }
+            pad_to(cur);
+            if (!in_place)
+            {
+                fo.seekp(cam.fx_off, std::ios::beg);
+                write_cam_arrays();
+                fo.seekp(hdr.frames_off, std::ios::beg);
+                wr(frs.data(), sizeof(FrameRec) * N);
+            }
+            fo.flush();
+            if (!fo || (!copies.empty() && !detail::copy_ranges(reuse->old->map, out_path, copies)))
+            {
+                set_error(Error::IoFail);
+                return -1;
+            }
+            for (uint32_t k = 0; shards && k < shards->recs.size(); k++)
+            {
+                if (!write_shard_header(*shards, k))
+                {
+                    set_error(Error::IoFail);
+                    return -1;
+                }
+            }
+            // The header goes in last so an interrupted append leaves the previous pack intact
+            fo.seekp(0, std::ios::beg);
+            wr(&hdr, sizeof(Hdr));
+            fo.flush();
+            if (!fo)
+            {
+                set_error(Error::IoFail);
+                return -1;
+            }
+            uint64_t copied = 0;
+            for (const auto& c : copies) copied += c.bytes;
+            wt.lap(BuildStage::Write, 0, written - tail0 + copied, 0);
+            return 0;
+        }
+
+        // config_path names a transforms JSON, a COLMAP sparse model directory or one of its .bin files. When it
+        // does not exist the manifest is looked for under the dataset root: transforms.json,
+        // transforms_train.json, then a COLMAP model in sparse/0 or sparse.
+        bool load_manifest(const BuildConfig& cfg, NSMeta& meta)
+        {
+            std::error_code ec;
+            fs::path root(cfg.dataset_root);
+            fs::path p(cfg.config_path);
+            if (!cfg.config_path.empty() && fs::exists(p, ec))
+            {
+                if (p.extension() == ".bin") p = p.parent_path();
+            }
+            else
+            {
+                const fs::path cand[] = {root / "transforms.json", root / "transforms_train.json", root / "sparse" / "0", root / "sparse"};
+                auto hit = std::find_if(std::begin(cand), std::end(cand), [&](const fs::path& c)
+                {
+                    return fs::is_directory(c, ec) ? fs::exists(c / "images.bin", ec) : fs::exists(c, ec);
+                });
+                if (hit == std::end(cand))
+                {
+                    set_error(Error::BadConfig);
+                    return false;
+                }
+                p = *hit;
+            }
+            std::vector<std::string> rel;
+            bool ok = fs::is_directory(p, ec) ? parse_colmap(p, meta, rel) : parse_transforms(p, meta, rel);
+            if (ok) resolve_paths(cfg.dataset_root, rel, meta.items, worker_count(cfg));
+            return ok;
+        }
+
+        bool load_build_meta(const BuildConfig& cfg, NSMeta& meta)
+        {
+            if (!load_manifest(cfg, meta)) return false;
+            bool tile_ok = cfg.tile_size == 0 || (cfg.tile_size >= 2 && cfg.tile_size <= 256 && (cfg.tile_size & (cfg.tile_size - 1)) == 0);
+            bool imp_ok = (uint32_t)cfg.importance <= (uint32_t)ImportanceSource::AlphaGradient && cfg.importance_floor >= 0.0f && cfg.importance_floor <= 1.0f;
+            if (meta.items.empty() || !pixel_format_bytes(cfg.pixel_format) || !tile_ok || !imp_ok || cfg.compress_level > 12)
+            {
+                set_error(Error::BadConfig);
+                return false;
+            }
+            // EXR frames decode on OpenEXR's own pool, sized like the build's
+            for (const auto& it : meta.items)
+            {
+                if (!is_exr(it.path)) continue;
+                uint32_t th = worker_count(cfg);
+                detail::exr_set_threads(th > 1 ? th : 0);
+                break;
+            }
+            return true;
+        }
+
+        // Reads the header and tables of the pack h->map holds. Only fixed-size structures and section bounds
+        // are checked here, so the cost does not depend on the frame count.
+        bool parse_pack(PackHandleImpl* h)
+        {
+            h->base = (const char*)h->map.ptr;
+            h->hdr = Hdr{};
+            std::memcpy(&h->hdr, h->base, h->map.bytes < sizeof(Hdr) ? h->map.bytes : sizeof(Hdr));
+            const Hdr& hd = h->hdr;
+            uint64_t size = h->map.bytes;
+            auto fits = [size](uint64_t off, uint64_t count, uint64_t elem, uint64_t align)
+            {
+                return off % align == 0 && off <= size && count <= (size - off) / elem;
+            };
+            const CamSOA& c = h->cam;
+            bool ok = size >= offsetof(Hdr, sects_off) && std::memcmp(hd.magic, "HPK1", 4) == 0 && hd.version >= 2 && hd.version <= kHdrVersion
+                && (hd.version < 3 || size >= sizeof(Hdr))
+                && fits(hd.scene_off, 1, sizeof(SceneRec), 1) && fits(hd.cam_off, 1, sizeof(CamSOA), 1);
+            if (ok)
+            {
+                std::memcpy(&h->scene, h->base + hd.scene_off, sizeof(SceneRec));
+                std::memcpy(&h->cam, h->base + hd.cam_off, sizeof(CamSOA));
+                size_t rec = hd.version < 4 ? kFrameRecV3Bytes : sizeof(FrameRec);
+                ok = fits(hd.frames_off, c.count, rec, alignof(FrameRec)) && fits(c.T_off, c.count, 12 * sizeof(float), alignof(float));
+                for (uint64_t off : {c.fx_off, c.fy_off, c.cx_off, c.cy_off, c.w_off, c.h_off, c.time_off}) ok = ok && fits(off, c.count, sizeof(float), alignof(float));
+            }
+            // Version 2 headers end before the section directory
+            if (hd.version < 3)
+            {
+                h->hdr.sects_off = 0;
+                h->hdr.sect_count = 0;
+            }
+            ok = ok && (!hd.sect_count || fits(hd.sects_off, hd.sect_count, sizeof(SectRec), alignof(SectRec)));
+            for (uint32_t k = 0; ok && k < hd.sect_count; k++)
+            {
+                const SectRec& sr = ((const SectRec*)(h->base + hd.sects_off))[k];
+                ok = fits(sr.off, sr.bytes, 1, alignof(uint64_t));
+            }
+            if (!ok)
+            {
+                set_error(Error::BadPack);
+                return false;
+            }
+            size_t n = c.count;
+            if (hd.version < 4)
+            {
+                h->frames_v3.resize(n);
+                for (size_t i = 0; i < n; i++) std::memcpy(&h->frames_v3[i], h->base + hd.frames_off + kFrameRecV3Bytes * i, kFrameRecV3Bytes);
+                h->frames = h->frames_v3;
+            }
+            else
+            {
+                h->frames = std::span<const FrameRec>((const FrameRec*)(h->base + hd.frames_off), n);
+            }
+            h->cache.budget = kDefaultMemoryBudget;
+            if (const SectRec* sr = find_sect(h, SectMips))
+            {
+                if (sr->flags && sr->bytes / sr->flags / sizeof(MipRec) >= n)
+                {
+                    h->mips = (const MipRec*)(h->base + sr->off);
+                    h->mip_stride = sr->flags;
+                }
+            }
+            if (const SectRec* sr = find_sect(h, SectRays))
+            {
+                if (sr->bytes / sizeof(RayRec) >= n)
+                {
+                    h->rays = h->base + sr->off;
+                    h->rays_bytes = sr->bytes;
+                }
+            }
+            if (const SectRec* sr = find_sect(h, SectImportance); sr && sr->bytes >= sizeof(ImpHead))
+            {
+                const ImpHead* ih = (const ImpHead*)(h->base + sr->off);
+                uint64_t room = sr->bytes - sizeof(ImpHead);
+                bool fits = ih->frame_count == n && n <= room / sizeof(ImpRec) && ih->frames_off % 4 == 0 && ih->frames_off <= sr->bytes && n <= (sr->bytes - ih->frames_off) / 8;
+                if (fits && n)
+                {
+                    h->imp = h->base + sr->off;
+                    h->imp_bytes = sr->bytes;
+                }
+            }
+            // Frame checksums cover stored_bytes, which packs before version 4 do not record
+            if (const SectRec* sr = find_sect(h, SectChecksums); sr && hd.version >= 4 && sr->bytes >= sizeof(SumHead))
+            {
+                const SumHead* sh = (const SumHead*)(h->base + sr->off);
+                uint64_t room = sr->bytes - sizeof(SumHead);
+                if (sh->frame_count == n && sh->sect_count <= room / sizeof(SumSect) && n <= (room - sizeof(SumSect) * sh->sect_count) / sizeof(uint32_t))
+                {
+                    h->sums = sh;
+                    h->frame_crc = (const uint32_t*)((const SumSect*)(sh + 1) + sh->sect_count);
+                }
+            }
+            // Cropped frames read their fill outside the ROI, so it must be there
+            if (const SectRec* sr = find_sect(h, SectFill); sr && sr->bytes >= kFillBytes) h->fill = (const unsigned char*)(h->base + sr->off);
+            if (!h->fill && (hd.caps_bits & CapCropped))
+            {
+                set_error(Error::BadPack);
+                return false;
+            }
+            return true;
+        }
+
+        // Every source's image size from its header alone
+        bool probe_frames(const BuildConfig& cfg, const NSMeta& meta, std::vector<uint32_t>& w, std::vector<uint32_t>& h, BuildTrace* tr)
+        {
+            std::atomic<bool> failed{false};
+            detail::parallel_for(meta.items.size(), worker_count(cfg), [&](size_t i)
+            {
+                if (failed.load(std::memory_order_relaxed)) return;
+                StageTimer st(tr);
+                if (!probe_image(meta.items[i].path, w[i], h[i])) failed.store(true, std::memory_order_relaxed);
+                st.lap(BuildStage::Decode, 0, 0, 0);
+            });
+            if (failed.load())
+            {
+                set_error(Error::IoFail);
+                return false;
+            }
+            return true;
+        }
+
+        // Frame sizes come from the image headers, so the whole file can be laid out and sized before any
+        // pixel is decoded. Workers then decode straight into their frame's slot of a shared mapping.
+        int build_mapped(const BuildConfig& cfg, NSMeta& meta, const std::string& out_path, BuildTrace* tr)
+        {
+            size_t N = meta.items.size();
+            uint32_t th = worker_count(cfg);
+            CamTables ct;
+            fill_camera_tables(meta, ct);
+            std::atomic<bool> failed{false};
+            auto pipeline0 = std::chrono::steady_clock::now();
+            double pipeline = 0;
+            if (!probe_frames(cfg, meta, ct.w, ct.h, tr)) return -1;
+            pipeline += std::chrono::duration<double>(std::chrono::steady_clock::now() - pipeline0).count();
+            StageTimer wt(tr);
+            fill_intrinsics(meta, ct);
+
+            Hdr hdr;
+            CamSOA cam;
+            init_header(cfg, hdr);
+            plan_sections(N, cfg.block_align, hdr, cam);
+            PixelEncode enc = make_encode(cfg);
+            std::vector<FrameRec> frs(N);
+            std::vector<FramePlan> plans(N);
+            uint64_t off = hdr.pixels_off;
+            for (size_t i = 0; i < N; i++)
+            {
+                plans[i] = plan_frame(i, ct.w[i], ct.h[i], cfg, enc);
+                plans[i].fr.pixel_off = off;
+                frs[i] = plans[i].fr;
+                off = rup(off + plans[i].bytes, cfg.block_align);
+            }
+            SceneRec scene = default_scene();
+            std::vector<TailSect> tail;
+            if (cfg.mip_levels > 1) tail.push_back(make_mip_table(plans));
+            if (cfg.ray_table) tail.push_back(make_ray_table(ct, scene));
+            tail.push_back(make_manifest(cfg, meta));
+            tail.push_back(make_checksums(N, tail.size()));
+            std::vector<SectRec> dir;
+            off = plan_tail(off, cfg.block_align, tail, dir, hdr);
+            hdr.end_off = off;
+            hdr.bytes_total = hdr.end_off;
+
+            auto m = detail::mmap_file_rw(out_path, (size_t)hdr.end_off);
+            if (!m.ptr)
+            {
+                set_error(Error::IoFail);
+                return -1;
+            }
+            unsigned char* base = (unsigned char*)m.ptr;
+            std::memcpy(base + hdr.scene_off, &scene, sizeof(scene));
+            std::memcpy(base + hdr.cam_off, &cam, sizeof(cam));
+            std::memcpy(base + cam.fx_off, ct.fx.data(), sizeof(float) * N);
+            std::memcpy(base + cam.fy_off, ct.fy.data(), sizeof(float) * N);
+            std::memcpy(base + cam.cx_off, ct.cx.data(), sizeof(float) * N);
+            std::memcpy(base + cam.cy_off, ct.cy.data(), sizeof(float) * N);
+            std::memcpy(base + cam.T_off, ct.T.data(), sizeof(float) * 12 * N);
+            std::memcpy(base + cam.w_off, ct.w.data(), sizeof(uint32_t) * N);
+            std::memcpy(base + cam.h_off, ct.h.data(), sizeof(uint32_t) * N);
+            std::memcpy(base + cam.time_off, ct.t.data(), sizeof(uint32_t) * N);
+            std::memcpy(base + hdr.frames_off, frs.data(), sizeof(FrameRec) * N);
+            std::vector<uint32_t> sect_crc;
+            // The manifest and checksums wait for the decode pass, which takes the sources' CRC-32
+            for (size_t k = 0; k + 2 < tail.size(); k++)
+            {
+                std::memcpy(base + dir[k].off, tail[k].data.data(), tail[k].data.size());
+                const TailSect& t = tail[k];
+                // Pieces are timed where they run; this thread's lap stops around them
+                wt.lap(BuildStage::Write, 0, 0, 0);
+                detail::parallel_for(t.piece_off.size(), th, [&](size_t j)
+                {
+                    StageTimer pt(tr);
+                    t.gen(j, base + dir[k].off + t.piece_off[j]);
+                    pt.lap(BuildStage::Write, 0, t.piece_bytes[j], 0);
+                });
+                wt.restart();
+                sect_crc.push_back(libdeflate_crc32(0, base + dir[k].off, dir[k].bytes));
+            }
+            if (!dir.empty()) std::memcpy(base + hdr.sects_off, dir.data(), sizeof(SectRec) * dir.size());
+            wt.lap(BuildStage::Write, 0, 0, 0);
+            pipeline0 = std::chrono::steady_clock::now();
+
+            detail::parallel_for(N, th, [&](size_t i)
+            {
+                if (failed.load(std::memory_order_relaxed)) return;
+                StageTimer st(tr);
+                FramePlan& p = plans[i];
+                unsigned char* block = base + p.fr.pixel_off;
+                // Tiled frames are assembled in scanline order first and swizzled into the mapping
+                std::vector<unsigned char> lin(p.lin_bytes);
+                unsigned char* dst = cfg.tile_size ? lin.data() : block;
+                const FrameRec& fr = cfg.tile_size ? p.lin_fr : p.fr;
+                bool ok = decode_image_into(meta.items[i].path, fr, enc, dst, meta.items[i].print.crc32);
+                st.lap(BuildStage::Decode, meta.items[i].print.size, (uint64_t)fr.row_stride * fr.height);
+                if (!ok)
+                {
+                    failed.store(true, std::memory_order_relaxed);
+                    return;
+                }
+                finish_frame(p, cfg, enc, dst, block);
+                st.lap(BuildStage::Convert, (uint64_t)fr.row_stride * fr.height, p.bytes);
+                p.crc = libdeflate_crc32(0, block, p.bytes);
+                st.lap(BuildStage::Compress, p.bytes, p.bytes);
+            });
+            pipeline += std::chrono::duration<double>(std::chrono::steady_clock::now() - pipeline0).count();
+            wt.restart();
+            size_t mk = tail.size() - 2;
+            tail[mk] = make_manifest(cfg, meta);
+            std::memcpy(base + dir[mk].off, tail[mk].data.data(), tail[mk].data.size());
+            sect_crc.push_back(libdeflate_crc32(0, base + dir[mk].off, dir[mk].bytes));
+            fill_checksums(tail.back(), hdr, scene, cam, ct, frs, [&](size_t i) { return plans[i].crc; }, dir, sect_crc);
+            std::memcpy(base + dir.back().off, tail.back().data.data(), tail.back().data.size());
+            // The header goes in last so an interrupted build never looks like a valid pack
+            if (!failed.load()) std::memcpy(base, &hdr, sizeof(Hdr));
+            detail::munmap_file(m);
+            if (failed.load())
+            {
+                set_error(Error::IoFail);
+                return -1;
+            }
+            // Frames reach the file through the mapping, so the write stage is credited with the whole pack
+            wt.lap(BuildStage::Write, 0, hdr.end_off, N);
+            if (tr)
+            {
+                std::lock_guard<std::mutex> lk(tr->mu);
+                tr->out->pipeline_seconds += pipeline;
+                tr->out->frames_built += N;
+            }
+            return 0;
+        }
+
+        // Shard files are written first and the index last, through a temporary file, so an interrupted split
+        // never leaves an index pointing at shards that are not there; a failed one removes the shards it wrote
+        int split_pack(const std::string& src_path, const std::string& index_path, uint32_t K, uint32_t block_align, BuildTrace* tr)
+        {
+            if (block_align == 0) block_align = 4096;
+            if (K == 0 || (block_align & (block_align - 1)))
+            {
+                set_error(Error::BadConfig);
+                return -1;
+            }
+            StageTimer wt(tr);
+            PackHandle ph = open_hostpack(src_path);
+            if (!ph) return -1;
+            auto* h = (PackHandleImpl*)ph;
+            ShardSet ss;
+            auto fail = [&](Error e)
+            {
+                close_hostpack(ph);
+                remove_shards(ss);
+                set_error(e);
+                return -1;
+            };
+            // Index packs and archive scenes are not split again; packs before version 4 lack block sizes
+            if (h->frame_shards || h->owner || h->hdr.version < 4) return fail(Error::Unsupported);
+            size_t N = h->frames.size();
+            if (K > N) return fail(Error::BadConfig);
+            std::vector<uint64_t> ext(N);
+            for (size_t i = 0; i < N; i++)
+            {
+                if (!frame_ok(h, i)) return fail(Error::BadPack);
+                uint64_t off;
+                frame_extent(h, i, off, ext[i]);
+            }
+            ss = plan_shards(index_path, ext, K, block_align);
+            std::vector<FrameRec> frs(h->frames.begin(), h->frames.end());
+            std::vector<std::vector<detail::CopyRange>> copies(K);
+            for (uint32_t k = 0; k < K; k++)
+            {
+                uint64_t cur = ss.head;
+                for (size_t i = ss.cut[k]; i < ss.cut[k + 1]; i++)
+                {
+                    cur = rup(cur, block_align);
+                    copies[k].push_back(detail::CopyRange{frs[i].pixel_off, cur, ext[i]});
+                    frs[i].pixel_off = cur;
+                    cur += ext[i];
+                }
+                ss.recs[k].bytes = rup(cur, block_align);
+            }
+
+            // The index: the pack's tables and sections without pixel data, then the shard section
+            Hdr hdr = h->hdr;
+            hdr.caps_bits |= CapSharded;
+            CamSOA cam;
+            plan_sections(N, block_align, hdr, cam);
+            CamTables ct;
+            const CamSOA& sc = h->cam;
+            auto arr = [&](std::vector<float>& v, uint64_t off, size_t n) { v.assign((const float*)(h->base + off), (const float*)(h->base + off) + n); };
+            auto arr_u = [&](std::vector<uint32_t>& v, uint64_t off) { v.assign((const uint32_t*)(h->base + off), (const uint32_t*)(h->base + off) + N); };
+            arr(ct.fx, sc.fx_off, N);
+            arr(ct.fy, sc.fy_off, N);
+            arr(ct.cx, sc.cx_off, N);
+            arr(ct.cy, sc.cy_off, N);
+            arr(ct.T, sc.T_off, 12 * N);
+            arr_u(ct.w, sc.w_off);
+            arr_u(ct.h, sc.h_off);
+            arr_u(ct.t, sc.time_off);
+
+            std::vector<TailSect> tail;
+            const SectRec* sdir = (const SectRec*)(h->base + h->hdr.sects_off);
+            for (uint32_t k = 0; k < h->hdr.sect_count; k++)
+            {
+                const SectRec& sr = sdir[k];
+                if (sr.kind == SectChecksums || sr.kind == SectShards) continue;
+                TailSect t{sr.kind, sr.flags, {}, {}, {}, {}};
+                if (sr.kind == SectMips)
+                {
+                    // Level offsets are absolute and move with their frame
+                    t.data.assign(h->base + sr.off, h->base + sr.off + sr.bytes);
+                    MipRec* m = (MipRec*)t.data.data();
+                    uint32_t stride = sr.flags;
+                    for (size_t i = 0; stride && i < N && (i + 1) * stride * sizeof(MipRec) <= sr.bytes; i++)
+                    {
+                        for (uint32_t l = 0; l < std::min(h->frames[i].mip_levels, stride); l++) m[i * stride + l].off -= h->frames[i].pixel_off;
+                    }
+                }
+                else
+                {
+                    // Copied in 1 MiB pieces rather than held whole; ray tables grow with the pixel count
+                    const char* src = h->base + sr.off;
+                    for (uint64_t at = 0; at < sr.bytes; at += 1u << 20)
+                    {
+                        t.piece_off.push_back(at);
+                        t.piece_bytes.push_back(std::min<uint64_t>(sr.bytes - at, 1u << 20));
+                    }
+                    uint64_t bytes = sr.bytes;
+                    t.gen = [src, bytes](size_t j, unsigned char* dst)
+                    {
+                        uint64_t at = (uint64_t)j << 20;
+                        std::memcpy(dst, src + at, std::min<uint64_t>(bytes - at, 1u << 20));
+                    };
+                }
+                tail.push_back(std::move(t));
+            }
+            tail.push_back(make_shard_sect(ss));
+            size_t shard_sect = tail.size() - 1;
+            bool sums = h->sums && h->frame_crc;
+            if (sums) tail.push_back(make_checksums(N, tail.size()));
+            std::vector<SectRec> dir;
+            uint64_t end = plan_tail(hdr.pixels_off, block_align, tail, dir, hdr);
+            hdr.end_off = end;
+            hdr.bytes_total = end;
+            // Shard slots follow the index in the address range open reserves
+            place_shards(ss, end, frs, tail[shard_sect]);
+            for (TailSect& t : tail)
+            {
+                if (t.kind != SectMips) continue;
+                MipRec* m = (MipRec*)t.data.data();
+                uint32_t stride = t.flags;
+                for (size_t i = 0; stride && i < N && (i + 1) * stride * sizeof(MipRec) <= t.data.size(); i++)
+                {
+                    for (uint32_t l = 0; l < std::min(frs[i].mip_levels, stride); l++) m[i * stride + l].off += frs[i].pixel_off;
+                }
+            }
+
+            uint64_t written = 0;
+            for (uint32_t k = 0; k < K; k++)
+            {
+                bool ok = (bool)std::ofstream(ss.paths[k], std::ios::binary | std::ios::trunc);
+                std::error_code ec;
+                if (ok) fs::resize_file(ss.paths[k], ss.recs[k].bytes, ec);
+                ok = ok && !ec && detail::copy_ranges(h->map, ss.paths[k], copies[k]) && write_shard_header(ss, k);
+                if (!ok) return fail(Error::IoFail);
+                written += ss.recs[k].bytes;
+            }
+
+            std::string tmp = index_path + ".tmp";
+            std::ofstream fo(tmp, std::ios::binary | std::ios::trunc);
+            auto wr = [&](const void* p, size_t n)
+            {
+                written += n;
+                return write_exact(fo, p, n);
+            };
+            auto pad_to = [&](size_t off)
+            {
+                size_t cur = (size_t)fo.tellp();
+                static const char z[64] = {0};
+                while (cur < off)
+                {
+                    size_t m = off - cur > 64 ? 64 : off - cur;
+                    wr(z, m);
+                    cur += m;
+                }
+            };
+            fo.seekp(sizeof(Hdr), std::ios::beg);
+            pad_to(hdr.scene_off);
+            wr(&h->scene, sizeof(SceneRec));
+            pad_to(hdr.cam_off);
+            wr(&cam, sizeof(cam));
+            wr(ct.fx.data(), sizeof(float) * N);
+            wr(ct.fy.data(), sizeof(float) * N);
+            wr(ct.cx.data(), sizeof(float) * N);
+            wr(ct.cy.data(), sizeof(float) * N);
+            wr(ct.T.data(), sizeof(float) * 12 * N);
+            wr(ct.w.data(), sizeof(uint32_t) * N);
+            wr(ct.h.data(), sizeof(uint32_t) * N);
+            wr(ct.t.data(), sizeof(uint32_t) * N);
+            pad_to(hdr.frames_off);
+            wr(frs.data(), sizeof(FrameRec) * N);
+            std::vector<uint32_t> sect_crc;
+            std::vector<unsigned char> piece;
+            for (size_t k = 0; k < tail.size(); k++)
+            {
+                if (tail[k].kind == SectChecksums) fill_checksums(tail[k], hdr, h->scene, cam, ct, frs, [h](size_t i) { return h->frame_crc[i]; }, dir, sect_crc);
+                pad_to(dir[k].off);
+                wr(tail[k].data.data(), tail[k].data.size());
+                uint32_t crc = libdeflate_crc32(0, tail[k].data.data(), tail[k].data.size());
+                for (size_t j = 0; j < tail[k].piece_off.size(); j++)
+                {
+                    piece.resize(tail[k].piece_bytes[j]);
+                    tail[k].gen(j, piece.data());
+                    wr(piece.data(), piece.size());
+                    crc = libdeflate_crc32(crc, piece.data(), piece.size());
+                }
+                sect_crc.push_back(crc);
+            }
+            pad_to(hdr.sects_off);
+            wr(dir.data(), sizeof(SectRec) * dir.size());
+            pad_to(end);
+            fo.seekp(0, std::ios::beg);
+            wr(&hdr, sizeof(Hdr));
+            fo.close();
+            std::error_code ec;
+            if (fo) fs::rename(tmp, index_path, ec);
+            if (!fo || ec)
+            {
+                fs::remove(tmp, ec);
+                return fail(Error::IoFail);
+            }
+            close_hostpack(ph);
+            wt.lap(BuildStage::Write, 0, written, K);
+            return 0;
+        }
+
+        int build_pack(const BuildConfig& cfg, const std::string& out_path, BuildTrace* tr)
+        {
+            g_last_error.store(0, std::memory_order_relaxed);
+            NSMeta meta;
+            StageTimer t(tr);
+            if (!load_build_meta(cfg, meta)) return -1;
+            t.lap(BuildStage::Manifest, meta.source_bytes, 0, meta.items.size());
+            PackHandle prev = nullptr;
+            // Nothing is reused for a sharded pack
+            if (cfg.incremental && cfg.shards <= 1 && fs::exists(out_path))
+            {
+                // Anything that does not open is simply rebuilt, as is an index pack: its blocks are not in the
+                // file the copies would read
+                prev = open_hostpack(out_path);
+                if (prev && ((PackHandleImpl*)prev)->frame_shards)
+                {
+                    close_hostpack(prev);
+                    prev = nullptr;
+                }
+                g_last_error.store(0, std::memory_order_relaxed);
+            }
+            Reuse reuse;
+            if (!fingerprint_sources(cfg, meta, (const PackHandleImpl*)prev, reuse))
+            {
+                close_hostpack(prev);
+                return -1;
+            }
+            t.lap(BuildStage::Fingerprint, reuse.hashed_bytes, 0, meta.items.size());
+            if (reuse.reused && pack_current(cfg, meta, reuse))
+            {
+                close_hostpack(prev);
+                if (tr) tr->out->frames_reused = meta.items.size();
+                return 0;
+            }
+            // Repeated in-place updates pile up superseded tables; past half the live size the pack is compacted
+            if (reuse.in_place && dead_bytes(reuse.old) * 2 > reuse.old->map.bytes) reuse.in_place = false;
+            if (reuse.reused && reuse.in_place)
+            {
+                int rc = build_stream(cfg, meta, out_path, &reuse, nullptr, tr);
+                close_hostpack(prev);
+                return rc;
+            }
+            if (reuse.reused)
+            {
+                // Reused blocks are copied out of the previous pack, which stays readable until the new one is done
+                std::string tmp = out_path + ".tmp";
+                int rc = build_stream(cfg, meta, tmp, &reuse, nullptr, tr);
+                close_hostpack(prev);
+                std::error_code ec;
+                if (rc == 0) fs::rename(tmp, out_path, ec);
+                if (rc != 0 || ec)
+                {
+                    fs::remove(tmp, ec);
+                    if (rc == 0) set_error(Error::IoFail);
+                    return -1;
+                }
+                return 0;
+            }
+            close_hostpack(prev);
+            if (cfg.shards > 1)
+            {
+                // Cut from the planned block sizes, read off the image headers before anything is decoded; crop
+                // and compression shrink blocks afterwards, so those shards balance on the uncropped raw sizes
+                size_t N = meta.items.size();
+                if (cfg.shards > N)
+                {
+                    set_error(Error::BadConfig);
+                    return -1;
+                }
+                std::vector<uint32_t> w(N);
+                std::vector<uint32_t> h(N);
+                if (!probe_frames(cfg, meta, w, h, tr)) return -1;
+                PixelEncode enc = make_encode(cfg);
+                std::vector<uint64_t> bytes(N);
+                for (size_t i = 0; i < N; i++) bytes[i] = plan_frame(i, w[i], h[i], cfg, enc).bytes;
+                ShardSet ss = plan_shards(out_path, bytes, cfg.shards, cfg.block_align);
+                int rc = build_stream(cfg, meta, out_path, nullptr, &ss, tr);
+                if (rc != 0) remove_shards(ss);
+                return rc;
+            }
+            // Compressed sizes, crop rectangles and importance tables are unknown until frames are encoded, so those
+            // packs are always streamed
+            bool mapped = cfg.mapped_output && !cfg.compress_level && !cfg.crop_alpha && cfg.importance == ImportanceSource::None;
+            return mapped ? build_mapped(cfg, meta, out_path, tr) : build_stream(cfg, meta, out_path, nullptr, nullptr, tr);
+        }
+
+        int append_pack(const BuildConfig& cfg, const std::string& hostpack_path, BuildTrace* tr)
+        {
+            g_last_error.store(0, std::memory_order_relaxed);
+            NSMeta meta;
+            StageTimer t(tr);
+            if (!load_build_meta(cfg, meta)) return -1;
+            t.lap(BuildStage::Manifest, meta.source_bytes, 0, meta.items.size());
+            PackHandle prev = open_hostpack(hostpack_path);
+            if (!prev) return -1;
+            if (((PackHandleImpl*)prev)->frame_shards)
+            {
+                close_hostpack(prev);
+                set_error(Error::Unsupported);
+                return -1;
+            }
+            Reuse reuse;
+            if (!fingerprint_sources(cfg, meta, (const PackHandleImpl*)prev, reuse))
+            {
+                close_hostpack(prev);
+                return -1;
+            }
+            t.lap(BuildStage::Fingerprint, reuse.hashed_bytes, 0, meta.items.size());
+            if (!reuse.in_place)
+            {
+                close_hostpack(prev);
+                set_error(Error::BadConfig);
+                return -1;
+            }
+            int rc = build_stream(cfg, meta, hostpack_path, &reuse, nullptr, tr);
+            close_hostpack(prev);
+            return rc;
+        }
+
+        // Shard handles draw frames from the ones they own: their probabilities scaled up to sum to 1, or their
+        // shares of the owned pixels when none of them has any weight
+        void renormalise_importance(PackHandleImpl* h)
+        {
+            const ImpHead* ih = (const ImpHead*)h->imp;
+            const float* w = (const float*)(h->imp + ih->frames_off);
+            size_t n = h->frames.size();
+            h->owned_imp.assign(2 * n, 0.0f);
+            double total = 0;
+            double pixels = 0;
+            for (size_t i = 0; i < n; i++)
+            {
+                if (!owns_frame(h, i)) continue;
+                total += w[i];
+                pixels += (double)h->frames[i].width * h->frames[i].height;
+            }
+            for (size_t i = 0; i < n && pixels > 0; i++)
+            {
+                if (owns_frame(h, i)) h->owned_imp[i] = (float)(total > 0 ? w[i] / total : (double)h->frames[i].width * h->frames[i].height / pixels);
+            }
+            prefix_cdf(h->owned_imp.data(), n, h->owned_imp.data() + n);
+        }
+
+        void unmap_pack(PackHandleImpl* h)
+        {
+            for (detail::mmap_ro& m : h->shards) detail::release_view(m);
+            if (!h->owner) detail::munmap_file(h->map);
+        }
+
+        // Moves the index file h->map holds to the start of a reservation covering every shard slot and maps
+        // the shards k % world == rank owns into theirs. Their headers must name the index's pack id.
+        bool map_shards(PackHandleImpl* h, const std::string& path, bool populate, uint32_t rank, uint32_t world)
+        {
+            const SectRec* sr = find_sect(h, SectShards);
+            const ShardHead* sh = sr && sr->bytes >= sizeof(ShardHead) ? (const ShardHead*)(h->base + sr->off) : nullptr;
+            uint64_t index_bytes = h->map.bytes;
+            size_t n = h->frames.size();
+            bool ok = sh && sh->shard_count && sh->frame_count == n && sh->shard_count <= (sr->bytes - sizeof(ShardHead)) / sizeof(ShardRec)
+                && sh->map_off % 4 == 0 && sh->map_off <= sr->bytes && n <= (sr->bytes - sh->map_off) / sizeof(uint32_t);
+            const ShardRec* recs = ok ? (const ShardRec*)(sh + 1) : nullptr;
+            uint64_t slot = rup(index_bytes, kShardSlotAlign);
+            for (uint32_t k = 0; ok && k < sh->shard_count; k++)
+            {
+                const ShardRec& r = recs[k];
+                ok = r.virt_off % kShardSlotAlign == 0 && r.virt_off >= slot && r.bytes >= sizeof(ShardHdr) && r.bytes < (1ull << 48)
+                    && r.name_off <= sr->bytes && r.name_len && r.name_len <= sr->bytes - r.name_off;
+                if (ok) slot = rup(r.virt_off + r.bytes, kShardSlotAlign);
+            }
+            if (!ok)
+            {
+                set_error(Error::BadPack);
+                return false;
+            }
+            if (!world || rank >= world || world > sh->shard_count)
+            {
+                set_error(Error::BadConfig);
+                return false;
+            }
+#if defined(_WIN32)
+            (void)path;
+            (void)populate;
+            set_error(Error::Unsupported);
+            return false;
+#else
+            uint32_t count = sh->shard_count;
+            uint64_t pack_id = sh->pack_id;
+            std::vector<std::string> names(count);
+            for (uint32_t k = 0; k < count; k++) names[k].assign(h->base + sr->off + recs[k].name_off, recs[k].name_len);
+            detail::mmap_ro span = detail::reserve_span((size_t)slot);
+            if (!span.ptr)
+            {
+                set_error(Error::NoMemory);
+                return false;
+            }
+            detail::mmap_ro index = detail::map_file_at(path, span.ptr, (size_t)index_bytes, populate);
+            if (!index.ptr)
+            {
+                detail::munmap_file(span);
+                set_error(Error::IoFail);
+                return false;
+            }
+            // The reservation takes over the index's descriptor, so unmapping it closes both
+            detail::munmap_file(h->map);
+            span.fd = index.fd;
+            h->map = span;
+            if (!parse_pack(h)) return false;
+            sr = find_sect(h, SectShards);
+            h->shard_recs = (const ShardRec*)(h->base + sr->off + sizeof(ShardHead));
+            h->frame_shards = (const uint32_t*)(h->base + sr->off + ((const ShardHead*)(h->base + sr->off))->map_off);
+            h->shards.assign(count, detail::mmap_ro());
+            h->shard_paths.resize(count);
+            fs::path dir = fs::path(path).parent_path();
+            for (uint32_t k = 0; k < count; k++)
+            {
+                h->shard_paths[k] = (dir / names[k]).string();
+                if (k % world != rank) continue;
+                const ShardRec& r = h->shard_recs[k];
+                detail::mmap_ro m = detail::map_file_at(h->shard_paths[k], (char*)h->map.ptr + r.virt_off, (size_t)r.bytes, populate);
+                if (!m.ptr)
+                {
+                    set_error(Error::IoFail);
+                    return false;
+                }
+                h->shards[k] = m;
+                ShardHdr sf;
+                std::memcpy(&sf, m.ptr, sizeof(sf));
+                if (std::memcmp(sf.magic, "HPS1", 4) != 0 || sf.version != kShardVersion || sf.pack_id != pack_id || sf.shard != k || sf.shard_count != count || sf.bytes != r.bytes)
+                {
+                    set_error(Error::BadPack);
+                    return false;
+                }
+            }
+            if (world > 1 && h->imp) renormalise_importance(h);
+            return true;
+#endif
+        }
+
+        // Runs build with a trace filling stats
+        int run_traced(const BuildConfig& cfg, BuildStats& stats, const std::function<int(BuildTrace*)>& build)
+        {
+            stats = BuildStats{};
+            stats.thread_busy_seconds.assign(std::clamp<uint32_t>(worker_count(cfg), 1, (uint32_t)tbb::info::default_concurrency()), 0.0);
+            BuildTrace tr;
+            tr.out = &stats;
+            auto w0 = std::chrono::steady_clock::now();
+            double c0 = detail::process_cpu_seconds();
+            int rc = build(&tr);
+            stats.wall_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - w0).count();
+            stats.cpu_seconds = detail::process_cpu_seconds() - c0;
+            return rc;
+        }
+    }
+
+    uint32_t pixel_format_bytes(PixelFormat pf)
+    {
+        switch (pf)
+        {
+        case PixelFormat::RGBA8: return 4;
+        case PixelFormat::RGBA32F: return 16;
+        case PixelFormat::RGBA16F: return 8;
+        case PixelFormat::RGB8: return 3;
+        case PixelFormat::RGB16F: return 6;
+        }
+        return 0;
+    }
+
+    Error last_error()
+    {
+        return (Error)g_last_error.load(std::memory_order_relaxed);
+    }
+
+    int build_hostpack(const BuildConfig& cfg, const std::string& out_path)
+    {
+        return build_pack(cfg, out_path, nullptr);
+    }
+
+    int build_hostpack(const BuildConfig& cfg, const std::string& out_path, BuildStats& stats)
+    {
+        return run_traced(cfg, stats, [&](BuildTrace* tr) { return build_pack(cfg, out_path, tr); });
+    }
+
+    int shard_hostpack(const std::string& hostpack_path, const std::string& index_path, uint32_t shards, uint32_t block_align)
+    {
+        g_last_error.store(0, std::memory_order_relaxed);
+        return split_pack(hostpack_path, index_path, shards, block_align, nullptr);
+    }
+
+    int append_hostpack(const BuildConfig& cfg, const std::string& hostpack_path)
+    {
+        return append_pack(cfg, hostpack_path, nullptr);
+    }
+
+    int append_hostpack(const BuildConfig& cfg, const std::string& hostpack_path, BuildStats& stats)
+    {
+        return run_traced(cfg, stats, [&](BuildTrace* tr) { return append_pack(cfg, hostpack_path, tr); });
+    }
+
+    const char* build_stage_name(BuildStage stage)
+    {
+        static const char* const kNames[kBuildStages] = {"manifest", "fingerprint", "decode", "convert", "compress", "write"};
+        return (size_t)stage < kBuildStages ? kNames[(size_t)stage] : "unknown";
+    }
+
+    PackHandle open_hostpack(const std::string& hostpack_path)
+    {
+        OpenOptions opt{};
+        return open_hostpack_ex(hostpack_path, opt);
+    }
+
+    PackHandle open_hostpack_ex(const std::string& hostpack_path, OpenOptions& opt)
+    {
+        return open_hostpack_shard_ex(hostpack_path, 0, 1, opt);
+    }
+
+    PackHandle open_hostpack_shard(const std::string& index_path, uint32_t rank, uint32_t world)
+    {
+        OpenOptions opt{};
+        return open_hostpack_shard_ex(index_path, rank, world, opt);
+    }
+
+    PackHandle open_hostpack_shard_ex(const std::string& hostpack_path, uint32_t rank, uint32_t world, OpenOptions& opt)
+    {
+        g_last_error.store(0, std::memory_order_relaxed);
+        auto t0 = std::chrono::steady_clock::now();
+        opt.open_seconds = 0;
+        opt.resident_bytes = 0;
+        opt.locked = false;
+        opt.attached = false;
+        auto* h = new PackHandleImpl();
+        switch (opt.residency)
+        {
+        case Residency::Lazy:
+            h->map = detail::mmap_file_ro(hostpack_path);
+            break;
+        case Residency::Populate:
+            h->map = detail::mmap_file_populate(hostpack_path);
+            break;
+        case Residency::HugeCopy:
+            h->map = detail::copy_file_anon(hostpack_path, opt.threads);
+            break;
+        case Residency::Shared:
+#if defined(_WIN32)
+            delete h;
+            set_error(Error::Unsupported);
+            return nullptr;
+#else
+            h->map = detail::map_file_shared(hostpack_path, opt.shm_name, opt.threads, opt.attached);
+            break;
+#endif
+        default:
+            delete h;
+            set_error(Error::BadConfig);
+            return nullptr;
+        }
+        if (!h->map.ptr)
+        {
+            delete h;
+            set_error(Error::IoFail);
+            return nullptr;
+        }
+        h->path = hostpack_path;
+        bool ok = parse_pack(h);
+        if (ok && (h->hdr.caps_bits & CapSharded))
+        {
+            // Shards are mapped in place of the file; private copies of them are not supported
+            bool mapped = opt.residency == Residency::Lazy || opt.residency == Residency::Populate;
+            if (!mapped) set_error(Error::Unsupported);
+            ok = mapped && map_shards(h, hostpack_path, opt.residency == Residency::Populate, rank, world);
+        }
+        else if (ok && (!world || rank >= world))
+        {
+            set_error(Error::BadConfig);
+            ok = false;
+        }
+        if (!ok)
+        {
+            unmap_pack(h);
+            delete h;
+            return nullptr;
+        }
+        if (opt.verify_frames && h->frame_crc) h->verified.reset(new std::atomic<uint8_t>[h->frames.size()]());
+        // Resident modes have nothing left to read ahead
+        if (opt.residency == Residency::Lazy) detail::advise_range(h->map, (size_t)h->hdr.pixels_off, h->map.bytes, detail::Advice::Random);
+        // Index packs count the index file and the shards they map, not the reservation around them
+        std::vector<detail::mmap_ro> parts{h->frame_shards ? detail::sub_view(h->map, 0, (size_t)h->hdr.end_off) : h->map};
+        for (const detail::mmap_ro& m : h->shards)
+        {
+            if (m.ptr) parts.push_back(m);
+        }
+        opt.locked = opt.lock_memory;
+        opt.resident_bytes = 0;
+        for (const detail::mmap_ro& m : parts)
+        {
+            if (opt.lock_memory) opt.locked = detail::lock_resident(m) && opt.locked;
+            opt.resident_bytes += detail::resident_bytes(m);
+        }
+        opt.open_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+        return (PackHandle)h;
+    }
+
+    int release_shared_hostpack(const std::string& hostpack_path, const std::string& shm_name)
+    {
+        if (!detail::unlink_shared(hostpack_path, shm_name))
+        {
+            set_error(Error::IoFail);
+            return -1;
+        }
+        return 0;
+    }
+
+    void close_hostpack(PackHandle ph)
+    {
+        if (!ph) return;
+        auto* h = (PackHandleImpl*)ph;
+        stop_readahead(h);
+        unmap_pack(h);
+        delete h;
+    }
+
+    int verify_hostpack(PackHandle ph, uint32_t threads, VerifyReport& report)
+    {
+        g_last_error.store(0, std::memory_order_relaxed);
+        report = VerifyReport{};
+        auto* h = (PackHandleImpl*)ph;
+        if (!h)
+        {
+            set_error(Error::BadConfig);
+            return -1;
+        }
+        if (!h->sums)
+        {
+            set_error(Error::Unsupported);
+            return -1;
+        }
+        auto t0 = std::chrono::steady_clock::now();
+        const SumHead& sh = *h->sums;
+        const char* b = h->base;
+        const Hdr& hd = h->hdr;
+        const CamSOA& c = h->cam;
+        size_t N = h->frames.size();
+        // plan_tables lays the camera block out contiguously from cam_off
+        uint64_t cam_bytes = c.time_off >= hd.cam_off ? c.time_off + sizeof(uint32_t) * N - hd.cam_off : 0;
+        report.tables_ok = libdeflate_crc32(0, b, sizeof(Hdr)) == sh.hdr_crc && libdeflate_crc32(0, b + hd.scene_off, sizeof(SceneRec)) == sh.scene_crc
+            && cam_bytes && libdeflate_crc32(0, b + hd.cam_off, cam_bytes) == sh.cam_crc
+            && libdeflate_crc32(0, b + hd.frames_off, sizeof(FrameRec) * N) == sh.frames_crc;
+        report.bytes_checked = sizeof(Hdr) + sizeof(SceneRec) + cam_bytes + sizeof(FrameRec) * N;
+        const SectRec* dir = (const SectRec*)(b + hd.sects_off);
+        const SumSect* ss = (const SumSect*)(h->sums + 1);
+        for (uint32_t k = 0; k < sh.sect_count; k++)
+        {
+            report.sections_checked++;
+            if (k < hd.sect_count && dir[k].kind == ss[k].kind && libdeflate_crc32(0, b + dir[k].off, dir[k].bytes) == ss[k].crc)
+            {
+                report.bytes_checked += dir[k].bytes;
+            }
+            else
+            {
+                report.bad_sections++;
+            }
+        }
+        std::vector<uint8_t> bad(N);
+        std::atomic<uint64_t> bytes{0};
+        uint32_t th = threads ? threads : std::thread::hardware_concurrency();
+        std::atomic<uint64_t> checked{0};
+        detail::parallel_for(N, th ? th : 1, [&](size_t i)
+        {
+            // Frames in other ranks' shards are theirs to check
+            if (!owns_frame(h, i)) return;
+            checked.fetch_add(1, std::memory_order_relaxed);
+            if (!frame_ok(h, i))
+            {
+                bad[i] = 1;
+                return;
+            }
+            const FrameRec& fr = h->frames[i];
+            // One readahead request for the frame rather than a fault per page of the randomly advised mapping
+            uint64_t start;
+            const detail::mmap_ro& m = frame_map(h, i, start);
+            detail::advise_range(m, (size_t)(fr.pixel_off - start), (size_t)fr.stored_bytes, detail::Advice::WillNeed);
+            bad[i] = libdeflate_crc32(0, b + fr.pixel_off, fr.stored_bytes) != h->frame_crc[i];
+            if (h->verified) h->verified[i].store(bad[i] ? 2 : 1, std::memory_order_release);
+            bytes.fetch_add(fr.stored_bytes, std::memory_order_relaxed);
+        });
+        for (size_t i = 0; i < N; i++)
+        {
+            if (bad[i]) report.bad_frames.push_back(i);
+        }
+        report.frames_checked = checked.load();
+        report.bytes_checked += bytes.load();
+        report.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+        if (!report.tables_ok || report.bad_sections || !report.bad_frames.empty())
+        {
+            set_error(Error::BadPack);
+            return -1;
+        }
+        return 0;
+    }
+
+    int pack_stats(PackHandle ph, PackStats& stats)
+    {
+        auto* h = (PackHandleImpl*)ph;
+        if (!h)
+        {
+            set_error(Error::BadConfig);
+            return -1;
+        }
+        stats = PackStats{};
+        size_t page = 4096;
+        size_t lead = 0;
+        std::vector<unsigned char> pages;
+        stats.residency_known = detail::resident_pages(h->map, page, lead, pages);
+        if (!stats.residency_known) pages.clear();
+        stats.page_bytes = page;
+        auto range = [&](uint64_t off, uint64_t bytes) { return range_residency(pages, page, lead, off, bytes); };
+        stats.total = range(0, h->map.bytes);
+
+        const Hdr& hd = h->hdr;
+        const CamSOA& c = h->cam;
+        size_t N = h->frames.size();
+        size_t rec = hd.version < 4 ? kFrameRecV3Bytes : sizeof(FrameRec);
+        add_range(stats.tables, range(0, sizeof(Hdr)));
+        add_range(stats.tables, range(hd.scene_off, sizeof(SceneRec)));
+        add_range(stats.tables, range(hd.cam_off, sizeof(CamSOA)));
+        for (uint64_t off : {c.fx_off, c.fy_off, c.cx_off, c.cy_off, c.w_off, c.h_off, c.time_off}) add_range(stats.tables, range(off, sizeof(float) * N));
+        add_range(stats.tables, range(c.T_off, sizeof(float) * 12 * N));
+        add_range(stats.tables, range(hd.frames_off, rec * N));
+        if (hd.sect_count) add_range(stats.tables, range(hd.sects_off, sizeof(SectRec) * hd.sect_count));
+
+        static const char* const kSectNames[] = {"", "mips", "rays", "manifest", "checksums", "fill", "importance", "shards"};
+        if (hd.sect_count && hd.sects_off + sizeof(SectRec) * hd.sect_count <= h->map.bytes)
+        {
+            const SectRec* dir = (const SectRec*)(h->base + hd.sects_off);
+            for (uint32_t k = 0; k < hd.sect_count; k++)
+            {
+                if (dir[k].off + dir[k].bytes > h->map.bytes) continue;
+                const char* name = dir[k].kind < std::size(kSectNames) && dir[k].kind ? kSectNames[dir[k].kind] : "unknown";
+                stats.sections.push_back(SectionResidency{name, range(dir[k].off, dir[k].bytes)});
+            }
+        }
+
+        stats.frames.resize(N);
+        for (size_t i = 0; i < N; i++)
+        {
+            if (!frame_ok(h, i)) continue;
+            uint64_t off;
+            uint64_t bytes;
+            frame_extent(h, i, off, bytes);
+            stats.frames[i] = range(off, bytes);
+        }
+
+        AccessCounters& a = stats.access;
+        a.views = h->views.load(std::memory_order_relaxed);
+        a.acquires = h->acquires.load(std::memory_order_relaxed);
+        a.cache_hits = h->cache_hits.load(std::memory_order_relaxed);
+        a.cache_misses = h->cache_misses.load(std::memory_order_relaxed);
+        a.reader_loads = h->reader_loads.load(std::memory_order_relaxed);
+        a.reader_bytes = h->reader_bytes.load(std::memory_order_relaxed);
+        a.prefetches = h->prefetches.load(std::memory_order_relaxed);
+        a.evictions = h->evictions.load(std::memory_order_relaxed);
+        return 0;
+    }
+
+    int build_archive(const std::vector<std::string>& hostpack_paths, const std::vector<std::string>& names, const std::string& out_path, uint32_t block_align)
+    {
+        g_last_error.store(0, std::memory_order_relaxed);
+        if (block_align == 0) block_align = 4096;
+        if ((block_align & (block_align - 1)) || hostpack_paths.empty() || (!names.empty() && names.size() != hostpack_paths.size()))
+        {
+            set_error(Error::BadConfig);
+            return -1;
+        }
+        size_t n = hostpack_paths.size();
+        std::vector<std::string> scene(n);
+        for (size_t i = 0; i < n; i++) scene[i] = names.empty() ? fs::path(hostpack_paths[i]).stem().string() : names[i];
+        std::vector<size_t> order(n);
+        for (size_t i = 0; i < n; i++) order[i] = i;
+        std::sort(order.begin(), order.end(), [&](size_t x, size_t y) { return scene[x] < scene[y]; });
+        for (size_t k = 0; k < n; k++)
+        {
+            if (scene[order[k]].empty() || (k && scene[order[k]] == scene[order[k - 1]]))
+            {
+                set_error(Error::BadConfig);
+                return -1;
+            }
+        }
+        std::vector<detail::mmap_ro> maps(n);
+        auto unmap_all = [&]
+        {
+            for (auto& m : maps) detail::munmap_file(m);
+        };
+        for (size_t i = 0; i < n; i++)
+        {
+            maps[i] = detail::mmap_file_ro(hostpack_paths[i]);
+            if (!maps[i].ptr)
+            {
+                unmap_all();
+                set_error(Error::IoFail);
+                return -1;
+            }
+            if (maps[i].bytes < sizeof(Hdr) || std::memcmp(maps[i].ptr, "HPK1", 4) != 0)
+            {
+                unmap_all();
+                set_error(Error::BadPack);
+                return -1;
+            }
+            // An index pack's frames live in its shard files, which the archive would not carry
+            if (((const Hdr*)maps[i].ptr)->caps_bits & CapSharded)
+            {
+                unmap_all();
+                set_error(Error::Unsupported);
+                return -1;
+            }
+        }
+        ArcHdr ah{};
+        std::memcpy(ah.magic, "HPA1", 4);
+        ah.version = kArcVersion;
+        ah.scene_count = n;
+        ah.catalog_off = sizeof(ArcHdr);
+        ah.names_off = ah.catalog_off + sizeof(ArcEntry) * n;
+        std::vector<ArcEntry> cat(n);
+        std::string blob;
+        for (size_t k = 0; k < n; k++)
+        {
+            cat[k].name_off = blob.size();
+            cat[k].name_len = (uint32_t)scene[order[k]].size();
+            blob += scene[order[k]];
+        }
+        uint64_t cursor = ah.names_off + blob.size();
+        for (size_t k = 0; k < n; k++)
+        {
+            cursor = rup(cursor, block_align);
+            cat[k].off = cursor;
+            cat[k].bytes = maps[order[k]].bytes;
+            cursor += cat[k].bytes;
+        }
+        ah.bytes_total = cursor;
+        bool ok;
+        {
+            // The header goes in last, so an interrupted build never looks like an archive
+            std::ofstream out(out_path, std::ios::binary | std::ios::trunc);
+            ArcHdr blank{};
+            ok = out && !write_exact(out, &blank, sizeof(blank)) && !write_exact(out, cat.data(), sizeof(ArcEntry) * n) && !write_exact(out, blob.data(), blob.size());
+        }
+        std::error_code ec;
+        if (ok)
+        {
+            fs::resize_file(out_path, ah.bytes_total, ec);
+            ok = !ec;
+        }
+        for (size_t k = 0; k < n && ok; k++) ok = detail::copy_ranges(maps[order[k]], out_path, {detail::CopyRange{0, cat[k].off, cat[k].bytes}});
+        unmap_all();
+        if (ok)
+        {
+            std::fstream out(out_path, std::ios::binary | std::ios::in | std::ios::out);
+            ok = out && !write_exact(out, &ah, sizeof(ah));
+        }
+        if (!ok)
+        {
+            fs::remove(out_path, ec);
+            set_error(Error::IoFail);
+            return -1;
+        }
+        return 0;
+    }
+
+    ArchiveHandle open_archive(const std::string& archive_path)
+    {
+        g_last_error.store(0, std::memory_order_relaxed);
+        auto a = std::make_shared<ArchiveImpl>();
+        a->map = detail::mmap_file_ro(archive_path);
+        if (!a->map.ptr)
+        {
+            set_error(Error::IoFail);
+            return nullptr;
+        }
+        a->path = archive_path;
+        ArcHdr ah{};
+        if (a->map.bytes >= sizeof(ah)) std::memcpy(&ah, a->map.ptr, sizeof(ah));
+        uint64_t size = a->map.bytes;
+        bool ok = a->map.bytes >= sizeof(ah) && std::memcmp(ah.magic, "HPA1", 4) == 0 && ah.version == kArcVersion
+            && ah.catalog_off % alignof(ArcEntry) == 0 && ah.catalog_off <= size && ah.scene_count <= (size - ah.catalog_off) / sizeof(ArcEntry)
+            && ah.names_off <= size && ah.bytes_total <= size;
+        if (ok)
+        {
+            a->cat = (const ArcEntry*)((const char*)a->map.ptr + ah.catalog_off);
+            a->count = (size_t)ah.scene_count;
+            a->names = (const char*)a->map.ptr + ah.names_off;
+            for (size_t k = 0; k < a->count && ok; k++)
+            {
+                const ArcEntry& e = a->cat[k];
+                ok = e.name_off <= size - ah.names_off && e.name_len <= size - ah.names_off - e.name_off && e.off <= size && e.bytes <= size - e.off;
+            }
+        }
+        if (!ok)
+        {
+            set_error(Error::BadPack);
+            return nullptr;
+        }
+        return (ArchiveHandle)new ArchiveBox{std::move(a)};
+    }
+
+    void close_archive(ArchiveHandle ah)
+    {
+        delete (ArchiveBox*)ah;
+    }
+
+    size_t archive_scene_count(ArchiveHandle ah)
+    {
+        auto* box = (ArchiveBox*)ah;
+        return box ? box->a->count : 0;
+    }
+
+    std::string archive_scene_name(ArchiveHandle ah, size_t scene_id)
+    {
+        auto* box = (ArchiveBox*)ah;
+        if (!box || scene_id >= box->a->count) return {};
+        return std::string(entry_name(box->a.get(), box->a->cat[scene_id]));
+    }
+
+    PackHandle open_scene(ArchiveHandle ah, const std::string& name)
+    {
+        g_last_error.store(0, std::memory_order_relaxed);
+        auto* box = (ArchiveBox*)ah;
+        if (!box)
+        {
+            set_error(Error::BadConfig);
+            return nullptr;
+        }
+        const ArchiveImpl* a = box->a.get();
+        const ArcEntry* end = a->cat + a->count;
+        const ArcEntry* e = std::lower_bound(a->cat, end, std::string_view(name), [a](const ArcEntry& x, std::string_view v) { return entry_name(a, x) < v; });
+        if (e == end || entry_name(a, *e) != name)
+        {
+            set_error(Error::BadConfig);
+            return nullptr;
+        }
+        return open_scene(ah, (size_t)(e - a->cat));
+    }
+
+    PackHandle open_scene(ArchiveHandle ah, size_t scene_id)
+    {
+        g_last_error.store(0, std::memory_order_relaxed);
+        auto* box = (ArchiveBox*)ah;
+        if (!box || scene_id >= box->a->count)
+        {
+            set_error(Error::BadConfig);
+            return nullptr;
+        }
+        const ArcEntry& e = box->a->cat[scene_id];
+        auto* h = new PackHandleImpl();
+        h->map = detail::sub_view(box->a->map, (size_t)e.off, (size_t)e.bytes);
+        h->owner = box->a;
+        h->path = box->a->path;
+        if (!parse_pack(h))
+        {
+            delete h;
+            return nullptr;
+        }
+        detail::advise_range(h->map, (size_t)h->hdr.pixels_off, h->map.bytes, detail::Advice::Random);
+        return (PackHandle)h;
+    }
+
+    size_t frame_count(PackHandle ph)
+    {
+        auto* h = (PackHandleImpl*)ph;
+        return h ? h->frames.size() : 0;
+    }
+
+    size_t camera_count(PackHandle ph)
+    {
+        auto* h = (PackHandleImpl*)ph;
+        return h ? (size_t)h->cam.count : 0;
+    }
+
+    size_t frame_camera_index(PackHandle ph, size_t i)
+    {
+        auto* h = (PackHandleImpl*)ph;
+        if (!h || i >= h->frames.size()) return 0;
+        return (size_t)h->frames[i].camera_id;
+    }
+
+    uint32_t shard_count(PackHandle ph)
+    {
+        auto* h = (PackHandleImpl*)ph;
+        return h ? (uint32_t)h->shards.size() : 0;
+    }
+
+    int64_t frame_shard(PackHandle ph, size_t i)
+    {
+        auto* h = (PackHandleImpl*)ph;
+        if (!h || i >= h->frames.size()) return -1;
+        return h->frame_shards ? (int64_t)h->frame_shards[i] : 0;
+    }
+
+    bool frame_owned(PackHandle ph, size_t i)
+    {
+        auto* h = (PackHandleImpl*)ph;
+        return h && owns_frame(h, i);
+    }
+
+    ImageView image_view(PackHandle ph, size_t i)
+    {
+        return image_view_level(ph, i, 0);
+    }
+
+    ImageView frame_info(PackHandle ph, size_t i)
+    {
+        auto* h = (PackHandleImpl*)ph;
+        if (!h || !frame_ok(h, i)) return ImageView{};
+        return frame_view(h, i, 0, nullptr);
+    }
+
+    uint32_t frame_mip_levels(PackHandle ph, size_t i)
+    {
+        auto* h = (PackHandleImpl*)ph;
+        if (!h || i >= h->frames.size()) return 0;
+        return h->mips ? std::min(h->frames[i].mip_levels, h->mip_stride) : 1;
+    }
+
+    ImageView image_view_level(PackHandle ph, size_t i, uint32_t level)
+    {
+        auto* h = (PackHandleImpl*)ph;
+        if (!h || !frame_ok(h, i) || frame_packed(h->frames[i])) return ImageView{};
+        h->views.fetch_add(1, std::memory_order_relaxed);
+        if (!frame_verified(h, i))
         {
-            detail::munmap_file(h->map);
-            delete h;
             set_error(Error::BadPack);
-            return nullptr;
+            return ImageView{};
         }
-        std::memcpy(&h->scene, h->base + h->hdr.scene_off, sizeof(SceneRec));
-        std::memcpy(&h->cam, h->base + h->hdr.cam_off, sizeof(CamSOA));
-        size_t n = h->cam.count;
-        h->frames.resize(n);
-        std::memcpy(h->frames.data(), h->base + h->hdr.frames_off, sizeof(FrameRec) * n);
-        return (PackHandle)h;
+        return frame_view(h, i, level, h->base + h->frames[i].pixel_off);
     }
 
-    void close_hostpack(PackHandle ph)
+    ImageView acquire_frame(PackHandle ph, size_t i, uint32_t level)
     {
-        if (!ph) return;
         auto* h = (PackHandleImpl*)ph;
-        detail::munmap_file(h->map);
-        delete h;
+        if (!h || i >= h->frames.size())
+        {
+            set_error(Error::BadConfig);
+            return ImageView{};
+        }
+        if (!frame_ok(h, i) || !frame_verified(h, i))
+        {
+            set_error(Error::BadPack);
+            return ImageView{};
+        }
+        h->acquires.fetch_add(1, std::memory_order_relaxed);
+        if (!frame_packed(h->frames[i])) return frame_view(h, i, level, h->base + h->frames[i].pixel_off);
+        const unsigned char* block = pin_frame(h, i);
+        if (!block) return ImageView{};
+        ImageView v = frame_view(h, i, level, (const char*)block);
+        if (!v.data) unpin_frame(h, i);
+        return v;
     }
 
-    size_t frame_count(PackHandle ph)
+    void release_frame(PackHandle ph, size_t i)
     {
         auto* h = (PackHandleImpl*)ph;
-        return h ? h->frames.size() : 0;
+        if (!h || i >= h->frames.size() || !frame_packed(h->frames[i])) return;
+        unpin_frame(h, i);
     }
 
-    size_t camera_count(PackHandle ph)
+    int acquire_frames(PackHandle ph, const size_t* idx, size_t count, uint32_t level, ImageView* out, uint32_t threads)
+    {
+        if (!ph || (count && (!idx || !out)))
+        {
+            set_error(Error::BadConfig);
+            return -1;
+        }
+        uint32_t th = threads ? threads : std::thread::hardware_concurrency();
+        detail::parallel_for(count, th ? th : 1, [&](size_t k) { out[k] = acquire_frame(ph, idx[k], level); });
+        bool ok = true;
+        for (size_t k = 0; k < count; k++) ok = ok && out[k].data;
+        if (ok) return 0;
+        for (size_t k = 0; k < count; k++)
+        {
+            if (out[k].data) release_frame(ph, idx[k]);
+            out[k] = ImageView{};
+        }
+        return -1;
+    }
+
+    void set_frame_cache_budget(PackHandle ph, uint64_t bytes)
     {
         auto* h = (PackHandleImpl*)ph;
-        return h ? (size_t)h->cam.count : 0;
+        if (!h) return;
+        std::lock_guard<std::mutex> lk(h->cache.mu);
+        h->cache.budget = bytes;
+        trim_cache(h->cache);
     }
 
-    size_t frame_camera_index(PackHandle ph, size_t i)
+    FrameReader open_frame_reader(PackHandle ph, const ReaderOptions& opt)
     {
         auto* h = (PackHandleImpl*)ph;
-        if (!h || i >= h->frames.size()) return 0;
-        return (size_t)h->frames[i].camera_id;
+        if (!h)
+        {
+            set_error(Error::BadConfig);
+            return nullptr;
+        }
+        // Index packs read frames from the shard files the handle owns, file k + 1 for shard k
+        std::vector<std::string> paths{h->path};
+        for (size_t k = 0; k < h->shards.size(); k++) paths.push_back(h->shards[k].ptr ? h->shard_paths[k] : std::string());
+        detail::AsyncReader* io = detail::aio_open(paths, opt.queue_depth, opt.threads, opt.direct);
+        if (!io)
+        {
+            set_error(Error::IoFail);
+            return nullptr;
+        }
+        auto* r = new FrameReaderImpl{h, io, detail::aio_direct_align(io), std::make_shared<BufferPool>()};
+        r->pool->keep = opt.queue_depth ? opt.queue_depth : 64;
+        return (FrameReader)r;
     }
 
-    ImageView image_view(PackHandle ph, size_t i)
+    void close_frame_reader(FrameReader fr)
     {
-        ImageView v{};
-        auto* h = (PackHandleImpl*)ph;
-        if (!h || i >= h->frames.size()) return v;
-        const FrameRec& fr = h->frames[i];
-        v.data = (const void*)(h->base + fr.pixel_off);
-        v.width = fr.width;
-        v.height = fr.height;
-        v.row_stride = fr.row_stride;
-        v.pixel_stride = fr.pixel_stride;
-        v.format = (PixelFormat)h->hdr.pixel_format;
-        v.roi_x = fr.roi_x;
-        v.roi_y = fr.roi_y;
-        v.roi_w = fr.roi_w;
-        v.roi_h = fr.roi_h;
-        return v;
+        if (!fr) return;
+        auto* r = (FrameReaderImpl*)fr;
+        detail::aio_close(r->io);
+        delete r;
+    }
+
+    const char* frame_reader_backend(FrameReader fr)
+    {
+        return fr ? detail::aio_backend(((FrameReaderImpl*)fr)->io) : "";
+    }
+
+    std::future<LoadedFrame> load_frame(FrameReader r, size_t i)
+    {
+        return std::move(load_frames(r, &i, 1)[0]);
+    }
+
+    std::vector<std::future<LoadedFrame>> load_frames(FrameReader fr, const size_t* idx, size_t count)
+    {
+        auto* r = (FrameReaderImpl*)fr;
+        std::vector<std::future<LoadedFrame>> out(count);
+        std::vector<detail::ReadOp> ops;
+        ops.reserve(count);
+        for (size_t k = 0; k < count; k++)
+        {
+            auto p = std::make_shared<std::promise<LoadedFrame>>();
+            out[k] = p->get_future();
+            size_t i = idx[k];
+            if (!r)
+            {
+                p->set_value(LoadedFrame{i, Error::BadConfig, nullptr});
+                continue;
+            }
+            plan_read(r, i, nullptr, 0, [p, i](Error e, std::shared_ptr<const unsigned char> block) { p->set_value(LoadedFrame{i, e, std::move(block)}); }, ops);
+        }
+        if (r) detail::aio_submit(r->io, ops);
+        return out;
+    }
+
+    std::future<Error> load_frame_into(FrameReader fr, size_t i, void* dst, size_t dst_bytes)
+    {
+        auto* r = (FrameReaderImpl*)fr;
+        auto p = std::make_shared<std::promise<Error>>();
+        std::future<Error> f = p->get_future();
+        if (!r || !dst)
+        {
+            p->set_value(Error::BadConfig);
+            return f;
+        }
+        std::vector<detail::ReadOp> ops;
+        plan_read(r, i, (unsigned char*)dst, dst_bytes, [p](Error e, std::shared_ptr<const unsigned char>) { p->set_value(e); }, ops);
+        detail::aio_submit(r->io, ops);
+        return f;
+    }
+
+    void FrameAwaiter::await_suspend(std::coroutine_handle<> c)
+    {
+        auto* r = (FrameReaderImpl*)reader;
+        if (!r)
+        {
+            result = LoadedFrame{frame_index, Error::BadConfig, nullptr};
+            c.resume();
+            return;
+        }
+        std::vector<detail::ReadOp> ops;
+        plan_read(r, frame_index, nullptr, 0, [this, r, c](Error e, std::shared_ptr<const unsigned char> block)
+        {
+            result = LoadedFrame{frame_index, e, std::move(block)};
+            resume_on_worker(r, c);
+        }, ops);
+        // The coroutine may already be running again; only locals from here on
+        detail::aio_submit(r->io, ops);
+    }
+
+    bool FramesAwaiter::await_suspend(std::coroutine_handle<> c)
+    {
+        auto* r = (FrameReaderImpl*)reader;
+        size_t n = frame_indices.size();
+        result.resize(n);
+        if (!r)
+        {
+            for (size_t k = 0; k < n; k++) result[k] = LoadedFrame{frame_indices[k], Error::BadConfig, nullptr};
+            return false;
+        }
+        // One extra count so nothing resumes the coroutine before every read is planned
+        remaining.store(n + 1, std::memory_order_relaxed);
+        std::vector<detail::ReadOp> ops;
+        ops.reserve(n);
+        for (size_t k = 0; k < n; k++)
+        {
+            plan_read(r, frame_indices[k], nullptr, 0, [this, r, c, k](Error e, std::shared_ptr<const unsigned char> block)
+            {
+                result[k] = LoadedFrame{frame_indices[k], e, std::move(block)};
+                if (remaining.fetch_sub(1, std::memory_order_acq_rel) == 1) resume_on_worker(r, c);
+            }, ops);
+        }
+        bool last = remaining.fetch_sub(1, std::memory_order_acq_rel) == 1;
+        detail::aio_submit(r->io, ops);
+        return !last;
+    }
+
+    FrameAwaiter load_frame_async(FrameReader r, size_t i)
+    {
+        return FrameAwaiter{r, i, LoadedFrame{i, Error::Ok, nullptr}};
+    }
+
+    FramesAwaiter load_frames_async(FrameReader r, const size_t* idx, size_t count)
+    {
+        return FramesAwaiter{r, std::vector<size_t>(idx, idx + count), {}, {}};
+    }
+
+    uint64_t frame_block_bytes(PackHandle ph, size_t i)
+    {
+        auto* h = (PackHandleImpl*)ph;
+        if (!h || !frame_ok(h, i)) return 0;
+        if (h->frames[i].block_bytes) return h->frames[i].block_bytes;
+        uint64_t off;
+        uint64_t bytes;
+        frame_extent(h, i, off, bytes);
+        return bytes;
+    }
+
+    ImageView loaded_frame_view(PackHandle ph, const LoadedFrame& f, uint32_t level)
+    {
+        auto* h = (PackHandleImpl*)ph;
+        if (!h || f.status != Error::Ok || !f.block || f.frame_index >= h->frames.size()) return ImageView{};
+        return frame_view(h, f.frame_index, level, (const char*)f.block.get());
     }
 
     CameraSOAView camera_soa(PackHandle ph)
@@ -593,4 +5067,416 @@ namespace dataset
         if (!h) return 0;
         return h->hdr.bytes_total;
     }
+
+    int image_to_rgba32f(const ImageView& v, float* dst, size_t dst_row_stride, bool srgb_to_linear)
+    {
+        if (!v.data || !dst)
+        {
+            set_error(Error::BadConfig);
+            return -1;
+        }
+        size_t out_rs = dst_row_stride ? dst_row_stride : (size_t)v.width * 16;
+        char* out = (char*)dst;
+        // Tiled and cropped rows are assembled in scanline order before conversion
+        std::vector<unsigned char> row((size_t)v.width * v.pixel_stride);
+        for (uint32_t y = 0; y < v.height; y++)
+        {
+            const unsigned char* s = view_row(v, 0, y, v.width, row.data());
+            if (!detail::decode_row_f32(s, v.format, v.width, srgb_to_linear, (float*)(out + y * out_rs)))
+            {
+                set_error(Error::Unsupported);
+                return -1;
+            }
+        }
+        return 0;
+    }
+
+    void set_access_pattern(PackHandle ph, AccessPattern pattern)
+    {
+        auto* h = (PackHandleImpl*)ph;
+        if (!h) return;
+        detail::Advice a = pattern == AccessPattern::Random ? detail::Advice::Random : pattern == AccessPattern::Sequential ? detail::Advice::Sequential : detail::Advice::Normal;
+        detail::advise_range(h->map, (size_t)h->hdr.pixels_off, h->map.bytes, a);
+    }
+
+    int prefetch_frames(PackHandle ph, const size_t* idx, size_t count)
+    {
+        auto* h = (PackHandleImpl*)ph;
+        if (!h || (count && !idx) || !advise_frames(h, idx, count, detail::Advice::WillNeed))
+        {
+            set_error(Error::BadConfig);
+            return -1;
+        }
+        return 0;
+    }
+
+    int evict_frames(PackHandle ph, const size_t* idx, size_t count)
+    {
+        auto* h = (PackHandleImpl*)ph;
+        if (!h || (count && !idx) || !advise_frames(h, idx, count, detail::Advice::DontNeed))
+        {
+            set_error(Error::BadConfig);
+            return -1;
+        }
+        return 0;
+    }
+
+    int set_access_schedule(PackHandle ph, const size_t* order, size_t count, uint32_t lookahead, bool evict_behind)
+    {
+        auto* h = (PackHandleImpl*)ph;
+        if (!h || (count && !order))
+        {
+            set_error(Error::BadConfig);
+            return -1;
+        }
+        for (size_t k = 0; k < count; k++)
+        {
+            if (order[k] >= h->frames.size())
+            {
+                set_error(Error::BadConfig);
+                return -1;
+            }
+        }
+        stop_readahead(h);
+        if (!count) return 0;
+        Readahead& r = h->ra;
+        r.order.assign(order, order + count);
+        r.pos = 0;
+        r.ahead = 0;
+        r.behind = 0;
+        r.lookahead = lookahead ? lookahead : 1;
+        r.evict_behind = evict_behind;
+        r.th = std::thread(readahead_loop, h);
+        return 0;
+    }
+
+    void advance_schedule(PackHandle ph, size_t position)
+    {
+        auto* h = (PackHandleImpl*)ph;
+        if (!h) return;
+        Readahead& r = h->ra;
+        {
+            std::lock_guard<std::mutex> lk(r.mu);
+            if (position > r.order.size()) position = r.order.size();
+            // Going backwards (a new epoch over the same order) restarts the window
+            if (position < r.pos)
+            {
+                r.ahead = position;
+                r.behind = position;
+            }
+            r.pos = position;
+        }
+        r.cv.notify_all();
+    }
+
+    const char* simd_kernel_name()
+    {
+        return detail::convert_kernels().name;
+    }
+
+    RayTableView ray_table(PackHandle ph, size_t i)
+    {
+        RayTableView v{};
+        auto* h = (PackHandleImpl*)ph;
+        if (!h || !h->rays || i >= h->frames.size()) return v;
+        const RayRec& r = ((const RayRec*)h->rays)[i];
+        uint64_t plane = 4ull * r.width * r.height;
+        for (uint64_t off : {r.dir_off, r.near_off, r.far_off})
+        {
+            if (off % 4 || off > h->rays_bytes || plane > h->rays_bytes - off) return v;
+        }
+        v.dir_oct = (const uint32_t*)(h->rays + r.dir_off);
+        v.t_near = (const float*)(h->rays + r.near_off);
+        v.t_far = (const float*)(h->rays + r.far_off);
+        v.width = r.width;
+        v.height = r.height;
+        return v;
+    }
+
+    ImportanceView importance_table(PackHandle ph, size_t i)
+    {
+        ImportanceView v{};
+        auto* h = (PackHandleImpl*)ph;
+        const ImpRec* r = h ? importance_rec(h, i) : nullptr;
+        if (!r) return v;
+        v.weight = (const float*)(h->imp + r->off);
+        v.cdf = v.weight + (size_t)r->tiles_x * r->tiles_y;
+        v.tiles_x = r->tiles_x;
+        v.tiles_y = r->tiles_y;
+        v.tile = ((const ImpHead*)h->imp)->tile;
+        return v;
+    }
+
+    FrameImportanceView frame_importance(PackHandle ph)
+    {
+        FrameImportanceView v{};
+        auto* h = (PackHandleImpl*)ph;
+        if (!h || !h->imp) return v;
+        if (!h->owned_imp.empty())
+        {
+            v.count = h->frames.size();
+            v.weight = h->owned_imp.data();
+            v.cdf = v.weight + v.count;
+            return v;
+        }
+        const ImpHead* ih = (const ImpHead*)h->imp;
+        v.weight = (const float*)(h->imp + ih->frames_off);
+        v.cdf = v.weight + ih->frame_count;
+        v.count = ih->frame_count;
+        return v;
+    }
+
+    int sample_rays(PackHandle ph, size_t count, const RaySampleConfig& cfg, const RayBatch& out)
+    {
+        auto* h = (PackHandleImpl*)ph;
+        bool outs_ok = true;
+        for (int c = 0; c < 3; c++) outs_ok = outs_ok && out.origin[c] && out.dir[c];
+        for (int c = 0; c < 4; c++) outs_ok = outs_ok && out.rgba[c];
+        if (h)
+        {
+            std::call_once(h->ray_cdf_once, [h]
+            {
+                size_t n = h->frames.size();
+                h->ray_cdf.resize(n + 1);
+                h->ray_cdf[0] = 0;
+                // Shard handles draw only from the frames they map
+                for (size_t i = 0; i < n; i++) h->ray_cdf[i + 1] = h->ray_cdf[i] + (owns_frame(h, i) ? (uint64_t)h->frames[i].width * h->frames[i].height : 0);
+            });
+        }
+        // Importance draws need every frame's table; a tile is 0 x 0 only in a damaged pack
+        uint32_t tile = h && h->imp ? ((const ImpHead*)h->imp)->tile : 0;
+        bool tables_ok = !cfg.importance || tile;
+        for (size_t i = 0; cfg.importance && tables_ok && i < h->frames.size(); i++)
+        {
+            const ImpRec* r = importance_rec(h, i);
+            tables_ok = r && r->tiles_x == (h->frames[i].width + tile - 1) / tile && r->tiles_y == (h->frames[i].height + tile - 1) / tile;
+        }
+        if (!h || !outs_ok || h->ray_cdf.back() == 0 || !tables_ok)
+        {
+            set_error(Error::BadConfig);
+            return -1;
+        }
+        const FrameImportanceView fimp = frame_importance(ph);
+        const CameraSOAView cams = camera_soa(ph);
+        const detail::ConvertKernels& k = detail::convert_kernels();
+        const std::vector<uint64_t>& cdf = h->ray_cdf;
+        uint64_t total = cdf.back();
+        PixelFormat pf = (PixelFormat)h->hdr.pixel_format;
+        bool packed = h->hdr.caps_bits & CapDeflate;
+        size_t chunks = (count + kRayChunk - 1) / kRayChunk;
+        uint32_t th = cfg.threads ? cfg.threads : std::thread::hardware_concurrency();
+        std::atomic<bool> failed{false};
+        detail::parallel_for(chunks, th ? th : 1, [&](size_t c)
+        {
+            size_t b = c * kRayChunk;
+            size_t n = count - b < kRayChunk ? count - b : kRayChunk;
+            uint64_t st = cfg.seed ^ (0xd1b54a32d192ed03ull * (c + 1));
+            std::vector<uint32_t> cam(n);
+            std::vector<float> px(n), py(n), rgba(n * 4);
+            std::vector<unsigned char> raw(n * 16);
+            // Compressed frames stay pinned for the whole chunk
+            std::unordered_map<size_t, ImageView> held;
+            auto release_held = [&]
+            {
+                for (const auto& kv : held) release_frame(ph, kv.first);
+            };
+            uint32_t ps = 0;
+            for (size_t j = 0; j < n; j++)
+            {
+                size_t f;
+                uint32_t x;
+                uint32_t y;
+                float pdf = 1.0f;
+                if (cfg.importance)
+                {
+                    // Frame and tile from one draw's two 24-bit halves, the pixel inside the tile from another
+                    uint64_t r = next_rand(st);
+                    f = sample_cdf(fimp.cdf, fimp.count, (float)(r >> 40) * 0x1.0p-24f);
+                    ImportanceView iv = importance_table(ph, f);
+                    size_t t = sample_cdf(iv.cdf, (size_t)iv.tiles_x * iv.tiles_y, (float)((r >> 16) & 0xffffff) * 0x1.0p-24f);
+                    const FrameRec& fr = h->frames[f];
+                    uint32_t x0 = (uint32_t)(t % iv.tiles_x) * tile;
+                    uint32_t y0 = (uint32_t)(t / iv.tiles_x) * tile;
+                    uint32_t span_x = std::min(tile, fr.width - x0);
+                    uint32_t span_y = std::min(tile, fr.height - y0);
+                    r = next_rand(st);
+                    x = x0 + (uint32_t)(((r >> 32) * span_x) >> 32);
+                    y = y0 + (uint32_t)(((r & 0xffffffffu) * span_y) >> 32);
+                    pdf = (float)((double)fimp.weight[f] * iv.weight[t] * (double)total / ((double)span_x * span_y));
+                }
+                else
+                {
+                    uint64_t u = (uint64_t)((double)(next_rand(st) >> 11) * 0x1.0p-53 * (double)total);
+                    if (u >= total) u = total - 1;
+                    f = (size_t)(std::upper_bound(cdf.begin(), cdf.end(), u) - cdf.begin()) - 1;
+                    uint64_t p = u - cdf[f];
+                    x = (uint32_t)(p % h->frames[f].width);
+                    y = (uint32_t)(p / h->frames[f].width);
+                }
+                const FrameRec& fr = h->frames[f];
+                float sx = 0.5f;
+                float sy = 0.5f;
+                if (cfg.jitter)
+                {
+                    uint64_t r = next_rand(st);
+                    sx = (float)(r >> 40) * 0x1.0p-24f;
+                    sy = (float)((r >> 16) & 0xffffff) * 0x1.0p-24f;
+                }
+                cam[j] = fr.camera_id;
+                px[j] = (float)x + sx;
+                py[j] = (float)y + sy;
+                if (out.frame) out.frame[b + j] = (uint32_t)f;
+                if (out.x) out.x[b + j] = x;
+                if (out.y) out.y[b + j] = y;
+                if (out.pdf) out.pdf[b + j] = pdf;
+                // Pixels cropped away read as the fill without mapping the frame
+                if (x - fr.roi_x >= fr.roi_w || y - fr.roi_y >= fr.roi_h)
+                {
+                    ps = fr.pixel_stride;
+                    std::memcpy(raw.data() + j * ps, h->fill, ps);
+                    continue;
+                }
+                ImageView v;
+                if (!packed)
+                {
+                    v = image_view(ph, f);
+                    if (!v.data)
+                    {
+                        set_error(Error::BadPack);
+                        failed.store(true, std::memory_order_relaxed);
+                        return;
+                    }
+                }
+                else if (auto it = held.find(f); it != held.end())
+                {
+                    v = it->second;
+                }
+                else
+                {
+                    v = acquire_frame(ph, f, 0);
+                    if (!v.data)
+                    {
+                        release_held();
+                        failed.store(true, std::memory_order_relaxed);
+                        return;
+                    }
+                    held.emplace(f, v);
+                }
+                ps = v.pixel_stride;
+                std::memcpy(raw.data() + j * ps, pixel_address(v, x - fr.roi_x, y - fr.roi_y), ps);
+            }
+            release_held();
+            if (!detail::decode_row_f32(raw.data(), pf, n, cfg.srgb_to_linear, rgba.data()))
+            {
+                set_error(Error::Unsupported);
+                failed.store(true, std::memory_order_relaxed);
+                return;
+            }
+            for (size_t j = 0; j < n; j++)
+            {
+                for (int ch = 0; ch < 4; ch++) out.rgba[ch][b + j] = rgba[j * 4 + ch];
+            }
+            float* o[3] = {out.origin[0] + b, out.origin[1] + b, out.origin[2] + b};
+            float* d[3] = {out.dir[0] + b, out.dir[1] + b, out.dir[2] + b};
+            k.ray_dirs(cams, cam.data(), px.data(), py.data(), n, o, d);
+        });
+        return failed.load() ? -1 : 0;
+    }
+
+    int read_patch(PackHandle ph, size_t i, uint32_t level, uint32_t x, uint32_t y, uint32_t width, uint32_t height, void* dst, size_t dst_row_stride)
+    {
+        ImageView v = acquire_frame(ph, i, level);
+        if (!v.data) return -1;
+        if (!dst || (uint64_t)x + width > v.width || (uint64_t)y + height > v.height)
+        {
+            release_frame(ph, i);
+            set_error(Error::BadConfig);
+            return -1;
+        }
+        size_t row_bytes = (size_t)width * v.pixel_stride;
+        size_t out_rs = dst_row_stride ? dst_row_stride : row_bytes;
+        char* out = (char*)dst;
+        for (uint32_t r = 0; r < height; r++)
+        {
+            unsigned char* d = (unsigned char*)out + r * out_rs;
+            const unsigned char* s = view_row(v, x, y + r, width, d);
+            if (s != d) std::memcpy(d, s, row_bytes);
+        }
+        release_frame(ph, i);
+        return 0;
+    }
+
+    int gather_frames(PackHandle ph, const size_t* idx, size_t count, const PixelRect& roi, TensorLayout layout, const TensorFormat& fmt, void* dst)
+    {
+        auto* h = (PackHandleImpl*)ph;
+        bool layout_ok = layout == TensorLayout::NHWC || layout == TensorLayout::NCHW;
+        bool type_ok = fmt.type == TensorType::U8 || fmt.type == TensorType::F16 || fmt.type == TensorType::F32;
+        if (!h || !dst || (count && !idx) || !layout_ok || !type_ok || (fmt.channels != 3 && fmt.channels != 4))
+        {
+            set_error(Error::BadConfig);
+            return -1;
+        }
+        if (!count) return 0;
+        for (size_t k = 0; k < count; k++)
+        {
+            if (idx[k] >= h->frames.size())
+            {
+                set_error(Error::BadConfig);
+                return -1;
+            }
+        }
+        GatherPlan g{};
+        const FrameRec& f0 = h->frames[idx[0]];
+        bool whole = !roi.width || !roi.height;
+        g.r = whole ? PixelRect{0, 0, f0.width, f0.height} : roi;
+        for (size_t k = 0; k < count; k++)
+        {
+            const FrameRec& fr = h->frames[idx[k]];
+            bool fits = whole ? fr.width == f0.width && fr.height == f0.height : (uint64_t)g.r.x + g.r.width <= fr.width && (uint64_t)g.r.y + g.r.height <= fr.height;
+            if (!fits)
+            {
+                set_error(Error::BadConfig);
+                return -1;
+            }
+        }
+        g.layout = layout;
+        g.type = fmt.type;
+        g.channels = fmt.channels;
+        g.elem = fmt.type == TensorType::U8 ? 1 : fmt.type == TensorType::F16 ? 2 : 4;
+        g.srgb = fmt.srgb_to_linear;
+        g.shade.straight = fmt.composite && !(h->hdr.caps_bits & CapPremultipliedAlpha);
+        bool identity = !fmt.srgb_to_linear && !fmt.composite;
+        for (int c = 0; c < 4; c++)
+        {
+            if (c < 3) g.shade.background[c] = fmt.composite ? fmt.background[c] : 0.0f;
+            g.shade.scale[c] = fmt.std[c] != 0.0f ? 1.0f / fmt.std[c] : 1.0f;
+            g.shade.bias[c] = -fmt.mean[c] * g.shade.scale[c];
+            identity = identity && g.shade.scale[c] == 1.0f && g.shade.bias[c] == 0.0f;
+        }
+        PixelFormat pf = (PixelFormat)h->hdr.pixel_format;
+        g.copy8 = identity && fmt.type == TensorType::U8 && (pf == PixelFormat::RGBA8 || (pf == PixelFormat::RGB8 && fmt.channels == 3));
+        if (!g.r.width || !g.r.height) return 0;
+
+        std::vector<ImageView> views(count);
+        if (acquire_frames(ph, idx, count, 0, views.data(), fmt.threads) != 0) return -1;
+        size_t frame_bytes = (size_t)g.r.width * g.r.height * g.channels * g.elem;
+        size_t row_bytes = (size_t)g.r.width * g.channels * g.elem;
+        uint32_t th = fmt.threads ? fmt.threads : std::thread::hardware_concurrency();
+        std::atomic<bool> failed{false};
+        detail::parallel_for(count, th ? th : 1, [&](size_t k)
+        {
+            char* base = (char*)dst + k * frame_bytes;
+            detail::for_bands(g.r.height, row_bytes, [&](size_t y0, size_t y1)
+            {
+                if (!gather_rows(g, views[k], base, y0, y1)) failed.store(true, std::memory_order_relaxed);
+            });
+        });
+        for (size_t k = 0; k < count; k++) release_frame(ph, idx[k]);
+        if (failed.load())
+        {
+            set_error(Error::Unsupported);
+            return -1;
+        }
+        return 0;
+    }
 }
@@ -0,0 +1,152 @@
+#include "exr.h"
+#include "mmio.h"
+#include <algorithm>
+#include <cstring>
+#include <exception>
+#include <memory>
+#include <Iex.h>
+#include <ImathBox.h>
+#include <ImfChannelList.h>
+#include <ImfFrameBuffer.h>
+#include <ImfHeader.h>
+#include <ImfIO.h>
+#include <ImfInputFile.h>
+#include <ImfThreading.h>
+
+namespace dataset::detail
+{
+    namespace
+    {
+        // OpenEXR reads the mapped file through this, so its bytes are in memory for the caller as well
+        class MappedStream : public Imf::IStream
+        {
+        public:
+            MappedStream(const char* path, const mmap_ro& m) : Imf::IStream(path), m_(m)
+            {
+            }
+
+            bool isMemoryMapped() const override
+            {
+                return true;
+            }
+
+            bool read(char c[], int n) override
+            {
+                if ((size_t)n > m_.bytes - std::min(pos_, m_.bytes)) throw Iex::InputExc("Unexpected end of file.");
+                std::memcpy(c, (const char*)m_.ptr + pos_, (size_t)n);
+                pos_ += (size_t)n;
+                return pos_ < m_.bytes;
+            }
+
+            char* readMemoryMapped(int n) override
+            {
+                if ((size_t)n > m_.bytes - std::min(pos_, m_.bytes)) throw Iex::InputExc("Reading past end of file.");
+                char* p = (char*)m_.ptr + pos_;
+                pos_ += (size_t)n;
+                return p;
+            }
+
+            uint64_t tellg() override
+            {
+                return pos_;
+            }
+
+            void seekg(uint64_t pos) override
+            {
+                pos_ = (size_t)pos;
+            }
+
+        private:
+            const mmap_ro& m_;
+            size_t pos_ = 0;
+        };
+    }
+
+    struct ExrSrc
+    {
+        mmap_ro map;
+        std::unique_ptr<MappedStream> stream;
+        std::unique_ptr<Imf::InputFile> in;
+        Imath::Box2i dw;
+        bool alpha;
+
+        ~ExrSrc()
+        {
+            in.reset();
+            stream.reset();
+            munmap_file(map);
+        }
+    };
+
+    // OpenEXR reports every failure by exception; none of them leave this file
+    ExrSrc* exr_open(const std::string& path)
+    {
+        try
+        {
+            auto s = std::make_unique<ExrSrc>();
+            s->map = mmap_file_ro(path);
+            if (!s->map.ptr) return nullptr;
+            s->stream = std::make_unique<MappedStream>(path.c_str(), s->map);
+            s->in = std::make_unique<Imf::InputFile>(*s->stream, Imf::globalThreadCount());
+            s->dw = s->in->header().dataWindow();
+            s->alpha = s->in->header().channels().findChannel("A") != nullptr;
+            if (s->dw.max.x < s->dw.min.x || s->dw.max.y < s->dw.min.y) return nullptr;
+            return s.release();
+        }
+        catch (const std::exception&)
+        {
+            return nullptr;
+        }
+    }
+
+    void exr_close(ExrSrc* s)
+    {
+        delete s;
+    }
+
+    void exr_size(const ExrSrc* s, uint32_t& w, uint32_t& h)
+    {
+        w = (uint32_t)((int64_t)s->dw.max.x - s->dw.min.x + 1);
+        h = (uint32_t)((int64_t)s->dw.max.y - s->dw.min.y + 1);
+    }
+
+    bool exr_has_alpha(const ExrSrc* s)
+    {
+        return s->alpha;
+    }
+
+    const void* exr_bytes(const ExrSrc* s, size_t& bytes)
+    {
+        bytes = s->map.bytes;
+        return s->map.ptr;
+    }
+
+    bool exr_read(ExrSrc* s, uint32_t y0, uint32_t y1, bool half, uint32_t channels, size_t pixel_stride, size_t row_stride, void* dst)
+    {
+        static const char* const names[4] = {"R", "G", "B", "A"};
+        Imf::PixelType t = half ? Imf::HALF : Imf::FLOAT;
+        size_t cb = half ? 2 : 4;
+        // The slices are anchored on the band, so its first row lands at dst
+        Imath::Box2i band(Imath::V2i(s->dw.min.x, s->dw.min.y + (int)y0), Imath::V2i(s->dw.max.x, s->dw.min.y + (int)y1 - 1));
+        try
+        {
+            Imf::FrameBuffer fb;
+            for (uint32_t c = 0; c < channels && c < 4; c++)
+            {
+                fb.insert(names[c], Imf::Slice::Make(t, (char*)dst + c * cb, band, pixel_stride, row_stride, 1, 1, c == 3 ? 1.0 : 0.0));
+            }
+            s->in->setFrameBuffer(fb);
+            s->in->readPixels(band.min.y, band.max.y);
+            return true;
+        }
+        catch (const std::exception&)
+        {
+            return false;
+        }
+    }
+
+    void exr_set_threads(uint32_t n)
+    {
+        if (Imf::globalThreadCount() != (int)n) Imf::setGlobalThreadCount((int)n);
+    }
+}
@@ -0,0 +1,27 @@
+#ifndef DATASET_EXR_H
+#define DATASET_EXR_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace dataset::detail
+{
+    struct ExrSrc;
+
+    // Maps a scanline or tiled OpenEXR file and opens its first part for reading the data window; nullptr when
+    // it cannot be read. Decoding is spread over OpenEXR's global thread pool.
+    ExrSrc* exr_open(const std::string& path);
+    void exr_close(ExrSrc* s);
+    void exr_size(const ExrSrc* s, uint32_t& w, uint32_t& h);
+    bool exr_has_alpha(const ExrSrc* s);
+    // The file as read by the decoder, mapped for the life of s
+    const void* exr_bytes(const ExrSrc* s, size_t& bytes);
+    // Reads rows [y0, y1) of the data window as R, G, B and, with channels 4, A into dst (row y0 first) as
+    // half or float. Missing color channels read as 0 and a missing A as 1.
+    bool exr_read(ExrSrc* s, uint32_t y0, uint32_t y1, bool half, uint32_t channels, size_t pixel_stride, size_t row_stride, void* dst);
+    // Sizes OpenEXR's global thread pool; 0 decodes on the calling thread
+    void exr_set_threads(uint32_t n);
+}
+
+#endif
@@ -0,0 +1,145 @@
+#include "mips.h"
+#include <vector>
+#include <cmath>
+#include "parallel.h"
+
+namespace dataset::detail
+{
+    namespace
+    {
+        struct Taps
+        {
+            int first;
+            std::vector<float> w;
+        };
+
+        double bessel_i0(double x)
+        {
+            double sum = 1.0;
+            double term = 1.0;
+            double q = x * x / 4.0;
+            for (int k = 1; k < 32; k++)
+            {
+                term *= q / ((double)k * k);
+                sum += term;
+                if (term < sum * 1e-12) break;
+            }
+            return sum;
+        }
+
+        double kaiser(double x)
+        {
+            const double width = 3.0;
+            const double alpha = 4.0;
+            double t = x / width;
+            if (t * t >= 1.0) return 0.0;
+            double sinc = x == 0.0 ? 1.0 : std::sin(3.14159265358979323846 * x) / (3.14159265358979323846 * x);
+            return sinc * bessel_i0(alpha * std::sqrt(1.0 - t * t)) / bessel_i0(alpha);
+        }
+
+        std::vector<Taps> make_taps(uint32_t sn, uint32_t dn, MipFilter filter)
+        {
+            std::vector<Taps> taps(dn);
+            double scale = (double)sn / (double)dn;
+            for (uint32_t x = 0; x < dn; x++)
+            {
+                Taps& t = taps[x];
+                if (filter == MipFilter::Box)
+                {
+                    double lo = x * scale;
+                    double hi = lo + scale;
+                    int first = (int)std::floor(lo);
+                    int last = (int)std::ceil(hi) - 1;
+                    if (last >= (int)sn) last = (int)sn - 1;
+                    t.first = first;
+                    for (int i = first; i <= last; i++)
+                    {
+                        double a = i < lo ? lo : (double)i;
+                        double b = i + 1 > hi ? hi : (double)(i + 1);
+                        t.w.push_back((float)((b - a) / scale));
+                    }
+                    continue;
+                }
+                double center = (x + 0.5) * scale;
+                double radius = 3.0 * scale;
+                int first = (int)std::floor(center - radius);
+                int last = (int)std::ceil(center + radius);
+                // Taps outside the image clamp to the edge pixel
+                int lo = first < 0 ? 0 : first >= (int)sn ? (int)sn - 1 : first;
+                int hi = last < 0 ? 0 : last >= (int)sn ? (int)sn - 1 : last;
+                std::vector<double> w((size_t)(hi - lo + 1), 0.0);
+                double sum = 0.0;
+                for (int i = first; i <= last; i++)
+                {
+                    double k = kaiser((i + 0.5 - center) / scale);
+                    if (k == 0.0) continue;
+                    int c = i < lo ? lo : i > hi ? hi : i;
+                    w[(size_t)(c - lo)] += k;
+                    sum += k;
+                }
+                t.first = lo;
+                for (double v : w) t.w.push_back((float)(v / sum));
+            }
+            return taps;
+        }
+    }
+
+    uint32_t mip_chain_length(uint32_t w, uint32_t h)
+    {
+        uint32_t n = 1;
+        while (w > 1 || h > 1)
+        {
+            w = w > 1 ? w >> 1 : 1;
+            h = h > 1 ? h >> 1 : 1;
+            n++;
+        }
+        return n;
+    }
+
+    void downsample_rgba32f(const float* src, uint32_t sw, uint32_t sh, float* dst, uint32_t dw, uint32_t dh, MipFilter filter)
+    {
+        std::vector<Taps> tx = make_taps(sw, dw, filter);
+        std::vector<Taps> ty = make_taps(sh, dh, filter);
+        std::vector<float> tmp((size_t)dw * sh * 4);
+        size_t row_bytes = (size_t)dw * 16;
+        for_bands(sh, row_bytes, [&](size_t y0, size_t y1)
+        {
+            for (size_t y = y0; y < y1; y++)
+            {
+                const float* s = src + y * sw * 4;
+                float* d = tmp.data() + y * dw * 4;
+                for (uint32_t x = 0; x < dw; x++)
+                {
+                    float acc[4] = {0, 0, 0, 0};
+                    const Taps& t = tx[x];
+                    for (size_t k = 0; k < t.w.size(); k++)
+                    {
+                        const float* p = s + (size_t)(t.first + k) * 4;
+                        for (int c = 0; c < 4; c++) acc[c] += p[c] * t.w[k];
+                    }
+                    for (int c = 0; c < 4; c++) d[x * 4 + c] = acc[c];
+                }
+            }
+        });
+        for_bands(dh, row_bytes, [&](size_t y0, size_t y1)
+        {
+            for (size_t y = y0; y < y1; y++)
+            {
+                const Taps& t = ty[y];
+                float* d = dst + y * dw * 4;
+                for (size_t i = 0; i < (size_t)dw * 4; i++) d[i] = 0.0f;
+                for (size_t k = 0; k < t.w.size(); k++)
+                {
+                    const float* s = tmp.data() + (size_t)(t.first + k) * dw * 4;
+                    float wk = t.w[k];
+                    for (size_t i = 0; i < (size_t)dw * 4; i++) d[i] += s[i] * wk;
+                }
+                // Kaiser lobes can ring below zero
+                if (filter == MipFilter::Kaiser)
+                {
+                    for (size_t i = 0; i < (size_t)dw * 4; i++) d[i] = d[i] < 0.0f ? 0.0f : d[i];
+                }
+            }
+        });
+    }
+}
@@ -0,0 +1,18 @@
+#ifndef DATASET_MIPS_H
+#define DATASET_MIPS_H
+
+#include <cstdint>
+#include <cstddef>
+#include "dataset.h"
+
+namespace dataset::detail
+{
+    // Number of levels down to 1x1, level l being max(1, w >> l) by max(1, h >> l)
+    uint32_t mip_chain_length(uint32_t w, uint32_t h);
+
+    // Separable downsample of premultiplied linear float RGBA in row bands; box is exact area averaging,
+    // Kaiser is a width 3, alpha 4 Kaiser-windowed sinc measured in destination texels
+    void downsample_rgba32f(const float* src, uint32_t sw, uint32_t sh, float* dst, uint32_t dw, uint32_t dh, MipFilter filter);
+}
+
+#endif
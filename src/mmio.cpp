@@ -1,4 +1,18 @@
 #include "mmio.h"
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <thread>
+#include <vector>
+#if !defined(_WIN32)
+#include <sys/file.h>
+#include <climits>
+#endif
 
 namespace dataset::detail
 {
@@ -53,6 +67,688 @@ namespace dataset::detail
 
     void munmap_file(mmap_ro& m)
     {
+#if defined(_WIN32)
+        if (m.hmap)
+        {
+            if (m.ptr) UnmapViewOfFile(m.ptr);
+            CloseHandle((HANDLE)m.hmap);
+        }
+        else if (m.ptr)
+        {
+            VirtualFree(m.base ? m.base : m.ptr, 0, MEM_RELEASE);
+        }
+        if (m.hfile) CloseHandle((HANDLE)m.hfile);
+        m.ptr = nullptr; m.bytes = 0; m.base = nullptr; m.span = 0; m.file_off = 0; m.hmap = nullptr; m.hfile = nullptr;
+#else
+        if (m.ptr) munmap(m.base ? m.base : m.ptr, m.span ? m.span : m.bytes);
+        if (m.fd >= 0) close(m.fd);
+        m.ptr = nullptr;
+        m.bytes = 0;
+        m.base = nullptr;
+        m.span = 0;
+        m.file_off = 0;
+        m.fd = -1;
+#endif
+    }
+
+    namespace
+    {
+        constexpr size_t kReadChunk = size_t(8) << 20;
+
+#if defined(_WIN32)
+        using native_file = HANDLE;
+#else
+        using native_file = int;
+#endif
+
+        // Fills dst with the first bytes of the file, threads reading disjoint chunks
+        bool read_parallel(native_file f, char* dst, size_t bytes, uint32_t threads)
+        {
+            size_t chunks = (bytes + kReadChunk - 1) / kReadChunk;
+            std::atomic<size_t> next{0};
+            std::atomic<bool> ok{true};
+            auto work = [&]
+            {
+                for (;;)
+                {
+                    size_t c = next.fetch_add(1, std::memory_order_relaxed);
+                    if (c >= chunks || !ok.load(std::memory_order_relaxed)) return;
+                    size_t off = c * kReadChunk;
+                    size_t n = bytes - off < kReadChunk ? bytes - off : kReadChunk;
+                    while (n)
+                    {
+#if defined(_WIN32)
+                        OVERLAPPED ov{};
+                        ov.Offset = (DWORD)(off & 0xffffffff);
+                        ov.OffsetHigh = (DWORD)((uint64_t)off >> 32);
+                        DWORD got = 0;
+                        if (!ReadFile(f, dst + off, (DWORD)n, &got, &ov) || got == 0)
+                        {
+                            ok.store(false);
+                            return;
+                        }
+                        size_t r = got;
+#else
+                        ssize_t r = pread(f, dst + off, n, (off_t)off);
+                        if (r < 0 && errno == EINTR) continue;
+                        if (r <= 0)
+                        {
+                            ok.store(false);
+                            return;
+                        }
+#endif
+                        off += (size_t)r;
+                        n -= (size_t)r;
+                    }
+                }
+            };
+            if (!threads) threads = std::thread::hardware_concurrency();
+            if (threads > chunks) threads = (uint32_t)chunks;
+            std::vector<std::thread> pool;
+            for (uint32_t t = 1; t < threads; t++) pool.emplace_back(work);
+            work();
+            for (auto& t : pool) t.join();
+            return ok.load();
+        }
+
+#if !defined(_WIN32)
+        // Precedes the pack bytes in a shared segment; ready flips once hydration is complete
+        struct ShmHead
+        {
+            char magic[8];
+            uint64_t bytes;
+            uint32_t ready;
+        };
+
+        size_t shm_head_bytes()
+        {
+            return (size_t)sysconf(_SC_PAGESIZE);
+        }
+
+        std::string shm_name_for(const std::string& path, const std::string& name)
+        {
+            if (!name.empty()) return name[0] == '/' ? name : "/" + name;
+            struct stat st;
+            if (stat(path.c_str(), &st) < 0) return std::string();
+            char real[PATH_MAX];
+            std::string key = realpath(path.c_str(), real) ? real : path;
+            key += ":" + std::to_string((long long)st.st_size) + ":" + std::to_string((long long)st.st_mtime);
+            uint64_t hsh = 1469598103934665603ull;
+            for (unsigned char c : key) hsh = (hsh ^ c) * 1099511628211ull;
+            char buf[40];
+            std::snprintf(buf, sizeof(buf), "/hostpack-%016llx", (unsigned long long)hsh);
+            return buf;
+        }
+#endif
+    }
+
+    mmap_ro mmap_file_populate(const std::string& path)
+    {
+#if defined(_WIN32)
+        mmap_ro m = mmap_file_ro(path);
+        if (m.ptr)
+        {
+            WIN32_MEMORY_RANGE_ENTRY r{m.ptr, m.bytes};
+            PrefetchVirtualMemory(GetCurrentProcess(), 1, &r, 0);
+            volatile const char* p = (const char*)m.ptr;
+            for (size_t i = 0; i < m.bytes; i += 4096) (void)p[i];
+        }
+        return m;
+#else
+        mmap_ro m;
+        int fd = open(path.c_str(), O_RDONLY);
+        if (fd < 0) return m;
+        struct stat st;
+        if (fstat(fd, &st) < 0 || st.st_size == 0)
+        {
+            close(fd);
+            return m;
+        }
+        size_t n = (size_t)st.st_size;
+        int flags = MAP_PRIVATE;
+#if defined(MAP_POPULATE)
+        flags |= MAP_POPULATE;
+#endif
+        void* p = mmap(nullptr, n, PROT_READ, flags, fd, 0);
+        if (p == MAP_FAILED)
+        {
+            close(fd);
+            return m;
+        }
+#if !defined(MAP_POPULATE)
+        madvise(p, n, MADV_WILLNEED);
+        size_t page = (size_t)sysconf(_SC_PAGESIZE);
+        volatile const char* q = (const char*)p;
+        for (size_t i = 0; i < n; i += page) (void)q[i];
+#endif
+        m.ptr = p;
+        m.bytes = n;
+        m.fd = fd;
+        return m;
+#endif
+    }
+
+    mmap_ro copy_file_anon(const std::string& path, uint32_t threads)
+    {
+        mmap_ro m;
+#if defined(_WIN32)
+        HANDLE hf = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (hf == INVALID_HANDLE_VALUE) return m;
+        LARGE_INTEGER sz;
+        if (!GetFileSizeEx(hf, &sz) || sz.QuadPart == 0)
+        {
+            CloseHandle(hf);
+            return m;
+        }
+        size_t n = (size_t)sz.QuadPart;
+        void* p = VirtualAlloc(nullptr, n, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+        bool ok = p && read_parallel(hf, (char*)p, n, threads);
+        CloseHandle(hf);
+        if (!ok)
+        {
+            if (p) VirtualFree(p, 0, MEM_RELEASE);
+            return m;
+        }
+        DWORD old;
+        VirtualProtect(p, n, PAGE_READONLY, &old);
+        m.ptr = p;
+        m.bytes = n;
+#else
+        int fd = open(path.c_str(), O_RDONLY);
+        if (fd < 0) return m;
+        struct stat st;
+        if (fstat(fd, &st) < 0 || st.st_size == 0)
+        {
+            close(fd);
+            return m;
+        }
+        size_t n = (size_t)st.st_size;
+        void* p = MAP_FAILED;
+        size_t span = n;
+#if defined(MAP_HUGETLB)
+        // Explicit huge pages only exist when the administrator reserved them; fall back silently
+        size_t huge = size_t(2) << 20;
+        span = (n + huge - 1) & ~(huge - 1);
+        p = mmap(nullptr, span, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+#endif
+        if (p == MAP_FAILED)
+        {
+            span = n;
+            p = mmap(nullptr, span, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+            if (p == MAP_FAILED)
+            {
+                close(fd);
+                return m;
+            }
+#if defined(MADV_HUGEPAGE)
+            madvise(p, span, MADV_HUGEPAGE);
+#endif
+        }
+        bool ok = read_parallel(fd, (char*)p, n, threads);
+        close(fd);
+        if (!ok)
+        {
+            munmap(p, span);
+            return m;
+        }
+        mprotect(p, span, PROT_READ);
+        m.ptr = p;
+        m.bytes = n;
+        m.span = span;
+#endif
+        return m;
+    }
+
+    mmap_ro map_file_shared(const std::string& path, const std::string& name, uint32_t threads, bool& attached)
+    {
+        mmap_ro m;
+        attached = false;
+#if defined(_WIN32)
+        (void)path;
+        (void)name;
+        (void)threads;
+        return m;
+#else
+        std::string shm = shm_name_for(path, name);
+        if (shm.empty()) return m;
+        size_t head = shm_head_bytes();
+        for (int attempt = 0;; attempt++)
+        {
+            int sfd = shm_open(shm.c_str(), O_RDWR | O_CREAT | O_EXCL, 0644);
+            if (sfd >= 0)
+            {
+                // Creator: hold the lock until every byte is in place so siblings block instead of polling
+                flock(sfd, LOCK_EX);
+                int fd = open(path.c_str(), O_RDONLY);
+                struct stat st;
+                bool ok = fd >= 0 && fstat(fd, &st) == 0 && st.st_size > 0;
+                size_t n = ok ? (size_t)st.st_size : 0;
+                ok = ok && ftruncate(sfd, (off_t)(head + n)) == 0;
+                void* p = ok ? mmap(nullptr, head + n, PROT_READ | PROT_WRITE, MAP_SHARED, sfd, 0) : MAP_FAILED;
+                ok = p != MAP_FAILED;
+                if (ok)
+                {
+#if defined(MADV_HUGEPAGE)
+                    madvise(p, head + n, MADV_HUGEPAGE);
+#endif
+                    ok = read_parallel(fd, (char*)p + head, n, threads);
+                }
+                if (fd >= 0) close(fd);
+                if (!ok)
+                {
+                    if (p != MAP_FAILED) munmap(p, head + n);
+                    shm_unlink(shm.c_str());
+                    flock(sfd, LOCK_UN);
+                    close(sfd);
+                    return m;
+                }
+                ShmHead* sh = (ShmHead*)p;
+                std::memcpy(sh->magic, "HPKSHM1", 8);
+                sh->bytes = n;
+                std::atomic_thread_fence(std::memory_order_release);
+                sh->ready = 1;
+                mprotect(p, head + n, PROT_READ);
+                flock(sfd, LOCK_UN);
+                m.base = p;
+                m.span = head + n;
+                m.ptr = (char*)p + head;
+                m.bytes = n;
+                m.fd = sfd;
+                return m;
+            }
+            if (errno != EEXIST) return m;
+            sfd = shm_open(shm.c_str(), O_RDONLY, 0);
+            if (sfd < 0)
+            {
+                // Unlinked between the two opens; create it afresh
+                if (errno == ENOENT && attempt == 0) continue;
+                return m;
+            }
+            // The creator sizes the segment right after taking the lock; until then there is nothing to wait on
+            struct stat st{};
+            for (int tries = 0; tries < 10000; tries++)
+            {
+                if (fstat(sfd, &st) < 0 || st.st_size > 0) break;
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            }
+            if (flock(sfd, LOCK_SH) < 0 || fstat(sfd, &st) < 0)
+            {
+                close(sfd);
+                return m;
+            }
+            flock(sfd, LOCK_UN);
+            if (st.st_size > (off_t)head)
+            {
+                void* p = mmap(nullptr, (size_t)st.st_size, PROT_READ, MAP_SHARED, sfd, 0);
+                if (p == MAP_FAILED)
+                {
+                    close(sfd);
+                    return m;
+                }
+                const ShmHead* sh = (const ShmHead*)p;
+                std::atomic_thread_fence(std::memory_order_acquire);
+                if (sh->ready && std::memcmp(sh->magic, "HPKSHM1", 8) == 0 && head + sh->bytes <= (size_t)st.st_size)
+                {
+                    m.base = p;
+                    m.span = (size_t)st.st_size;
+                    m.ptr = (char*)p + head;
+                    m.bytes = sh->bytes;
+                    m.fd = sfd;
+                    attached = true;
+                    return m;
+                }
+                munmap(p, (size_t)st.st_size);
+            }
+            // The lock was free, so the creator died mid-hydration: drop its segment and hydrate once more. The
+            // name is only unlinked while it still refers to the dead segment, not one a sibling already replaced.
+            int again = shm_open(shm.c_str(), O_RDONLY, 0);
+            struct stat now{};
+            if (again >= 0 && fstat(again, &now) == 0 && now.st_ino == st.st_ino && now.st_dev == st.st_dev)
+            {
+                shm_unlink(shm.c_str());
+            }
+            if (again >= 0) close(again);
+            close(sfd);
+            if (attempt > 0) return m;
+        }
+#endif
+    }
+
+    bool unlink_shared(const std::string& path, const std::string& name)
+    {
+#if defined(_WIN32)
+        (void)path;
+        (void)name;
+        return false;
+#else
+        std::string shm = shm_name_for(path, name);
+        return !shm.empty() && shm_unlink(shm.c_str()) == 0;
+#endif
+    }
+
+    mmap_ro sub_view(const mmap_ro& m, size_t off, size_t bytes)
+    {
+        mmap_ro v;
+        if (!m.ptr || off > m.bytes || bytes > m.bytes - off) return v;
+        v.ptr = (char*)m.ptr + off;
+        v.bytes = bytes;
+        v.file_off = m.file_off + off;
+#if defined(_WIN32)
+        v.hfile = m.hfile;
+#else
+        v.fd = m.fd;
+#endif
+        return v;
+    }
+
+    mmap_ro reserve_span(size_t bytes)
+    {
+        mmap_ro m;
+#if !defined(_WIN32)
+        int flags = MAP_PRIVATE | MAP_ANONYMOUS;
+#if defined(MAP_NORESERVE)
+        flags |= MAP_NORESERVE;
+#endif
+        void* p = bytes ? mmap(nullptr, bytes, PROT_NONE, flags, -1, 0) : MAP_FAILED;
+        if (p == MAP_FAILED) return m;
+        m.ptr = p;
+        m.bytes = bytes;
+#endif
+        return m;
+    }
+
+    mmap_ro map_file_at(const std::string& path, void* addr, size_t bytes, bool populate)
+    {
+        mmap_ro m;
+#if !defined(_WIN32)
+        int fd = open(path.c_str(), O_RDONLY);
+        if (fd < 0) return m;
+        struct stat st;
+        if (fstat(fd, &st) < 0 || !bytes || (uint64_t)st.st_size != bytes)
+        {
+            close(fd);
+            return m;
+        }
+        size_t n = bytes;
+        int flags = MAP_PRIVATE | MAP_FIXED;
+#if defined(MAP_POPULATE)
+        if (populate) flags |= MAP_POPULATE;
+#endif
+        void* p = mmap(addr, n, PROT_READ, flags, fd, 0);
+        if (p == MAP_FAILED)
+        {
+            close(fd);
+            return m;
+        }
+#if !defined(MAP_POPULATE)
+        if (populate) madvise(p, n, MADV_WILLNEED);
+#endif
+        m.ptr = p;
+        m.bytes = n;
+        m.fd = fd;
+#else
+        (void)path;
+        (void)addr;
+        (void)bytes;
+        (void)populate;
+#endif
+        return m;
+    }
+
+    void release_view(mmap_ro& m)
+    {
+#if !defined(_WIN32)
+        if (m.fd >= 0) close(m.fd);
+        m.fd = -1;
+#endif
+        m.ptr = nullptr;
+        m.bytes = 0;
+    }
+
+    bool lock_resident(const mmap_ro& m)
+    {
+        if (!m.ptr) return false;
+#if defined(_WIN32)
+        return VirtualLock(m.ptr, m.bytes) != 0;
+#else
+        return mlock(m.ptr, m.bytes) == 0;
+#endif
+    }
+
+    bool resident_pages(const mmap_ro& m, size_t& page_bytes, size_t& lead, std::vector<unsigned char>& pages)
+    {
+        if (!m.ptr) return false;
+#if defined(_WIN32)
+        SYSTEM_INFO si;
+        GetSystemInfo(&si);
+        page_bytes = si.dwPageSize;
+        lead = (size_t)((uintptr_t)m.ptr % page_bytes);
+        // Private copies are committed memory; file views report nothing without a working-set walk
+        if (m.hmap) return false;
+        pages.assign((lead + m.bytes + page_bytes - 1) / page_bytes, 1);
+        return true;
+#else
+        page_bytes = (size_t)sysconf(_SC_PAGESIZE);
+        lead = (size_t)((uintptr_t)m.ptr % page_bytes);
+        size_t n = (lead + m.bytes + page_bytes - 1) / page_bytes;
+#if defined(__APPLE__)
+        std::vector<char> vec(n);
+#else
+        std::vector<unsigned char> vec(n);
+#endif
+        if (mincore((char*)m.ptr - lead, lead + m.bytes, vec.data()) != 0) return false;
+        pages.resize(n);
+        for (size_t i = 0; i < n; i++) pages[i] = vec[i] & 1;
+        return true;
+#endif
+    }
+
+    size_t resident_bytes(const mmap_ro& m)
+    {
+        size_t page = 0;
+        size_t lead = 0;
+        std::vector<unsigned char> pages;
+        if (!resident_pages(m, page, lead, pages)) return 0;
+        size_t n = 0;
+        for (unsigned char p : pages) n += p;
+        n *= page;
+        return n > m.bytes ? m.bytes : n;
+    }
+
+    double thread_cpu_seconds()
+    {
+#if defined(_WIN32)
+        FILETIME c, e, k, u;
+        if (!GetThreadTimes(GetCurrentThread(), &c, &e, &k, &u)) return 0;
+        auto ticks = [](const FILETIME& f) { return ((uint64_t)f.dwHighDateTime << 32) | f.dwLowDateTime; };
+        return (ticks(k) + ticks(u)) * 1e-7;
+#else
+        timespec ts;
+        if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts) != 0) return 0;
+        return ts.tv_sec + ts.tv_nsec * 1e-9;
+#endif
+    }
+
+    double process_cpu_seconds()
+    {
+#if defined(_WIN32)
+        FILETIME c, e, k, u;
+        if (!GetProcessTimes(GetCurrentProcess(), &c, &e, &k, &u)) return 0;
+        auto ticks = [](const FILETIME& f) { return ((uint64_t)f.dwHighDateTime << 32) | f.dwLowDateTime; };
+        return (ticks(k) + ticks(u)) * 1e-7;
+#else
+        timespec ts;
+        if (clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts) != 0) return 0;
+        return ts.tv_sec + ts.tv_nsec * 1e-9;
+#endif
+    }
+
+    bool advise_range(const mmap_ro& m, size_t off, size_t bytes, Advice a)
+    {
+        if (!m.ptr || off >= m.bytes) return false;
+        if (bytes > m.bytes - off) bytes = m.bytes - off;
+#if defined(_WIN32)
+        // Windows only has a prefetch hint for file views
+        if (a != Advice::WillNeed) return true;
+        WIN32_MEMORY_RANGE_ENTRY r;
+        r.VirtualAddress = (char*)m.ptr + off;
+        r.NumberOfBytes = bytes;
+        return PrefetchVirtualMemory(GetCurrentProcess(), 1, &r, 0) != 0;
+#else
+        // Page rounding goes by address: archive scene views need not start on a page
+        size_t page = (size_t)sysconf(_SC_PAGESIZE);
+        uintptr_t base = (uintptr_t)m.ptr;
+        uintptr_t lo = (base + off) & ~(uintptr_t)(page - 1);
+        uintptr_t hi = base + off + bytes;
+        char* p = (char*)lo;
+        size_t n = hi - lo;
+        switch (a)
+        {
+        case Advice::Normal:
+            return madvise(p, n, MADV_NORMAL) == 0;
+        case Advice::Random:
+            return madvise(p, n, MADV_RANDOM) == 0;
+        case Advice::Sequential:
+            return madvise(p, n, MADV_SEQUENTIAL) == 0;
+        case Advice::WillNeed:
+#if defined(POSIX_FADV_WILLNEED)
+            posix_fadvise(m.fd, (off_t)(m.file_off + off), (off_t)bytes, POSIX_FADV_WILLNEED);
+#endif
+            return madvise(p, n, MADV_WILLNEED) == 0;
+        case Advice::DontNeed:
+        {
+            // Anonymous copies (HugeCopy) have nothing to fault back in from: MADV_DONTNEED would zero them
+            if (m.fd < 0) return true;
+            // Only whole pages inside the range may be dropped; neighbouring frames share the edge pages
+            uintptr_t in_lo = (base + off + page - 1) & ~(uintptr_t)(page - 1);
+            uintptr_t in_hi = off + bytes == m.bytes ? hi : hi & ~(uintptr_t)(page - 1);
+            if (in_hi <= in_lo) return true;
+            bool ok = madvise((char*)in_lo, in_hi - in_lo, MADV_DONTNEED) == 0;
+#if defined(POSIX_FADV_DONTNEED)
+            posix_fadvise(m.fd, (off_t)(m.file_off + (in_lo - base)), (off_t)(in_hi - in_lo), POSIX_FADV_DONTNEED);
+#endif
+            return ok;
+        }
+        }
+        return false;
+#endif
+    }
+
+    bool copy_ranges(const mmap_ro& src, const std::string& dst_path, const std::vector<CopyRange>& ranges)
+    {
+        for (const auto& r : ranges)
+        {
+            if (!src.ptr || r.src_off + r.bytes > src.bytes) return false;
+        }
+#if defined(_WIN32)
+        HANDLE hf = CreateFileA(dst_path.c_str(), GENERIC_WRITE, 0, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (hf == INVALID_HANDLE_VALUE) return false;
+        bool ok = true;
+        for (size_t k = 0; k < ranges.size() && ok; k++)
+        {
+            const char* p = (const char*)src.ptr + ranges[k].src_off;
+            uint64_t off = ranges[k].dst_off;
+            uint64_t n = ranges[k].bytes;
+            while (n && ok)
+            {
+                OVERLAPPED ov{};
+                ov.Offset = (DWORD)(off & 0xffffffff);
+                ov.OffsetHigh = (DWORD)(off >> 32);
+                DWORD want = n < kReadChunk ? (DWORD)n : (DWORD)kReadChunk;
+                DWORD put = 0;
+                ok = WriteFile(hf, p, want, &put, &ov) && put;
+                p += put;
+                off += put;
+                n -= put;
+            }
+        }
+        CloseHandle(hf);
+        return ok;
+#else
+        int fd = open(dst_path.c_str(), O_WRONLY);
+        if (fd < 0) return false;
+        bool ok = true;
+        for (size_t k = 0; k < ranges.size() && ok; k++)
+        {
+            off_t in = (off_t)(src.file_off + ranges[k].src_off);
+            off_t out = (off_t)ranges[k].dst_off;
+            size_t n = (size_t)ranges[k].bytes;
+#if defined(__linux__)
+            // Not every file system pair supports it (EXDEV, EINVAL, ENOSYS); the rest goes through pwrite
+            while (n)
+            {
+                ssize_t c = copy_file_range(src.fd, &in, fd, &out, n, 0);
+                if (c < 0 && errno == EINTR) continue;
+                if (c <= 0) break;
+                n -= (size_t)c;
+            }
+#endif
+            const char* p = (const char*)src.ptr + (in - (off_t)src.file_off);
+            while (n)
+            {
+                ssize_t c = pwrite(fd, p, n, out);
+                if (c < 0 && errno == EINTR) continue;
+                if (c <= 0)
+                {
+                    ok = false;
+                    break;
+                }
+                p += c;
+                out += c;
+                n -= (size_t)c;
+            }
+        }
+        if (close(fd) < 0) ok = false;
+        return ok;
+#endif
+    }
+
+    mmap_rw mmap_file_rw(const std::string& path, size_t bytes)
+    {
+        mmap_rw m;
+        if (!bytes) return m;
+#if defined(_WIN32)
+        HANDLE hf = CreateFileA(path.c_str(), GENERIC_READ | GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (hf == INVALID_HANDLE_VALUE) return m;
+        LARGE_INTEGER sz;
+        sz.QuadPart = (LONGLONG)bytes;
+        HANDLE hm = CreateFileMappingA(hf, nullptr, PAGE_READWRITE, (DWORD)(sz.QuadPart >> 32), (DWORD)(sz.QuadPart & 0xffffffff), nullptr);
+        if (!hm)
+        {
+            CloseHandle(hf);
+            return m;
+        }
+        void* p = MapViewOfFile(hm, FILE_MAP_WRITE, 0, 0, 0);
+        if (!p)
+        {
+            CloseHandle(hm);
+            CloseHandle(hf);
+            return m;
+        }
+        m.ptr = p; m.bytes = bytes; m.hfile = hf; m.hmap = hm;
+#else
+        int fd = open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+        if (fd < 0) return m;
+        if (ftruncate(fd, (off_t)bytes) < 0)
+        {
+            close(fd);
+            return m;
+        }
+        void* p = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (p == MAP_FAILED)
+        {
+            close(fd);
+            return m;
+        }
+        m.ptr = p;
+        m.bytes = bytes;
+        m.fd = fd;
+#endif
+        return m;
+    }
+
+    void munmap_file(mmap_rw& m)
+    {
 #if defined(_WIN32)
         if (m.ptr) UnmapViewOfFile(m.ptr);
         if (m.hmap) CloseHandle((HANDLE)m.hmap);
@@ -2,7 +2,9 @@
 #define DATASET_MMIO_H
 
 #include <cstddef>
+#include <cstdint>
 #include <string>
+#include <vector>
 
 #if defined(_WIN32)
 #define WIN32_LEAN_AND_MEAN
@@ -20,23 +22,95 @@ namespace dataset::detail
     {
         void* ptr;
         size_t bytes;
+        // Underlying mapping when ptr does not start it or it is longer than bytes (header, huge page rounding)
+        void* base;
+        size_t span;
+        // Offset of ptr in the file, non-zero for views of part of a mapping
+        uint64_t file_off;
 #if defined(_WIN32)
         void* hfile;
         void* hmap;
-        mmap_ro() : ptr(nullptr), bytes(0), hfile(nullptr), hmap(nullptr)
+        mmap_ro() : ptr(nullptr), bytes(0), base(nullptr), span(0), file_off(0), hfile(nullptr), hmap(nullptr)
         {
         }
 #else
         int fd;
 
-        mmap_ro() : ptr(nullptr), bytes(0), fd(-1)
+        mmap_ro() : ptr(nullptr), bytes(0), base(nullptr), span(0), file_off(0), fd(-1)
         {
         }
 #endif
     };
 
+    struct mmap_rw
+    {
+        void* ptr;
+        size_t bytes;
+#if defined(_WIN32)
+        void* hfile;
+        void* hmap;
+        mmap_rw() : ptr(nullptr), bytes(0), hfile(nullptr), hmap(nullptr)
+        {
+        }
+#else
+        int fd;
+
+        mmap_rw() : ptr(nullptr), bytes(0), fd(-1)
+        {
+        }
+#endif
+    };
+
+    enum class Advice { Normal, Random, Sequential, WillNeed, DontNeed };
+
     mmap_ro mmap_file_ro(const std::string& path);
+    // Same mapping with every page read in up front (MAP_POPULATE where available)
+    mmap_ro mmap_file_populate(const std::string& path);
+    // Reads the whole file into private anonymous memory, MAP_HUGETLB pages when the system has them reserved
+    // and transparent huge pages otherwise; threads read disjoint chunks
+    mmap_ro copy_file_anon(const std::string& path, uint32_t threads);
+    // Maps the named shared-memory copy of the file, hydrating it first when this process creates it. A
+    // sibling that finds the segment waits for hydration to finish and sets attached, or replaces it when the
+    // creator died before finishing. An empty name is derived from the file's path, size and mtime.
+    mmap_ro map_file_shared(const std::string& path, const std::string& name, uint32_t threads, bool& attached);
+    bool unlink_shared(const std::string& path, const std::string& name);
+    // bytes of m from off on, sharing its descriptor; m owns the mapping and the view is never unmapped
+    mmap_ro sub_view(const mmap_ro& m, size_t off, size_t bytes);
+    // Address range of bytes with nothing readable behind it, for map_file_at to place files in side by side.
+    // munmap_file on it drops every file mapped inside as well. Empty on Windows.
+    mmap_ro reserve_span(size_t bytes);
+    // Maps the file read-only over the reserved pages at addr (page aligned), MAP_POPULATE with populate.
+    // Fails unless the file is exactly bytes long, so it cannot spill over whatever follows it. The pages
+    // belong to the reservation: release_view closes the descriptor and leaves them.
+    mmap_ro map_file_at(const std::string& path, void* addr, size_t bytes, bool populate);
+    void release_view(mmap_ro& m);
+    bool lock_resident(const mmap_ro& m);
+    // One entry per page spanned by m, counted from the page holding m.ptr (lead bytes before it), non-zero
+    // when the page is in RAM. False when the platform cannot tell.
+    bool resident_pages(const mmap_ro& m, size_t& page_bytes, size_t& lead, std::vector<unsigned char>& pages);
+    // Bytes of the mapping currently in RAM
+    size_t resident_bytes(const mmap_ro& m);
     void munmap_file(mmap_ro& m);
+    // Hints the kernel about [off, off + bytes) of a read-only mapping, widened to whole pages. WillNeed and
+    // DontNeed also reach the page cache through the file descriptor. DontNeed does nothing to a mapping with
+    // no descriptor (copy_file_anon), whose pages are the only copy. Best effort; returns false on failure.
+    bool advise_range(const mmap_ro& m, size_t off, size_t bytes, Advice a);
+    struct CopyRange
+    {
+        uint64_t src_off;
+        uint64_t dst_off;
+        uint64_t bytes;
+    };
+
+    // Copies ranges of the file behind src into the existing file at dst_path, inside the kernel where it can
+    // (copy_file_range, which shares extents on reflink-capable file systems) and from the mapping otherwise
+    bool copy_ranges(const mmap_ro& src, const std::string& dst_path, const std::vector<CopyRange>& ranges);
+    // CPU time in seconds, user plus system, of the calling thread and of the whole process
+    double thread_cpu_seconds();
+    double process_cpu_seconds();
+    // Creates or truncates path to exactly bytes (zero filled) and maps it shared read-write
+    mmap_rw mmap_file_rw(const std::string& path, size_t bytes);
+    void munmap_file(mmap_rw& m);
 }
 
 #endif
\ No newline at end of file
@@ -0,0 +1,57 @@
+#ifndef DATASET_PARALLEL_H
+#define DATASET_PARALLEL_H
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <tbb/blocked_range.h>
+#include <tbb/info.h>
+#include <tbb/parallel_for.h>
+#include <tbb/task_arena.h>
+
+namespace dataset::detail
+{
+    // Rows per band are chosen so a band covers about this many output bytes
+    constexpr size_t kBandBytes = 256 << 10;
+
+    // Runs fn(i) for i in [0, n) on a task arena of the given concurrency, capped at the machine's. The
+    // arena is not shrunk to n, so threads without an item of their own help out with the row bands inside
+    // the others.
+    template <class F>
+    void parallel_for(size_t n, uint32_t threads, F&& fn)
+    {
+        if (!n) return;
+        int c = std::clamp((int)std::min<uint32_t>(threads, INT32_MAX), 1, tbb::info::default_concurrency());
+        tbb::task_arena arena(c, 1);
+        arena.execute([&]
+        {
+            tbb::parallel_for(tbb::blocked_range<size_t>(0, n, 1), [&](const tbb::blocked_range<size_t>& r)
+            {
+                for (size_t i = r.begin(); i != r.end(); i++) fn(i);
+            });
+        });
+    }
+
+    // Splits rows [0, rows) into bands of about kBandBytes and runs fn(y0, y1) on each, on the calling
+    // thread's arena. Isolated so a thread waiting on its bands never picks up another whole item.
+    template <class F>
+    void for_bands(size_t rows, size_t row_bytes, F&& fn)
+    {
+        size_t grain = row_bytes ? kBandBytes / row_bytes : rows;
+        if (grain < 1) grain = 1;
+        if (rows <= grain)
+        {
+            if (rows) fn((size_t)0, rows);
+            return;
+        }
+        tbb::this_task_arena::isolate([&]
+        {
+            tbb::parallel_for(tbb::blocked_range<size_t>(0, rows, grain), [&](const tbb::blocked_range<size_t>& r)
+            {
+                fn(r.begin(), r.end());
+            });
+        });
+    }
+}
+
+#endif